@@ -0,0 +1,427 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <drm_fourcc.h>
+#include <hardware/gralloc.h>
+
+#include "counters.h"
+#include "membrane_sim.h"
+
+#include <log.h>
+#include <membrane_meta.h>
+#include <membrane_telemetry.h>
+#include <membrane_time.h>
+
+int hybris_gralloc_allocate(
+    int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride);
+int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
+
+#define BENCH_MAX_BUFFERS 8
+#define BENCH_TIMEOUT_MS 1000
+
+struct commit {
+    uint32_t fb_id;
+    int64_t t_commit;
+    int64_t t_flip;
+};
+
+struct stats {
+    int64_t* v;
+    size_t n;
+};
+
+static struct {
+    int frames;
+    int warmup;
+    int buffers;
+    int width;
+    int height;
+    bool nonblock;
+    const char* name;
+} g_opts = {
+    .frames = 600,
+    .warmup = 60,
+    .buffers = 3,
+    .width = 1080,
+    .height = 2340,
+    .name = "default",
+};
+
+static pid_t spawn(char* const argv[], const char* preload) {
+    pid_t pid = fork();
+    membrane_assert(pid >= 0);
+
+    if (pid == 0) {
+        if (preload)
+            setenv("LD_PRELOAD", preload, 1);
+        else
+            unsetenv("LD_PRELOAD");
+
+        execv(argv[0], argv);
+        membrane_err("exec %s: %s", argv[0], strerror(errno));
+        _exit(127);
+    }
+
+    return pid;
+}
+
+static void reap(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static void* map_shm(const char* name, size_t size, bool create) {
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0600);
+    if (fd < 0)
+        return NULL;
+
+    if (create && ftruncate(fd, size) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return map == MAP_FAILED ? NULL : map;
+}
+
+static struct membrane_telemetry* wait_for_daemon(pid_t daemon) {
+    for (int i = 0; i < BENCH_TIMEOUT_MS / 10; i++) {
+        struct membrane_telemetry* t = map_shm(membrane_telemetry_name(), MEMBRANE_TELEMETRY_SIZE, false);
+
+        if (t && t->magic == MEMBRANE_TELEMETRY_MAGIC)
+            return t;
+        if (t)
+            munmap(t, MEMBRANE_TELEMETRY_SIZE);
+
+        if (waitpid(daemon, NULL, WNOHANG) == daemon)
+            return NULL;
+
+        usleep(10000);
+    }
+
+    return NULL;
+}
+
+static int open_card(void) {
+    for (int i = 0; i < BENCH_TIMEOUT_MS / 10; i++) {
+        int fd = open(MEMBRANE_SIM_NODE, O_RDWR | O_CLOEXEC);
+        if (fd >= 0)
+            return fd;
+
+        usleep(10000);
+    }
+
+    return -1;
+}
+
+static uint32_t add_buffer(int fd) {
+    buffer_handle_t handle = NULL;
+    uint32_t stride = 0;
+
+    int ret = hybris_gralloc_allocate(g_opts.width, g_opts.height, HAL_PIXEL_FORMAT_RGBA_8888,
+        GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER, &handle,
+        &stride);
+    membrane_assert(ret == 0);
+    membrane_assert(membrane_meta_set(fd, handle, stride) == 0);
+
+    struct drm_prime_handle prime = { .fd = handle->data[0] };
+    membrane_assert(ioctl(fd, DRM_IOCTL_PRIME_FD_TO_HANDLE, &prime) == 0);
+
+    struct drm_mode_fb_cmd2 cmd = {
+        .width = g_opts.width,
+        .height = g_opts.height,
+        .pixel_format = DRM_FORMAT_XRGB8888,
+        .handles = { prime.handle },
+        .pitches = { stride * 4 },
+    };
+    membrane_assert(ioctl(fd, DRM_IOCTL_MODE_ADDFB2, &cmd) == 0);
+
+    struct drm_gem_close close_args = { .handle = prime.handle };
+    ioctl(fd, DRM_IOCTL_GEM_CLOSE, &close_args);
+
+    /* the fb and the meta registry hold their own references */
+    hybris_gralloc_release(handle, 1);
+
+    return cmd.fb_id;
+}
+
+static int commit(int fd, uint32_t fb_id, uint32_t mode_id, uint64_t user_data) {
+    uint32_t objs[] = { MEMBRANE_SIM_CRTC_ID, MEMBRANE_SIM_CONNECTOR_ID, MEMBRANE_SIM_PLANE_ID };
+    uint32_t counts[] = { 2, 1, 2 };
+    uint32_t props[] = {
+        MEMBRANE_SIM_PROP_ACTIVE,
+        MEMBRANE_SIM_PROP_MODE_ID,
+        MEMBRANE_SIM_PROP_CRTC_ID,
+        MEMBRANE_SIM_PROP_FB_ID,
+        MEMBRANE_SIM_PROP_CRTC_ID,
+    };
+    uint64_t values[] = { 1, mode_id, MEMBRANE_SIM_CRTC_ID, fb_id, MEMBRANE_SIM_CRTC_ID };
+    struct drm_mode_atomic atomic = {
+        .flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_ALLOW_MODESET,
+        .count_objs = 3,
+        .objs_ptr = (uintptr_t)objs,
+        .count_props_ptr = (uintptr_t)counts,
+        .props_ptr = (uintptr_t)props,
+        .prop_values_ptr = (uintptr_t)values,
+        .user_data = user_data,
+    };
+
+    if (g_opts.nonblock)
+        atomic.flags |= DRM_MODE_ATOMIC_NONBLOCK;
+
+    return ioctl(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
+}
+
+static int64_t wait_flip(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct drm_event_vblank ev;
+
+    if (poll(&pfd, 1, BENCH_TIMEOUT_MS) <= 0)
+        return 0;
+
+    if (read(fd, &ev, sizeof(ev)) != sizeof(ev) || ev.base.type != DRM_EVENT_FLIP_COMPLETE)
+        return 0;
+
+    return membrane_now_ns();
+}
+
+static void stats_add(struct stats* s, int64_t v) { s->v[s->n++] = v; }
+
+static int cmp_i64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_stats(const char* key, struct stats* s, bool last) {
+    if (!s->n) {
+        printf("    \"%s\": null%s\n", key, last ? "" : ",");
+        return;
+    }
+
+    qsort(s->v, s->n, sizeof(int64_t), cmp_i64);
+
+    double sum = 0;
+    for (size_t i = 0; i < s->n; i++)
+        sum += s->v[i];
+
+    printf("    \"%s\": { \"count\": %zu, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+           "\"p99\": %.1f, \"max\": %.1f }%s\n",
+        key, s->n, sum / s->n / 1000.0, s->v[s->n / 2] / 1000.0, s->v[s->n * 90 / 100] / 1000.0,
+        s->v[s->n * 99 / 100] / 1000.0, s->v[s->n - 1] / 1000.0, last ? "" : ",");
+}
+
+/* pairs each daemon frame with the last commit of the same fb that preceded it */
+static const struct commit* match_commit(
+    const struct commit* commits, int n, uint32_t fb_id, int64_t t_event) {
+    const struct commit* best = NULL;
+
+    for (int i = 0; i < n; i++) {
+        if (commits[i].fb_id == fb_id && commits[i].t_commit <= t_event)
+            best = &commits[i];
+    }
+
+    return best;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "usage: %s [-n frames] [-w warmup] [-b buffers] [-s WxH] [-N] [-l label] "
+        "<membrane-sim> <membrane> <sim-preload> <counters-preload>\n",
+        argv0);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:b:s:Nl:")) != -1) {
+        switch (opt) {
+        case 'n':
+            g_opts.frames = atoi(optarg);
+            break;
+        case 'w':
+            g_opts.warmup = atoi(optarg);
+            break;
+        case 'b':
+            g_opts.buffers = atoi(optarg);
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &g_opts.width, &g_opts.height) != 2)
+                usage(argv[0]);
+            break;
+        case 'N':
+            g_opts.nonblock = true;
+            break;
+        case 'l':
+            g_opts.name = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 4 || g_opts.frames <= 0 || g_opts.buffers < 1
+        || g_opts.buffers > BENCH_MAX_BUFFERS)
+        usage(argv[0]);
+
+    char sim_socket[108], telemetry[64], counters_name[64], preload[1024];
+
+    snprintf(sim_socket, sizeof(sim_socket), "/tmp/membrane-bench-%d.sock", getpid());
+    snprintf(telemetry, sizeof(telemetry), "/membrane-bench-telemetry-%d", getpid());
+    snprintf(counters_name, sizeof(counters_name), "/membrane-bench-counters-%d", getpid());
+    snprintf(preload, sizeof(preload), "%s %s", argv[optind + 3], argv[optind + 2]);
+
+    setenv("MEMBRANE_SIM_SOCKET", sim_socket, 1);
+    setenv("MEMBRANE_TELEMETRY_SHM", telemetry, 1);
+    setenv(BENCH_COUNTERS_ENV, counters_name, 1);
+    setenv("MEMBRANE_MOCK_WIDTH", "1080", 0);
+    setenv("MEMBRANE_MOCK_HEIGHT", "2340", 0);
+
+    struct bench_counters* counters = map_shm(counters_name, sizeof(*counters), true);
+    membrane_assert(counters);
+
+    char* sim_argv[] = { argv[optind], NULL };
+    char* daemon_argv[] = { argv[optind + 1], NULL };
+
+    pid_t sim = spawn(sim_argv, NULL);
+
+    for (int i = 0; i < BENCH_TIMEOUT_MS / 10 && access(sim_socket, F_OK) != 0; i++)
+        usleep(10000);
+
+    pid_t daemon = spawn(daemon_argv, preload);
+    struct membrane_telemetry* t = wait_for_daemon(daemon);
+    int fd = t ? open_card() : -1;
+
+    if (fd < 0) {
+        membrane_err("daemon did not come up");
+        reap(daemon);
+        reap(sim);
+        return 1;
+    }
+
+    struct drm_set_client_cap cap = { .capability = DRM_CLIENT_CAP_ATOMIC, .value = 1 };
+    membrane_assert(ioctl(fd, DRM_IOCTL_SET_CLIENT_CAP, &cap) == 0);
+
+    /* the daemon opened the node first and drops master once it's up */
+    for (int i = 0; i < BENCH_TIMEOUT_MS / 10 && ioctl(fd, DRM_IOCTL_SET_MASTER, 0) < 0; i++)
+        usleep(10000);
+
+    uint32_t fbs[BENCH_MAX_BUFFERS];
+    for (int i = 0; i < g_opts.buffers; i++)
+        fbs[i] = add_buffer(fd);
+
+    struct drm_mode_modeinfo mode = {
+        .hdisplay = g_opts.width,
+        .vdisplay = g_opts.height,
+        .vrefresh = 60,
+    };
+    struct drm_mode_create_blob blob = { .data = (uintptr_t)&mode, .length = sizeof(mode) };
+    membrane_assert(ioctl(fd, DRM_IOCTL_MODE_CREATEPROPBLOB, &blob) == 0);
+
+    int total = g_opts.warmup + g_opts.frames;
+    struct commit* commits = calloc(total, sizeof(*commits));
+    uint64_t head = 0;
+    struct bench_counters start = {};
+
+    for (int f = 0; f < total; f++) {
+        if (f == g_opts.warmup) {
+            head = atomic_load(&t->head);
+            start.syscalls = atomic_load(&counters->syscalls);
+            start.allocs = atomic_load(&counters->allocs);
+        }
+
+        commits[f].fb_id = fbs[f % g_opts.buffers];
+        commits[f].t_commit = membrane_now_ns();
+
+        int ret;
+        while ((ret = commit(fd, commits[f].fb_id, blob.blob_id, f)) < 0 && errno == EBUSY)
+            wait_flip(fd);
+
+        if (ret < 0) {
+            membrane_err("atomic commit failed: %s", strerror(errno));
+            break;
+        }
+
+        commits[f].t_flip = wait_flip(fd);
+    }
+
+    /* let the last frames reach the daemon */
+    usleep(100000);
+
+    uint64_t end = atomic_load(&t->head);
+    uint64_t syscalls = atomic_load(&counters->syscalls) - start.syscalls;
+    uint64_t allocs = atomic_load(&counters->allocs) - start.allocs;
+
+    struct stats commit_to_receive = { .v = calloc(total, sizeof(int64_t)) };
+    struct stats receive_to_present = { .v = calloc(total, sizeof(int64_t)) };
+    struct stats flip = { .v = calloc(total, sizeof(int64_t)) };
+    uint64_t frames = 0, hits = 0;
+
+    if (end - head > t->capacity)
+        head = end - t->capacity;
+
+    for (uint64_t i = head; i < end; i++) {
+        struct membrane_frame_record rec;
+
+        if (!membrane_telemetry_read(t, i, &rec) || rec.display != 0)
+            continue;
+
+        frames++;
+        hits += !!(rec.flags & MEMBRANE_FRAME_CACHE_HIT);
+
+        const struct commit* c = match_commit(commits, total, rec.fb_id, rec.t_event);
+        if (c && c >= &commits[g_opts.warmup])
+            stats_add(&commit_to_receive, rec.t_event - c->t_commit);
+
+        if (rec.t_present)
+            stats_add(&receive_to_present, rec.t_present - rec.t_event);
+    }
+
+    for (int f = g_opts.warmup; f < total; f++) {
+        if (commits[f].t_flip)
+            stats_add(&flip, commits[f].t_flip - commits[f].t_commit);
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"%s\",\n", g_opts.name);
+    printf("  \"config\": { \"frames\": %d, \"buffers\": %d, \"width\": %d, \"height\": %d, "
+           "\"nonblock\": %s },\n",
+        g_opts.frames, g_opts.buffers, g_opts.width, g_opts.height,
+        g_opts.nonblock ? "true" : "false");
+    printf("  \"daemon_frames\": %" PRIu64 ",\n", frames);
+    printf("  \"cache_hit_rate\": %.3f,\n", frames ? (double)hits / frames : 0.0);
+    printf("  \"syscalls_per_frame\": %.2f,\n", frames ? (double)syscalls / frames : 0.0);
+    printf("  \"allocs_per_frame\": %.2f,\n", frames ? (double)allocs / frames : 0.0);
+    printf("  \"latency_us\": {\n");
+    print_stats("commit_to_receive", &commit_to_receive, false);
+    print_stats("receive_to_present", &receive_to_present, false);
+    print_stats("flip_event", &flip, true);
+    printf("  }\n");
+    printf("}\n");
+
+    close(fd);
+    reap(daemon);
+    reap(sim);
+
+    shm_unlink(telemetry);
+    shm_unlink(counters_name);
+    unlink(sim_socket);
+
+    return frames ? 0 : 1;
+}
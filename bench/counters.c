@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+/*
+ * Counts calls into libc syscall wrappers and the allocator. Calls made while another
+ * wrapper is running (e.g. the simulator shim turning an ioctl into sendmsg/recvmsg)
+ * are not counted, so the numbers match what the process would do on real hardware.
+ */
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+static struct bench_counters g_local;
+static struct bench_counters* g_counters = &g_local;
+static __thread int t_depth;
+
+__attribute__((constructor)) static void counters_init(void) {
+    const char* name = getenv(BENCH_COUNTERS_ENV);
+    if (!name)
+        return;
+
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0)
+        return;
+
+    void* map = mmap(NULL, sizeof(*g_counters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map != MAP_FAILED)
+        g_counters = map;
+}
+
+#define REAL(name) ((__typeof__(&name))dlsym(RTLD_NEXT, #name))
+
+#define COUNTED(expr)                                                                              \
+    ({                                                                                             \
+        if (!t_depth)                                                                              \
+            atomic_fetch_add_explicit(&g_counters->syscalls, 1, memory_order_relaxed);             \
+        t_depth++;                                                                                 \
+        __auto_type __ret = (expr);                                                                \
+        t_depth--;                                                                                 \
+        __ret;                                                                                     \
+    })
+
+#define WRAP(ret, name, params, args)                                                              \
+    ret name params {                                                                              \
+        static __typeof__(&name) real;                                                             \
+        if (!real)                                                                                 \
+            real = REAL(name);                                                                     \
+        return COUNTED(real args);                                                                 \
+    }
+
+WRAP(ssize_t, read, (int fd, void* buf, size_t n), (fd, buf, n))
+WRAP(ssize_t, write, (int fd, const void* buf, size_t n), (fd, buf, n))
+WRAP(int, close, (int fd), (fd))
+WRAP(int, poll, (struct pollfd * fds, nfds_t n, int timeout), (fds, n, timeout))
+WRAP(int, ppoll,
+    (struct pollfd * fds, nfds_t n, const struct timespec* t, const sigset_t* mask),
+    (fds, n, t, mask))
+WRAP(void*, mmap, (void* addr, size_t len, int prot, int flags, int fd, off_t off),
+    (addr, len, prot, flags, fd, off))
+WRAP(int, munmap, (void* addr, size_t len), (addr, len))
+WRAP(int, dup, (int fd), (fd))
+WRAP(int, ftruncate, (int fd, off_t len), (fd, len))
+WRAP(int, memfd_create, (const char* name, unsigned int flags), (name, flags))
+WRAP(ssize_t, sendmsg, (int fd, const struct msghdr* msg, int flags), (fd, msg, flags))
+WRAP(ssize_t, recvmsg, (int fd, struct msghdr* msg, int flags), (fd, msg, flags))
+WRAP(int, nanosleep, (const struct timespec* req, struct timespec* rem), (req, rem))
+WRAP(int, clock_nanosleep,
+    (clockid_t clk, int flags, const struct timespec* req, struct timespec* rem),
+    (clk, flags, req, rem))
+
+int ioctl(int fd, unsigned long request, ...) {
+    static int (*real)(int, unsigned long, ...);
+    va_list ap;
+
+    va_start(ap, request);
+    void* arg = va_arg(ap, void*);
+    va_end(ap);
+
+    if (!real)
+        real = dlsym(RTLD_NEXT, "ioctl");
+
+    return COUNTED(real(fd, request, arg));
+}
+
+int fcntl(int fd, int cmd, ...) {
+    static int (*real)(int, int, ...);
+    va_list ap;
+
+    va_start(ap, cmd);
+    void* arg = va_arg(ap, void*);
+    va_end(ap);
+
+    if (!real)
+        real = dlsym(RTLD_NEXT, "fcntl");
+
+    return COUNTED(real(fd, cmd, arg));
+}
+
+int open(const char* path, int flags, ...) {
+    static int (*real)(const char*, int, ...);
+    va_list ap;
+
+    va_start(ap, flags);
+    mode_t mode = va_arg(ap, mode_t);
+    va_end(ap);
+
+    if (!real)
+        real = dlsym(RTLD_NEXT, "open");
+
+    return COUNTED(real(path, flags, mode));
+}
+
+int openat(int dirfd, const char* path, int flags, ...) {
+    static int (*real)(int, const char*, int, ...);
+    va_list ap;
+
+    va_start(ap, flags);
+    mode_t mode = va_arg(ap, mode_t);
+    va_end(ap);
+
+    if (!real)
+        real = dlsym(RTLD_NEXT, "openat");
+
+    return COUNTED(real(dirfd, path, flags, mode));
+}
+
+void* malloc(size_t size) {
+    atomic_fetch_add_explicit(&g_counters->allocs, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&g_counters->allocs, 1, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&g_counters->allocs, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    if (ptr)
+        atomic_fetch_add_explicit(&g_counters->frees, 1, memory_order_relaxed);
+    __libc_free(ptr);
+}
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef BENCH_COUNTERS_H
+#define BENCH_COUNTERS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* shm segment the counters preload publishes into, named by this variable */
+#define BENCH_COUNTERS_ENV "MEMBRANE_BENCH_COUNTERS"
+
+struct bench_counters {
+    _Atomic uint64_t syscalls;
+    _Atomic uint64_t allocs;
+    _Atomic uint64_t frees;
+};
+
+#endif /* BENCH_COUNTERS_H */
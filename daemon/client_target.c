@@ -0,0 +1,454 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <hardware/gralloc.h>
+
+#include "client_target.h"
+#include "rwb.h"
+
+#include <log.h>
+
+#define CLIENT_TARGET_BUFFERS 3
+#define CLIENT_TARGET_SOURCES 8
+#define CLIENT_TARGET_FENCE_TIMEOUT_MS 100
+
+int hybris_gralloc_allocate(
+    int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride);
+int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
+
+static PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_func = NULL;
+static PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_func = NULL;
+static PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR_func = NULL;
+static PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR_func = NULL;
+static PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID_func = NULL;
+static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES_func = NULL;
+static PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC glEGLImageTargetRenderbufferStorageOES_func
+    = NULL;
+
+static const char* s_vertex_src = "attribute vec2 pos;\n"
+                                  "varying vec2 uv;\n"
+                                  "void main() {\n"
+                                  "    uv = pos * 0.5 + 0.5;\n"
+                                  "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+                                  "}\n";
+
+static const char* s_fragment_src = "#extension GL_OES_EGL_image_external : require\n"
+                                    "precision mediump float;\n"
+                                    "uniform samplerExternalOES tex;\n"
+                                    "varying vec2 uv;\n"
+                                    "void main() {\n"
+                                    "    gl_FragColor = texture2D(tex, uv);\n"
+                                    "}\n";
+
+static const GLfloat s_quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+struct client_target {
+    int width;
+    int height;
+
+    EGLDisplay dpy;
+    EGLContext ctx;
+    EGLSurface surface;
+    GLuint program;
+    GLint tex_loc;
+
+    struct {
+        buffer_handle_t handle;
+        struct ANativeWindowBuffer* anw;
+        EGLImageKHR image;
+        GLuint rbo;
+        GLuint fbo;
+        int release_fence;
+    } slots[CLIENT_TARGET_BUFFERS];
+    uint32_t next;
+    int prev;
+
+    struct {
+        struct ANativeWindowBuffer* anw;
+        EGLImageKHR image;
+        GLuint tex;
+    } sources[CLIENT_TARGET_SOURCES];
+    uint32_t next_source;
+};
+
+static void init_egl_funcs(void) {
+    if (eglCreateImageKHR_func)
+        return;
+
+    eglCreateImageKHR_func = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    eglDestroyImageKHR_func = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    eglCreateSyncKHR_func = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+    eglDestroySyncKHR_func = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+    eglDupNativeFenceFDANDROID_func
+        = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+    glEGLImageTargetTexture2DOES_func
+        = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    glEGLImageTargetRenderbufferStorageOES_func
+        = (PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC)eglGetProcAddress(
+            "glEGLImageTargetRenderbufferStorageOES");
+}
+
+static void fence_wait(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ret;
+
+    do {
+        ret = poll(&pfd, 1, CLIENT_TARGET_FENCE_TIMEOUT_MS);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+    if (ret == 0)
+        membrane_err("client target release fence timed out");
+}
+
+static GLuint compile_shader(GLenum type, const char* src) {
+    GLuint shader = glCreateShader(type);
+    GLint ok = 0;
+
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        membrane_err("shader compile failed: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static bool init_program(client_target_t* ct) {
+    GLuint vs = compile_shader(GL_VERTEX_SHADER, s_vertex_src);
+    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, s_fragment_src);
+    GLint ok = 0;
+
+    if (!vs || !fs) {
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        return false;
+    }
+
+    ct->program = glCreateProgram();
+    glAttachShader(ct->program, vs);
+    glAttachShader(ct->program, fs);
+    glBindAttribLocation(ct->program, 0, "pos");
+    glLinkProgram(ct->program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    glGetProgramiv(ct->program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        membrane_err("program link failed");
+        return false;
+    }
+
+    ct->tex_loc = glGetUniformLocation(ct->program, "tex");
+    return true;
+}
+
+static bool init_egl(client_target_t* ct) {
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE,
+        EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE,
+        EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE,
+        8,
+        EGL_GREEN_SIZE,
+        8,
+        EGL_BLUE_SIZE,
+        8,
+        EGL_ALPHA_SIZE,
+        8,
+        EGL_NONE,
+    };
+    static const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    static const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    EGLConfig config;
+    EGLint num_configs = 0;
+
+    ct->dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (ct->dpy == EGL_NO_DISPLAY || !eglInitialize(ct->dpy, NULL, NULL)) {
+        membrane_err("eglInitialize failed: 0x%x", eglGetError());
+        return false;
+    }
+
+    if (!eglChooseConfig(ct->dpy, config_attribs, &config, 1, &num_configs) || num_configs < 1) {
+        membrane_err("eglChooseConfig failed: 0x%x", eglGetError());
+        return false;
+    }
+
+    ct->ctx = eglCreateContext(ct->dpy, config, EGL_NO_CONTEXT, context_attribs);
+    if (ct->ctx == EGL_NO_CONTEXT) {
+        membrane_err("eglCreateContext failed: 0x%x", eglGetError());
+        return false;
+    }
+
+    ct->surface = eglCreatePbufferSurface(ct->dpy, config, pbuffer_attribs);
+    if (!eglMakeCurrent(ct->dpy, ct->surface, ct->surface, ct->ctx)) {
+        membrane_err("eglMakeCurrent failed: 0x%x", eglGetError());
+        return false;
+    }
+
+    init_egl_funcs();
+    if (!eglCreateImageKHR_func || !glEGLImageTargetTexture2DOES_func
+        || !glEGLImageTargetRenderbufferStorageOES_func) {
+        membrane_err("EGLImage extensions missing");
+        return false;
+    }
+
+    return true;
+}
+
+static EGLImageKHR create_image(client_target_t* ct, struct ANativeWindowBuffer* anw) {
+    static const EGLint attribs[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+
+    EGLImageKHR image = eglCreateImageKHR_func(
+        ct->dpy, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, (EGLClientBuffer)anw, attribs);
+    if (image == EGL_NO_IMAGE_KHR)
+        membrane_err("eglCreateImageKHR failed: 0x%x", eglGetError());
+
+    return image;
+}
+
+static bool init_slots(client_target_t* ct) {
+    int usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
+
+    for (int i = 0; i < CLIENT_TARGET_BUFFERS; i++) {
+        uint32_t stride = 0;
+
+        if (hybris_gralloc_allocate(ct->width, ct->height, HAL_PIXEL_FORMAT_RGBA_8888, usage,
+                &ct->slots[i].handle, &stride)
+            != 0) {
+            membrane_err("client target allocation failed");
+            return false;
+        }
+
+        rwb_t* rwb = rwb_new(
+            ct->slots[i].handle, ct->width, ct->height, stride, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+        if (!rwb)
+            return false;
+
+        /* the window buffer owns the handle from here on */
+        rwb_set_allocated(rwb);
+        ct->slots[i].handle = NULL;
+        ct->slots[i].anw = rwb_get_native(rwb);
+        ct->slots[i].image = create_image(ct, ct->slots[i].anw);
+        if (ct->slots[i].image == EGL_NO_IMAGE_KHR)
+            return false;
+
+        glGenRenderbuffers(1, &ct->slots[i].rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, ct->slots[i].rbo);
+        glEGLImageTargetRenderbufferStorageOES_func(GL_RENDERBUFFER, ct->slots[i].image);
+
+        glGenFramebuffers(1, &ct->slots[i].fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, ct->slots[i].fbo);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ct->slots[i].rbo);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            membrane_err("client target framebuffer incomplete");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void client_target_init(void) {
+    /* the daemon only renders offscreen, keep hybris away from the wayland platform */
+    setenv("EGL_PLATFORM", "null", 1);
+}
+
+client_target_t* client_target_new(int width, int height) {
+    client_target_t* ct = calloc(1, sizeof(*ct));
+    if (!ct)
+        return NULL;
+
+    ct->width = width;
+    ct->height = height;
+    ct->prev = -1;
+    ct->ctx = EGL_NO_CONTEXT;
+    ct->surface = EGL_NO_SURFACE;
+    for (int i = 0; i < CLIENT_TARGET_BUFFERS; i++)
+        ct->slots[i].release_fence = -1;
+
+    if (!init_egl(ct) || !init_program(ct) || !init_slots(ct)) {
+        membrane_err("client composition unavailable");
+        client_target_destroy(ct);
+        return NULL;
+    }
+
+    membrane_debug("client target %dx%d ready", width, height);
+
+    return ct;
+}
+
+/* also tears down a target that failed halfway through client_target_new */
+void client_target_destroy(client_target_t* ct) {
+    if (!ct)
+        return;
+
+    client_target_flush_sources(ct);
+
+    /* gl names only exist if the context was made current */
+    bool current = ct->ctx != EGL_NO_CONTEXT && eglGetCurrentContext() == ct->ctx;
+
+    for (int i = 0; i < CLIENT_TARGET_BUFFERS; i++) {
+        if (ct->slots[i].release_fence >= 0)
+            close(ct->slots[i].release_fence);
+
+        if (current && ct->slots[i].fbo)
+            glDeleteFramebuffers(1, &ct->slots[i].fbo);
+        if (current && ct->slots[i].rbo)
+            glDeleteRenderbuffers(1, &ct->slots[i].rbo);
+
+        if (ct->slots[i].image != EGL_NO_IMAGE_KHR)
+            eglDestroyImageKHR_func(ct->dpy, ct->slots[i].image);
+        if (ct->slots[i].anw)
+            ct->slots[i].anw->common.decRef(&ct->slots[i].anw->common);
+        else if (ct->slots[i].handle)
+            hybris_gralloc_release(ct->slots[i].handle, 1);
+    }
+
+    if (current && ct->program)
+        glDeleteProgram(ct->program);
+
+    if (ct->dpy != EGL_NO_DISPLAY) {
+        if (current)
+            eglMakeCurrent(ct->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (ct->surface != EGL_NO_SURFACE)
+            eglDestroySurface(ct->dpy, ct->surface);
+        if (ct->ctx != EGL_NO_CONTEXT)
+            eglDestroyContext(ct->dpy, ct->ctx);
+    }
+
+    free(ct);
+}
+
+bool client_target_fits(client_target_t* ct, int width, int height) {
+    return ct->width == width && ct->height == height;
+}
+
+static GLuint source_texture(client_target_t* ct, struct ANativeWindowBuffer* anw) {
+    for (int i = 0; i < CLIENT_TARGET_SOURCES; i++) {
+        if (ct->sources[i].anw == anw)
+            return ct->sources[i].tex;
+    }
+
+    EGLImageKHR image = create_image(ct, anw);
+    if (image == EGL_NO_IMAGE_KHR)
+        return 0;
+
+    uint32_t idx = ct->next_source;
+    ct->next_source = (ct->next_source + 1) % CLIENT_TARGET_SOURCES;
+
+    if (ct->sources[idx].anw) {
+        glDeleteTextures(1, &ct->sources[idx].tex);
+        eglDestroyImageKHR_func(ct->dpy, ct->sources[idx].image);
+        ct->sources[idx].anw->common.decRef(&ct->sources[idx].anw->common);
+    }
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, tex);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glEGLImageTargetTexture2DOES_func(GL_TEXTURE_EXTERNAL_OES, image);
+
+    anw->common.incRef(&anw->common);
+    ct->sources[idx].anw = anw;
+    ct->sources[idx].image = image;
+    ct->sources[idx].tex = tex;
+
+    return tex;
+}
+
+void client_target_flush_sources(client_target_t* ct) {
+    if (!ct)
+        return;
+
+    for (int i = 0; i < CLIENT_TARGET_SOURCES; i++) {
+        if (!ct->sources[i].anw)
+            continue;
+
+        glDeleteTextures(1, &ct->sources[i].tex);
+        eglDestroyImageKHR_func(ct->dpy, ct->sources[i].image);
+        ct->sources[i].anw->common.decRef(&ct->sources[i].anw->common);
+        ct->sources[i].anw = NULL;
+    }
+}
+
+int client_target_render(client_target_t* ct, struct ANativeWindowBuffer* src, uint32_t* slot,
+    struct ANativeWindowBuffer** target, int* acquire_fence) {
+    uint32_t idx = ct->next;
+
+    GLuint tex = source_texture(ct, src);
+    if (!tex)
+        return -1;
+
+    if (ct->slots[idx].release_fence >= 0) {
+        fence_wait(ct->slots[idx].release_fence);
+        close(ct->slots[idx].release_fence);
+        ct->slots[idx].release_fence = -1;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, ct->slots[idx].fbo);
+    glViewport(0, 0, ct->width, ct->height);
+    glDisable(GL_BLEND);
+
+    glUseProgram(ct->program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, tex);
+    glUniform1i(ct->tex_loc, 0);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, s_quad);
+    glEnableVertexAttribArray(0);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    *acquire_fence = -1;
+    if (eglDupNativeFenceFDANDROID_func && eglCreateSyncKHR_func) {
+        EGLSyncKHR sync = eglCreateSyncKHR_func(ct->dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+        if (sync != EGL_NO_SYNC_KHR) {
+            glFlush();
+            *acquire_fence = eglDupNativeFenceFDANDROID_func(ct->dpy, sync);
+            eglDestroySyncKHR_func(ct->dpy, sync);
+        }
+    }
+
+    if (*acquire_fence < 0)
+        glFinish();
+
+    *slot = idx;
+    *target = ct->slots[idx].anw;
+    ct->next = (idx + 1) % CLIENT_TARGET_BUFFERS;
+
+    return 0;
+}
+
+void client_target_presented(client_target_t* ct, bool used, int present_fence) {
+    if (!ct)
+        return;
+
+    /* the previous target stays on screen until this frame's present fence signals */
+    if (ct->prev >= 0 && present_fence >= 0) {
+        if (ct->slots[ct->prev].release_fence >= 0)
+            close(ct->slots[ct->prev].release_fence);
+        ct->slots[ct->prev].release_fence = dup(present_fence);
+    }
+
+    ct->prev = used ? (int)((ct->next + CLIENT_TARGET_BUFFERS - 1) % CLIENT_TARGET_BUFFERS) : -1;
+}
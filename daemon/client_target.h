@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef CLIENT_TARGET_H
+#define CLIENT_TARGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <system/window.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct client_target client_target_t;
+
+/* sets up the environment EGL reads, must be called before any thread starts */
+void client_target_init(void);
+
+client_target_t* client_target_new(int width, int height);
+
+/* must be called from the thread that created the client target */
+void client_target_destroy(client_target_t* ct);
+
+bool client_target_fits(client_target_t* ct, int width, int height);
+
+/* must be called from the thread that created the client target */
+int client_target_render(client_target_t* ct, struct ANativeWindowBuffer* src, uint32_t* slot,
+    struct ANativeWindowBuffer** target, int* acquire_fence);
+
+void client_target_presented(client_target_t* ct, bool used, int present_fence);
+
+void client_target_flush_sources(client_target_t* ct);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLIENT_TARGET_H */
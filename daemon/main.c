@@ -7,339 +7,499 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <hybris/hwc2/hwc2_compatibility_layer.h>
 #include <libdroid/leds.h>
 #include <xf86drm.h>
 
-#include "rwb.h"
+#include "client_target.h"
+#include "present.h"
+#include "present_sched.h"
+#include "record.h"
+#include "rt.h"
+#include "telemetry.h"
 
 #include <log.h>
 #include <membrane.h>
-
-int hybris_gralloc_allocate(
-    int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride);
-int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
-int hybris_gralloc_import_buffer(buffer_handle_t raw_handle, buffer_handle_t* out_handle);
-
-static uint32_t g_stride = 0;
-static bool g_display_enabled = false;
+#include <membrane_time.h>
+
+#define MEMBRANE_CARD "/dev/dri/by-path/platform-membrane-card"
+
+void hybris_gralloc_initialize(int framebuffer);
+
+/* one HWC display driving one membrane pipe, presented from its own thread */
+struct membrane_display {
+    int index;
+    hwc2_compat_display_t* hwc;
+    HWC2DisplayConfig* cfg;
+    present_t* present;
+    present_sched_t sched;
+    int mfd;
+    pthread_t thread;
+    bool active;
+    bool enabled;
+};
+
+struct membrane_hotplug {
+    int32_t index;
+    bool connected;
+};
+
+static struct membrane_display g_displays[MEMBRANE_MAX_DISPLAYS];
+static hwc2_compat_device_t* g_device = NULL;
+static int g_control_fd = -1;
+static int g_hotplug_pipe[2] = { -1, -1 };
 static DroidLeds* g_droid_leds = NULL;
 static bool g_has_backlight = false;
-static bool g_backlight_slept = false;
-static hwc2_compat_layer_t* g_layer = NULL;
 
-#define BUFFER_CACHE_SIZE 64
+enum backlight_state {
+    BACKLIGHT_ON,
+    BACKLIGHT_DOZE,
+    BACKLIGHT_OFF,
+};
+
+/* libdroid can block for a while, so the backlight is driven from its own thread */
 static struct {
-    uint32_t id;
-    struct ANativeWindowBuffer* anw;
-} g_buffer_cache[BUFFER_CACHE_SIZE];
-
-static void clear_buffer_cache(void) {
-    for (int i = 0; i < BUFFER_CACHE_SIZE; i++) {
-        if (g_buffer_cache[i].anw) {
-            g_buffer_cache[i].anw->common.decRef(&g_buffer_cache[i].anw->common);
-            g_buffer_cache[i].anw = NULL;
-        }
-        g_buffer_cache[i].id = 0;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    enum backlight_state want;
+    enum backlight_state state;
+    guint level;
+    guint doze_level;
+} g_backlight = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void backlight_apply(enum backlight_state state) {
+    guint level = g_backlight.level ? g_backlight.level : 5;
+
+    if (state == BACKLIGHT_OFF) {
+        guint current = droid_leds_get_backlight(g_droid_leds);
+        if (g_backlight.state == BACKLIGHT_ON && current)
+            g_backlight.level = current;
+        level = 0;
+    } else if (state == BACKLIGHT_DOZE && g_backlight.doze_level) {
+        level = g_backlight.doze_level;
     }
-}
-
-static uint32_t get_stride(int width, int height, int format, int usage) {
-    buffer_handle_t handle = NULL;
-    uint32_t stride = 0;
 
-    int ret = hybris_gralloc_allocate(width, height, format, usage, &handle, &stride);
+    droid_leds_set_backlight(g_droid_leds, level, FALSE);
+}
 
-    membrane_assert(ret == 0);
-    membrane_assert(handle);
-    membrane_assert(stride > 0);
+static void* backlight_thread(void* data) {
+    pthread_setname_np(pthread_self(), "membrane-leds");
 
-    hybris_gralloc_release(handle, 1);
+    pthread_mutex_lock(&g_backlight.lock);
 
-    return stride;
-}
+    for (;;) {
+        while (g_backlight.want == g_backlight.state)
+            pthread_cond_wait(&g_backlight.cond, &g_backlight.lock);
 
-static void membrane_send_cfg(int fd, HWC2DisplayConfig* cfg) {
-    struct membrane_u2k_cfg u = {
-        .w = cfg->width,
-        .h = cfg->height,
-        .r = (cfg->vsyncPeriod > 0) ? (int)lround(1e9 / cfg->vsyncPeriod) : 60,
-        .__reserved = 0,
-    };
+        enum backlight_state want = g_backlight.want;
+        pthread_mutex_unlock(&g_backlight.lock);
 
-    if (u.r <= 0)
-        u.r = 60;
+        backlight_apply(want);
 
-    int ret = ioctl(fd, DRM_IOCTL_MEMBRANE_CONFIG, &u);
-    membrane_assert(ret == 0);
+        pthread_mutex_lock(&g_backlight.lock);
+        g_backlight.state = want;
+    }
 
-    membrane_debug("sent cfg %dx%d@%d", u.w, u.h, u.r);
+    return NULL;
 }
 
-static buffer_handle_t import_buffer_from_fds(int* fds, int num_fds) {
-    if (num_fds < 2)
-        return NULL;
+static void set_backlight(enum backlight_state state) {
+    if (!g_has_backlight)
+        return;
 
-    int meta_fd = fds[num_fds - 1];
-    int plane_fds = num_fds - 1;
+    pthread_mutex_lock(&g_backlight.lock);
+    g_backlight.want = state;
+    pthread_cond_signal(&g_backlight.cond);
+    pthread_mutex_unlock(&g_backlight.lock);
+}
 
-    struct stat sb;
-    if (fstat(meta_fd, &sb) < 0 || sb.st_size <= 0)
-        return NULL;
+static void* leds_init(void* data) {
+    GError* err = NULL;
 
-    int ints[128];
-    if (sb.st_size > (off_t)sizeof(ints)) {
-        membrane_err("metadata too large (%zd bytes)", (size_t)sb.st_size);
+    g_droid_leds = droid_leds_new(&err);
+    if (err) {
+        membrane_err("libdroid: init failed: %s", err->message);
+        g_error_free(err);
+        g_droid_leds = NULL;
         return NULL;
     }
 
-    int num_ints = sb.st_size / sizeof(int);
+    const char* doze = getenv("MEMBRANE_DOZE_BACKLIGHT");
 
-    lseek(meta_fd, 0, SEEK_SET);
-    if (read(meta_fd, ints, sb.st_size) != (ssize_t)sb.st_size)
-        return NULL;
+    g_backlight.level = droid_leds_get_backlight(g_droid_leds);
+    g_backlight.doze_level = doze ? strtoul(doze, NULL, 0) : 0;
 
-    native_handle_t* nh = native_handle_create(plane_fds, num_ints);
-    membrane_assert(nh);
-
-    for (int i = 0; i < plane_fds; i++)
-        nh->data[i] = fds[i];
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, backlight_thread, NULL) != 0) {
+        membrane_err("libdroid: pthread_create failed");
+        return NULL;
+    }
 
-    for (int i = 0; i < num_ints; i++)
-        nh->data[plane_fds + i] = ints[i];
+    pthread_detach(thread);
+    g_has_backlight = true;
 
-    buffer_handle_t handle = NULL;
-    hybris_gralloc_import_buffer(nh, &handle);
+    membrane_debug("libdroid: backlight control enabled");
 
-    native_handle_delete(nh);
+    return NULL;
+}
 
-    return handle;
+static void* gralloc_init(void* data) {
+    hybris_gralloc_initialize(0);
+    return NULL;
 }
 
-static void do_present_block(hwc2_compat_display_t* display, struct ANativeWindowBuffer* anw) {
-    uint32_t numTypes = 0;
-    uint32_t numReqs = 0;
+static int membrane_open(void) {
+    int fd = open(MEMBRANE_CARD, O_RDWR | O_CLOEXEC);
+    if (fd >= 0)
+        drmDropMaster(fd);
+    return fd;
+}
 
-    hwc2_compat_layer_set_buffer(g_layer, 0, anw, -1);
+static int membrane_send_cfg(int fd, int index, HWC2DisplayConfig* cfg) {
+    const char* doze = getenv("MEMBRANE_DOZE_REFRESH");
+    struct membrane_u2k_cfg u = {
+        .display = index,
+    };
 
-    hwc2_error_t err = hwc2_compat_display_validate(display, &numTypes, &numReqs);
+    /* no config sends a zero sized mode, which unplugs the pipe */
+    if (cfg) {
+        u.w = cfg->width;
+        u.h = cfg->height;
+        u.r = (cfg->vsyncPeriod > 0) ? (int)lround(1e9 / cfg->vsyncPeriod) : 60;
+        if (u.r <= 0)
+            u.r = 60;
 
-    if (err != HWC2_ERROR_NONE && err != HWC2_ERROR_HAS_CHANGES) {
-        membrane_err("validate failed: %d", err);
-        return;
+        u.doze_r = doze ? atoi(doze) : 10;
     }
 
-    if (numTypes || numReqs) {
-        err = hwc2_compat_display_accept_changes(display);
-        if (err != HWC2_ERROR_NONE) {
-            membrane_err("accept_changes failed: %d", err);
-            return;
-        }
+    int ret = ioctl(fd, DRM_IOCTL_MEMBRANE_CONFIG, &u);
+    if (ret < 0) {
+        membrane_err("display %d: MEMBRANE_CONFIG: %s", index, strerror(errno));
+        return ret;
     }
 
-    int32_t presentFence = -1;
-    err = hwc2_compat_display_present(display, &presentFence);
+    membrane_debug(
+        "display %d: sent cfg %dx%d@%d (doze @%d)", index, u.w, u.h, u.r, u.doze_r);
+    return 0;
+}
 
-    if (err != HWC2_ERROR_NONE) {
-        membrane_err("present failed: %d", err);
-        return;
+static const char* power_mode_name(hwc2_power_mode_t mode) {
+    switch (mode) {
+    case HWC2_POWER_MODE_ON:
+        return "ON";
+    case HWC2_POWER_MODE_DOZE:
+        return "DOZE";
+    case HWC2_POWER_MODE_DOZE_SUSPEND:
+        return "DOZE_SUSPEND";
+    default:
+        return "OFF";
     }
-
-    if (presentFence >= 0)
-        close(presentFence);
 }
 
-static struct ANativeWindowBuffer* membrane_handle_present(int mfd) {
-    struct membrane_get_present_fd arg = {};
-
-    if (ioctl(mfd, DRM_IOCTL_MEMBRANE_GET_PRESENT_FD, &arg) < 0) {
-        membrane_err("MEMBRANE_GET_PRESENT_FD: %s", strerror(errno));
-        return NULL;
+static hwc2_power_mode_t dpms_power_mode(uint32_t value) {
+    switch (value) {
+    case MEMBRANE_DPMS_ON:
+        return HWC2_POWER_MODE_ON;
+    case MEMBRANE_DPMS_DOZE:
+        return HWC2_POWER_MODE_DOZE;
+    case MEMBRANE_DPMS_DOZE_SUSPEND:
+        return HWC2_POWER_MODE_DOZE_SUSPEND;
+    default:
+        return HWC2_POWER_MODE_OFF;
     }
+}
 
-    uint32_t slot = arg.buffer_id % BUFFER_CACHE_SIZE;
-    if (g_buffer_cache[slot].anw && g_buffer_cache[slot].id == arg.buffer_id) {
-        for (uint32_t i = 0; i < arg.num_fds; i++) {
-            if (arg.fds[i] >= 0)
-                close(arg.fds[i]);
-        }
-        struct ANativeWindowBuffer* anw = g_buffer_cache[slot].anw;
-        anw->common.incRef(&anw->common);
-        return anw;
+static void handle_dpms_event(struct membrane_display* d, uint32_t value) {
+    if (value == MEMBRANE_DPMS_NO_COMP) {
+        clear_buffer_cache(d->present);
+        membrane_debug("display %d: DPMS NO_COMP (cache cleared)", d->index);
+        return;
     }
 
-    if (arg.num_fds < 2) {
-        membrane_err("insufficient fds (%u)", arg.num_fds);
-        for (uint32_t i = 0; i < arg.num_fds; i++) {
-            if (arg.fds[i] >= 0)
-                close(arg.fds[i]);
-        }
-        return NULL;
-    }
+    hwc2_power_mode_t mode = dpms_power_mode(value);
+    /* doze-suspend stops updating the panel, nothing to pace against */
+    bool vsync = mode == HWC2_POWER_MODE_ON || mode == HWC2_POWER_MODE_DOZE;
 
-    buffer_handle_t handle = import_buffer_from_fds(arg.fds, arg.num_fds);
+    d->enabled = mode != HWC2_POWER_MODE_OFF;
 
-    for (uint32_t i = 0; i < arg.num_fds; i++) {
-        if (arg.fds[i] >= 0)
-            close(arg.fds[i]);
-    }
+    /* the backlight belongs to the internal panel */
+    if (mode == HWC2_POWER_MODE_OFF && d->index == 0)
+        set_backlight(BACKLIGHT_OFF);
 
-    if (!handle)
-        return NULL;
+    hwc2_compat_display_set_vsync_enabled(d->hwc, HWC2_VSYNC_DISABLE);
+    present_sched_reset(&d->sched);
 
-    rwb_t* rwb = rwb_new(handle);
-    if (!rwb) {
-        hybris_gralloc_release(handle, 1);
-        return NULL;
-    }
+    if (hwc2_compat_display_set_power_mode(d->hwc, mode) != HWC2_ERROR_NONE)
+        return;
 
-    struct ANativeWindowBuffer* anw = rwb_get_native(rwb);
+    if (vsync)
+        hwc2_compat_display_set_vsync_enabled(d->hwc, HWC2_VSYNC_ENABLE);
 
-    if (g_buffer_cache[slot].anw) {
-        g_buffer_cache[slot].anw->common.decRef(&g_buffer_cache[slot].anw->common);
-    }
-    g_buffer_cache[slot].id = arg.buffer_id;
-    g_buffer_cache[slot].anw = anw;
-    anw->common.incRef(&anw->common);
+    if (d->enabled && d->index == 0)
+        set_backlight(mode == HWC2_POWER_MODE_ON ? BACKLIGHT_ON : BACKLIGHT_DOZE);
 
-    return anw;
+    membrane_debug("display %d: DPMS %s", d->index, power_mode_name(mode));
 }
 
-static void handle_dpms_event(hwc2_compat_display_t* display, uint32_t value) {
-    if (value == MEMBRANE_DPMS_NO_COMP) {
-        clear_buffer_cache();
-        membrane_debug("DPMS NO_COMP (cache cleared)");
-        return;
-    }
-
-    g_display_enabled = (value == MEMBRANE_DPMS_ON);
-
-    const bool change_backlight = g_has_backlight && g_droid_leds;
+static void handle_present_event(
+    struct membrane_display* d, const struct membrane_event* ev, int64_t t_wake) {
+    struct membrane_frame_record rec = {
+        .display = d->index,
+        .t_signal = ev->timestamp,
+        .t_event = t_wake,
+    };
+    struct membrane_get_present_fd arg = { .display = d->index };
 
-    if (!g_display_enabled && change_backlight && !g_backlight_slept) {
-        droid_leds_set_backlight(g_droid_leds, 0, FALSE);
-        g_backlight_slept = true;
+    if (ioctl(d->mfd, DRM_IOCTL_MEMBRANE_GET_PRESENT_FD, &arg) < 0) {
+        membrane_err("display %d: MEMBRANE_GET_PRESENT_FD: %s", d->index, strerror(errno));
+        return;
     }
 
-    hwc2_power_mode_t mode = g_display_enabled ? HWC2_POWER_MODE_ON : HWC2_POWER_MODE_OFF;
+    record_present(&arg, rec.t_event);
 
-    if (hwc2_compat_display_set_power_mode(display, mode) != HWC2_ERROR_NONE)
+    struct ANativeWindowBuffer* anw = membrane_handle_present(d->present, &arg, &rec);
+    if (!anw)
         return;
 
-    if (g_display_enabled && change_backlight && g_backlight_slept) {
-        guint level = droid_leds_get_backlight(g_droid_leds);
-        if (level == 0)
-            level = 5;
+    rec.t_import = membrane_now_ns();
+    present_sched_wait(&d->sched);
+    rec.t_paced = membrane_now_ns();
 
-        droid_leds_set_backlight(g_droid_leds, level, FALSE);
-        g_backlight_slept = false;
-    }
+    int64_t start = membrane_now_ns();
+    int present_fence = do_present_block(d->present, anw, &rec);
+    rec.slack = present_sched_done(&d->sched, start, membrane_now_ns());
+
+    telemetry_commit(&rec, present_fence);
+    if (present_fence >= 0)
+        close(present_fence);
 
-    membrane_debug("DPMS %s", g_display_enabled ? "ON" : "OFF");
+    anw->common.decRef(&anw->common);
 }
 
-static void membrane_event_loop(int mfd, hwc2_compat_display_t* display, HWC2DisplayConfig* cfg) {
+static void* membrane_event_loop(void* data) {
+    struct membrane_display* d = data;
     struct membrane_event ev;
+    char name[16];
+
+    snprintf(name, sizeof(name), "membrane-disp%d", d->index);
+    pthread_setname_np(pthread_self(), name);
+    rt_thread_setup(name, d->cfg->vsyncPeriod);
 
     for (;;) {
-        if (ioctl(mfd, DRM_IOCTL_MEMBRANE_SIGNAL, &ev) < 0) {
+        ev = (struct membrane_event) { .display = d->index };
+
+        if (ioctl(d->mfd, DRM_IOCTL_MEMBRANE_SIGNAL, &ev) < 0) {
             if (errno == EINTR)
                 continue;
             membrane_err("ioctl DRM_IOCTL_MEMBRANE_SIGNAL: %s", strerror(errno));
             continue;
         }
 
-        if (ev.flags & MEMBRANE_DPMS_UPDATED) {
-            clear_buffer_cache();
-            handle_dpms_event(display, ev.value);
-        }
+        int64_t now = membrane_now_ns();
+        record_signal(&ev, now);
 
-        if (ev.flags & MEMBRANE_PRESENT_UPDATED) {
-            struct ANativeWindowBuffer* anw = membrane_handle_present(mfd);
+        if (ev.flags & MEMBRANE_DISPLAY_REMOVED)
+            break;
 
-            if (anw) {
-                do_present_block(display, anw);
-                anw->common.decRef(&anw->common);
-            }
+        if (ev.flags & MEMBRANE_DPMS_UPDATED) {
+            clear_buffer_cache(d->present);
+            handle_dpms_event(d, ev.value);
         }
+
+        /* a powered off panel has nothing to show, later commits replace the frame */
+        if ((ev.flags & MEMBRANE_PRESENT_UPDATED) && d->enabled)
+            handle_present_event(d, &ev, now);
     }
+
+    membrane_debug("display %d: removed", d->index);
+
+    present_destroy(d->present);
+    d->present = NULL;
+
+    return NULL;
 }
 
-static void on_hotplug(HWC2EventListener* l, int32_t id, hwc2_display_t d, bool c, bool p) {
-    membrane_debug("hotplug display=%lu connected=%d primary=%d", d, c, p);
+static bool display_start(int index) {
+    struct membrane_display* d = &g_displays[index];
+
+    if (d->active)
+        return true;
+
+    d->index = index;
+    d->hwc = hwc2_compat_device_get_display_by_id(g_device, index);
+    if (!d->hwc) {
+        membrane_err("display %d: not found", index);
+        return false;
+    }
+
+    hwc2_compat_display_set_power_mode(d->hwc, HWC2_POWER_MODE_ON);
+    d->enabled = true;
+
+    d->cfg = hwc2_compat_display_get_active_config(d->hwc);
+    if (!d->cfg) {
+        membrane_err("display %d: no active config", index);
+        goto err_power;
+    }
+
+    membrane_debug("display %d: %dx%d", index, d->cfg->width, d->cfg->height);
+
+    present_sched_init(&d->sched, d->cfg->vsyncPeriod);
+    hwc2_compat_display_set_vsync_enabled(d->hwc, HWC2_VSYNC_ENABLE);
+
+    d->present = present_new(d->hwc, d->cfg);
+    if (!d->present)
+        goto err_cfg;
+
+    if (index == 0)
+        record_init(d->cfg, present_stride(d->present));
+
+    d->mfd = membrane_open();
+    if (d->mfd < 0) {
+        membrane_err("display %d: open %s: %s", index, MEMBRANE_CARD, strerror(errno));
+        goto err_present;
+    }
+
+    /* configuring through the display's own fd makes it the pipe's event consumer */
+    if (membrane_send_cfg(d->mfd, index, d->cfg) < 0)
+        goto err_fd;
+
+    if (pthread_create(&d->thread, NULL, membrane_event_loop, d) != 0) {
+        membrane_err("display %d: pthread_create failed", index);
+        membrane_send_cfg(g_control_fd, index, NULL);
+        goto err_fd;
+    }
+
+    d->active = true;
+    return true;
+
+err_fd:
+    close(d->mfd);
+    d->mfd = -1;
+err_present:
+    present_destroy(d->present);
+    d->present = NULL;
+err_cfg:
+    free(d->cfg);
+    d->cfg = NULL;
+err_power:
+    hwc2_compat_display_set_vsync_enabled(d->hwc, HWC2_VSYNC_DISABLE);
+    hwc2_compat_display_set_power_mode(d->hwc, HWC2_POWER_MODE_OFF);
+    return false;
 }
 
-int main(void) {
-    int mfd = open("/dev/dri/by-path/platform-membrane-card", O_RDWR | O_CLOEXEC);
-    membrane_assert(mfd >= 0);
+static void display_stop(int index) {
+    struct membrane_display* d = &g_displays[index];
 
-    drmDropMaster(mfd);
+    if (!d->active)
+        return;
 
-    hwc2_compat_device_t* device = hwc2_compat_device_new(false);
-    membrane_assert(device);
+    /* wakes the display thread with MEMBRANE_DISPLAY_REMOVED, it tears down its own present */
+    membrane_send_cfg(g_control_fd, index, NULL);
+    pthread_join(d->thread, NULL);
 
-    HWC2EventListener listener = {};
-    listener.on_hotplug_received = on_hotplug;
+    close(d->mfd);
+    d->mfd = -1;
 
-    hwc2_compat_device_register_callback(device, &listener, 0);
-    hwc2_compat_device_on_hotplug(device, 0, true);
+    hwc2_compat_display_set_vsync_enabled(d->hwc, HWC2_VSYNC_DISABLE);
+    hwc2_compat_display_set_power_mode(d->hwc, HWC2_POWER_MODE_OFF);
+    present_sched_reset(&d->sched);
 
-    hwc2_compat_display_t* display = hwc2_compat_device_get_display_by_id(device, 0);
-    membrane_assert(display);
+    free(d->cfg);
+    d->cfg = NULL;
+    d->active = false;
+    d->enabled = false;
 
-    if (getenv("MEMBRANE_BACKLIGHT")) {
-        GError* err = NULL;
+    hwc2_compat_device_on_hotplug(g_device, index, false);
+}
 
-        g_droid_leds = droid_leds_new(&err);
-        if (err) {
-            membrane_err("libdroid: init failed: %s", err->message);
-            g_error_free(err);
-            g_droid_leds = NULL;
-        } else {
-            g_has_backlight = true;
+static void on_hotplug(HWC2EventListener* l, int32_t id, hwc2_display_t d, bool c, bool p) {
+    membrane_debug("hotplug display=%lu connected=%d primary=%d", d, c, p);
 
-            (void)droid_leds_get_backlight(g_droid_leds);
+    /* the primary display is brought up once at startup */
+    if (d == 0)
+        return;
 
-            membrane_debug("libdroid: backlight control enabled");
-        }
+    if (d >= MEMBRANE_MAX_DISPLAYS) {
+        membrane_err("hotplug: display %lu exceeds %d pipes", d, MEMBRANE_MAX_DISPLAYS);
+        return;
     }
 
-    hwc2_compat_display_set_power_mode(display, HWC2_POWER_MODE_ON);
+    struct membrane_hotplug ev = { .index = d, .connected = c };
+    if (write(g_hotplug_pipe[1], &ev, sizeof(ev)) != sizeof(ev))
+        membrane_err("hotplug: write failed: %s", strerror(errno));
+}
 
-    HWC2DisplayConfig* cfg = hwc2_compat_display_get_active_config(display);
-    membrane_assert(cfg);
+static void on_vsync(HWC2EventListener* l, int32_t id, hwc2_display_t d, int64_t timestamp) {
+    if (d < MEMBRANE_MAX_DISPLAYS)
+        present_sched_vsync(&g_displays[d].sched, timestamp);
+}
 
-    g_layer = hwc2_compat_display_create_layer(display);
-    membrane_assert(g_layer);
+int main(void) {
+    rt_init();
+    client_target_init();
 
-    hwc2_compat_layer_set_blend_mode(g_layer, HWC2_BLEND_MODE_NONE);
-    hwc2_compat_layer_set_composition_type(g_layer, HWC2_COMPOSITION_DEVICE);
-    hwc2_compat_layer_set_source_crop(g_layer, 0.0f, 0.0f, cfg->width, cfg->height);
-    hwc2_compat_layer_set_display_frame(g_layer, 0, 0, cfg->width, cfg->height);
-    hwc2_compat_layer_set_visible_region(g_layer, 0, 0, cfg->width, cfg->height);
+    g_control_fd = membrane_open();
+    membrane_assert(g_control_fd >= 0);
 
-    membrane_debug("Display %dx%d", cfg->width, cfg->height);
+    membrane_assert(pipe2(g_hotplug_pipe, O_CLOEXEC) == 0);
 
-    g_stride = get_stride(cfg->width, cfg->height, HAL_PIXEL_FORMAT_RGBA_8888,
-        GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER);
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++)
+        g_displays[i].mfd = -1;
 
-    membrane_debug("Using cached gralloc stride = %u (width = %u)", g_stride, cfg->width);
+    /* the HALs don't depend on each other, bring gralloc and libdroid up while HWC loads */
+    pthread_t gralloc_thread, leds_thread;
+    bool leds = getenv("MEMBRANE_BACKLIGHT") != NULL;
 
-    membrane_send_cfg(mfd, cfg);
+    membrane_assert(pthread_create(&gralloc_thread, NULL, gralloc_init, NULL) == 0);
+    if (leds)
+        membrane_assert(pthread_create(&leds_thread, NULL, leds_init, NULL) == 0);
 
-    rwb_set_properties(cfg->width, cfg->height, g_stride, HAL_PIXEL_FORMAT_RGBA_8888,
-        GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER);
+    g_device = hwc2_compat_device_new(false);
+    membrane_assert(g_device);
 
-    membrane_event_loop(mfd, display, cfg);
+    HWC2EventListener listener = {};
+    listener.on_hotplug_received = on_hotplug;
+    listener.on_vsync_received = on_vsync;
+
+    hwc2_compat_device_register_callback(g_device, &listener, 0);
+    hwc2_compat_device_on_hotplug(g_device, 0, true);
+
+    telemetry_init();
+
+    pthread_join(gralloc_thread, NULL);
+    if (leds)
+        pthread_join(leds_thread, NULL);
+
+    membrane_assert(display_start(0));
+
+    for (;;) {
+        struct membrane_hotplug ev;
+        ssize_t n = read(g_hotplug_pipe[0], &ev, sizeof(ev));
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        membrane_assert(n == sizeof(ev));
+
+        if (ev.connected) {
+            hwc2_compat_device_on_hotplug(g_device, ev.index, true);
+            if (!display_start(ev.index))
+                hwc2_compat_device_on_hotplug(g_device, ev.index, false);
+        } else {
+            display_stop(ev.index);
+        }
+    }
 
     return 0;
 }
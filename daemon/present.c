@@ -0,0 +1,432 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "client_target.h"
+#include "present.h"
+#include "rwb.h"
+
+#include <log.h>
+#include <membrane_meta.h>
+#include <membrane_time.h>
+
+int hybris_gralloc_allocate(
+    int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride);
+int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
+int hybris_gralloc_import_buffer(buffer_handle_t raw_handle, buffer_handle_t* out_handle);
+
+#define BUFFER_CACHE_SIZE 64
+#define STRIDE_CACHE "/var/cache/membrane/stride"
+
+#ifdef __LP64__
+#define GRALLOC_LIB "lib64"
+#else
+#define GRALLOC_LIB "lib"
+#endif
+
+struct present {
+    hwc2_compat_display_t* display;
+    HWC2DisplayConfig* cfg;
+    hwc2_compat_layer_t* layer;
+    uint32_t stride;
+
+    client_target_t* client_target;
+    bool client_target_failed;
+    bool client_composition;
+
+    struct {
+        uint32_t id;
+        struct ANativeWindowBuffer* anw;
+    } buffer_cache[BUFFER_CACHE_SIZE];
+};
+
+static pthread_mutex_t g_stride_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* const g_gralloc_dirs[] = {
+    "/vendor/" GRALLOC_LIB "/hw",
+    "/odm/" GRALLOC_LIB "/hw",
+    "/system/" GRALLOC_LIB "/hw",
+};
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ ((const uint8_t*)data)[i]) * 1099511628211ULL;
+    return h;
+}
+
+/*
+ * strides are only valid for the gralloc they were probed with, so the cache is tagged with the
+ * name, size and mtime of every gralloc and mapper module. summed, as readdir has no order.
+ */
+static uint64_t gralloc_build_id(void) {
+    uint64_t id = 0;
+
+    for (size_t i = 0; i < sizeof(g_gralloc_dirs) / sizeof(g_gralloc_dirs[0]); i++) {
+        const char* path = g_gralloc_dirs[i];
+        DIR* dir = opendir(path);
+        if (!dir)
+            continue;
+
+        uint64_t base = fnv1a(14695981039346656037ULL, path, strlen(path));
+
+        struct dirent* de;
+        while ((de = readdir(dir))) {
+            struct stat st;
+
+            if (!strstr(de->d_name, "gralloc") && !strstr(de->d_name, "mapper"))
+                continue;
+            if (fstatat(dirfd(dir), de->d_name, &st, 0) < 0)
+                continue;
+
+            uint64_t h = fnv1a(base, de->d_name, strlen(de->d_name));
+            h = fnv1a(h, &st.st_size, sizeof(st.st_size));
+            h = fnv1a(h, &st.st_mtim, sizeof(st.st_mtim));
+            id += h;
+        }
+
+        closedir(dir);
+    }
+
+    return id;
+}
+
+static const char* stride_cache_path(void) {
+    const char* path = getenv("MEMBRANE_STRIDE_CACHE");
+    return path && *path ? path : STRIDE_CACHE;
+}
+
+/*
+ * a "gralloc <id>" line, then one "width height format usage stride" line per probed mode. 0 if
+ * there is none, *valid tells whether the file belongs to this gralloc.
+ */
+static uint32_t stride_cache_lookup(
+    uint64_t id, int width, int height, int format, int usage, bool* valid) {
+    FILE* f = fopen(stride_cache_path(), "re");
+    uint64_t file_id;
+
+    *valid = false;
+    if (!f)
+        return 0;
+
+    if (fscanf(f, "gralloc %" SCNx64, &file_id) != 1 || file_id != id) {
+        fclose(f);
+        return 0;
+    }
+
+    *valid = true;
+
+    int w, h, fmt, u;
+    uint32_t stride, found = 0;
+
+    while (fscanf(f, "%d %d %d %d %" SCNu32, &w, &h, &fmt, &u, &stride) == 5) {
+        if (w == width && h == height && fmt == format && u == usage)
+            found = stride;
+    }
+
+    fclose(f);
+    return found;
+}
+
+static void mkdir_parents(const char* path) {
+    char dir[PATH_MAX];
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char* p = strchr(dir + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+            membrane_debug("stride cache: mkdir %s: %s", dir, strerror(errno));
+        *p = '/';
+    }
+}
+
+/* a cache of another gralloc is started over */
+static void stride_cache_store(
+    uint64_t id, bool valid, int width, int height, int format, int usage, uint32_t stride) {
+    const char* path = stride_cache_path();
+
+    mkdir_parents(path);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (valid ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0) {
+        membrane_err("stride cache: open %s: %s", path, strerror(errno));
+        return;
+    }
+
+    if (!valid)
+        dprintf(fd, "gralloc %" PRIx64 "\n", id);
+
+    dprintf(fd, "%d %d %d %d %" PRIu32 "\n", width, height, format, usage, stride);
+    close(fd);
+}
+
+/* displays start up in parallel, they share the cache file */
+static uint32_t get_stride(int width, int height, int format, int usage) {
+    static uint64_t id;
+    static bool have_id;
+    buffer_handle_t handle = NULL;
+    bool valid;
+
+    pthread_mutex_lock(&g_stride_lock);
+
+    if (!have_id) {
+        id = gralloc_build_id();
+        have_id = true;
+    }
+
+    uint32_t stride = stride_cache_lookup(id, width, height, format, usage, &valid);
+    if (stride) {
+        pthread_mutex_unlock(&g_stride_lock);
+        return stride;
+    }
+
+    int ret = hybris_gralloc_allocate(width, height, format, usage, &handle, &stride);
+
+    membrane_assert(ret == 0);
+    membrane_assert(handle);
+    membrane_assert(stride > 0);
+
+    hybris_gralloc_release(handle, 1);
+
+    stride_cache_store(id, valid, width, height, format, usage, stride);
+
+    pthread_mutex_unlock(&g_stride_lock);
+
+    return stride;
+}
+
+present_t* present_new(hwc2_compat_display_t* display, HWC2DisplayConfig* cfg) {
+    present_t* p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+
+    p->display = display;
+    p->cfg = cfg;
+
+    p->layer = hwc2_compat_display_create_layer(display);
+    if (!p->layer) {
+        membrane_err("create_layer failed");
+        free(p);
+        return NULL;
+    }
+
+    hwc2_compat_layer_set_blend_mode(p->layer, HWC2_BLEND_MODE_NONE);
+    hwc2_compat_layer_set_composition_type(p->layer, HWC2_COMPOSITION_DEVICE);
+    hwc2_compat_layer_set_source_crop(p->layer, 0.0f, 0.0f, cfg->width, cfg->height);
+    hwc2_compat_layer_set_display_frame(p->layer, 0, 0, cfg->width, cfg->height);
+    hwc2_compat_layer_set_visible_region(p->layer, 0, 0, cfg->width, cfg->height);
+
+    p->stride = get_stride(cfg->width, cfg->height, PRESENT_FORMAT, PRESENT_USAGE);
+
+    membrane_debug("Using cached gralloc stride = %u (width = %u)", p->stride, cfg->width);
+
+    return p;
+}
+
+void present_destroy(present_t* p) {
+    if (!p)
+        return;
+
+    clear_buffer_cache(p);
+    client_target_destroy(p->client_target);
+    hwc2_compat_display_destroy_layer(p->display, p->layer);
+
+    free(p);
+}
+
+uint32_t present_stride(present_t* p) { return p->stride; }
+
+void clear_buffer_cache(present_t* p) {
+    client_target_flush_sources(p->client_target);
+
+    for (int i = 0; i < BUFFER_CACHE_SIZE; i++) {
+        if (p->buffer_cache[i].anw) {
+            p->buffer_cache[i].anw->common.decRef(&p->buffer_cache[i].anw->common);
+            p->buffer_cache[i].anw = NULL;
+        }
+        p->buffer_cache[i].id = 0;
+    }
+}
+
+static buffer_handle_t import_buffer_from_fds(
+    int* fds, int num_fds, const struct membrane_meta* meta) {
+    if (num_fds < 1)
+        return NULL;
+
+    if (meta->version != MEMBRANE_META_VERSION) {
+        membrane_err("missing buffer metadata (version %u)", meta->version);
+        return NULL;
+    }
+
+    if (!meta->stride) {
+        membrane_err("buffer metadata has no stride");
+        return NULL;
+    }
+
+    if (num_fds != (int)meta->num_fds) {
+        membrane_err("%d dmabufs for a handle of %u", num_fds, meta->num_fds);
+        return NULL;
+    }
+
+    native_handle_t* nh = membrane_meta_wrap(meta, fds, num_fds);
+    membrane_assert(nh);
+
+    buffer_handle_t handle = NULL;
+    hybris_gralloc_import_buffer(nh, &handle);
+
+    native_handle_delete(nh);
+
+    return handle;
+}
+
+static bool compose_client_target(present_t* p, struct ANativeWindowBuffer* anw) {
+    /* a mode change leaves the targets at the old size, start over at the new one */
+    if (p->client_target && !client_target_fits(p->client_target, p->cfg->width, p->cfg->height)) {
+        client_target_destroy(p->client_target);
+        p->client_target = NULL;
+        p->client_target_failed = false;
+    }
+
+    if (!p->client_target && !p->client_target_failed) {
+        p->client_target = client_target_new(p->cfg->width, p->cfg->height);
+        p->client_target_failed = !p->client_target;
+    }
+
+    if (!p->client_target)
+        return false;
+
+    uint32_t slot = 0;
+    struct ANativeWindowBuffer* target = NULL;
+    int acquire_fence = -1;
+
+    if (client_target_render(p->client_target, anw, &slot, &target, &acquire_fence) != 0)
+        return false;
+
+    hwc2_error_t err = hwc2_compat_display_set_client_target(
+        p->display, slot, target, acquire_fence, HAL_DATASPACE_UNKNOWN);
+    if (err != HWC2_ERROR_NONE) {
+        membrane_err("set_client_target failed: %d", err);
+        return false;
+    }
+
+    return true;
+}
+
+int do_present_block(
+    present_t* p, struct ANativeWindowBuffer* anw, struct membrane_frame_record* rec) {
+    uint32_t numTypes = 0;
+    uint32_t numReqs = 0;
+    bool client_composed = false;
+
+    hwc2_compat_layer_set_buffer(p->layer, 0, anw, -1);
+
+    if (p->client_composition) {
+        hwc2_compat_layer_set_composition_type(p->layer, HWC2_COMPOSITION_DEVICE);
+        p->client_composition = false;
+    }
+
+    hwc2_error_t err = hwc2_compat_display_validate(p->display, &numTypes, &numReqs);
+
+    if (err != HWC2_ERROR_NONE && err != HWC2_ERROR_HAS_CHANGES) {
+        membrane_err("validate failed: %d", err);
+        return -1;
+    }
+
+    if (numTypes || numReqs) {
+        err = hwc2_compat_display_accept_changes(p->display);
+        if (err != HWC2_ERROR_NONE) {
+            membrane_err("accept_changes failed: %d", err);
+            return -1;
+        }
+    }
+
+    rec->t_validate = membrane_now_ns();
+
+    /* with a single layer any type change means HWC wants it composed by us */
+    if (numTypes) {
+        p->client_composition = true;
+        client_composed = compose_client_target(p, anw);
+    }
+
+    int32_t presentFence = -1;
+    err = hwc2_compat_display_present(p->display, &presentFence);
+    rec->t_present = membrane_now_ns();
+
+    if (err != HWC2_ERROR_NONE) {
+        membrane_err("present failed: %d", err);
+        return -1;
+    }
+
+    if (client_composed)
+        rec->flags |= MEMBRANE_FRAME_CLIENT_COMPOSED;
+
+    client_target_presented(p->client_target, client_composed, presentFence);
+
+    return presentFence;
+}
+
+static void close_fds(struct membrane_get_present_fd* arg) {
+    for (uint32_t i = 0; i < arg->num_fds; i++) {
+        if (arg->fds[i] >= 0)
+            close(arg->fds[i]);
+    }
+}
+
+struct ANativeWindowBuffer* membrane_handle_present(
+    present_t* p, struct membrane_get_present_fd* arg, struct membrane_frame_record* rec) {
+    rec->fb_id = arg->buffer_id;
+
+    uint32_t slot = arg->buffer_id % BUFFER_CACHE_SIZE;
+    if (p->buffer_cache[slot].anw && p->buffer_cache[slot].id == arg->buffer_id) {
+        close_fds(arg);
+        struct ANativeWindowBuffer* anw = p->buffer_cache[slot].anw;
+        anw->common.incRef(&anw->common);
+        rec->flags |= MEMBRANE_FRAME_CACHE_HIT;
+        return anw;
+    }
+
+    if (arg->num_fds < 1) {
+        membrane_err("insufficient fds (%u)", arg->num_fds);
+        close_fds(arg);
+        return NULL;
+    }
+
+    buffer_handle_t handle = import_buffer_from_fds(arg->fds, arg->num_fds, &arg->meta);
+
+    close_fds(arg);
+
+    if (!handle)
+        return NULL;
+
+    /* the allocator's pitch, the probed p->stride only describes buffers allocated like ours */
+    rwb_t* rwb = rwb_new(
+        handle, p->cfg->width, p->cfg->height, arg->meta.stride, PRESENT_FORMAT, PRESENT_USAGE);
+    if (!rwb) {
+        hybris_gralloc_release(handle, 1);
+        return NULL;
+    }
+
+    struct ANativeWindowBuffer* anw = rwb_get_native(rwb);
+
+    if (p->buffer_cache[slot].anw) {
+        p->buffer_cache[slot].anw->common.decRef(&p->buffer_cache[slot].anw->common);
+    }
+    p->buffer_cache[slot].id = arg->buffer_id;
+    p->buffer_cache[slot].anw = anw;
+    anw->common.incRef(&anw->common);
+
+    return anw;
+}
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include <stdint.h>
+
+#include <hardware/gralloc.h>
+#include <hybris/hwc2/hwc2_compatibility_layer.h>
+#include <xf86drm.h>
+
+#include <membrane.h>
+#include <membrane_telemetry.h>
+
+#define PRESENT_FORMAT HAL_PIXEL_FORMAT_RGBA_8888
+#define PRESENT_USAGE                                                                              \
+    (GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER)
+
+/* the scanout layer, buffer cache and client target of one display */
+typedef struct present present_t;
+
+present_t* present_new(hwc2_compat_display_t* display, HWC2DisplayConfig* cfg);
+
+/* must be called from the thread that presents, it owns the client target's EGL context */
+void present_destroy(present_t* p);
+
+/* the gralloc stride buffers of this display are imported with */
+uint32_t present_stride(present_t* p);
+
+void clear_buffer_cache(present_t* p);
+
+/* takes ownership of the fds in arg, returns a referenced buffer or NULL */
+struct ANativeWindowBuffer* membrane_handle_present(
+    present_t* p, struct membrane_get_present_fd* arg, struct membrane_frame_record* rec);
+
+/* returns the present fence, owned by the caller */
+int do_present_block(
+    present_t* p, struct ANativeWindowBuffer* anw, struct membrane_frame_record* rec);
+
+#endif /* PRESENT_H */
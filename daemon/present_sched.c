@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "present_sched.h"
+
+#include <log.h>
+#include <membrane_time.h>
+
+#define PRESENT_SCHED_MARGIN_US 1000
+#define PRESENT_SCHED_STALE_PERIODS 8
+#define PRESENT_SCHED_REPORT_FRAMES 600
+
+void present_sched_init(present_sched_t* ps, int64_t period) {
+    memset(ps, 0, sizeof(*ps));
+
+    ps->period = period > 0 ? period : 1000000000LL / 60;
+    ps->margin = PRESENT_SCHED_MARGIN_US * 1000LL;
+
+    const char* margin = getenv("MEMBRANE_PRESENT_MARGIN_US");
+    if (margin)
+        ps->margin = strtoll(margin, NULL, 10) * 1000LL;
+
+    membrane_debug("present scheduling: period %" PRId64 " ns, margin %" PRId64 " ns", ps->period,
+        ps->margin);
+}
+
+void present_sched_vsync(present_sched_t* ps, int64_t timestamp) {
+    atomic_store_explicit(&ps->last_vsync, timestamp, memory_order_relaxed);
+}
+
+void present_sched_reset(present_sched_t* ps) {
+    atomic_store_explicit(&ps->last_vsync, 0, memory_order_relaxed);
+}
+
+int64_t present_sched_wait(present_sched_t* ps) {
+    int64_t last = atomic_load_explicit(&ps->last_vsync, memory_order_relaxed);
+    int64_t now = membrane_now_ns();
+
+    ps->deadline = 0;
+
+    if (!last || now - last > PRESENT_SCHED_STALE_PERIODS * ps->period)
+        return 0;
+
+    /* first vsync we can still make with the expected present cost and margin */
+    int64_t lead = ps->margin + ps->cost;
+    int64_t vsync = last + ((now + lead - last) / ps->period + 1) * ps->period;
+
+    ps->deadline = vsync - ps->margin;
+
+    int64_t wake = ps->deadline - ps->cost;
+    if (wake > now)
+        membrane_sleep_until_ns(wake);
+
+    return ps->deadline;
+}
+
+int64_t present_sched_done(present_sched_t* ps, int64_t start, int64_t end) {
+    int64_t cost = end - start;
+
+    ps->cost = ps->cost ? (ps->cost * 7 + cost) / 8 : cost;
+
+    if (!ps->deadline)
+        return 0;
+
+    int64_t slack = ps->deadline - end;
+
+    if (!ps->frames || slack < ps->slack_min)
+        ps->slack_min = slack;
+    ps->slack_sum += slack;
+    ps->frames++;
+
+    if (slack < 0) {
+        ps->misses++;
+        membrane_debug("missed latch deadline by %" PRId64 " us", -slack / 1000);
+    }
+
+    if (ps->frames == PRESENT_SCHED_REPORT_FRAMES) {
+        membrane_debug("latch slack over %u frames: min %" PRId64 " us, avg %" PRId64
+                       " us, %u missed",
+            ps->frames, ps->slack_min / 1000, ps->slack_sum / ps->frames / 1000, ps->misses);
+        ps->frames = 0;
+        ps->misses = 0;
+        ps->slack_sum = 0;
+    }
+
+    return slack;
+}
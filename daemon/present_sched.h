@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef PRESENT_SCHED_H
+#define PRESENT_SCHED_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+typedef struct present_sched {
+    _Atomic int64_t last_vsync;
+    int64_t period;
+    int64_t margin;
+    int64_t cost;
+    int64_t deadline;
+
+    uint32_t frames;
+    uint32_t misses;
+    int64_t slack_min;
+    int64_t slack_sum;
+} present_sched_t;
+
+void present_sched_init(present_sched_t* ps, int64_t period);
+
+/* called from the HWC vsync callback thread */
+void present_sched_vsync(present_sched_t* ps, int64_t timestamp);
+
+void present_sched_reset(present_sched_t* ps);
+
+/* sleeps until just before the next latch deadline, returns the deadline or 0 if unknown */
+int64_t present_sched_wait(present_sched_t* ps);
+
+/* returns how long before the deadline the present returned, negative if it was missed */
+int64_t present_sched_done(present_sched_t* ps, int64_t start, int64_t end);
+
+#endif /* PRESENT_SCHED_H */
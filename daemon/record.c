@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "present.h"
+#include "record.h"
+
+#include <log.h>
+
+static int g_record_fd = -1;
+static pthread_mutex_t g_record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void record_write(const void* data, size_t size) {
+    pthread_mutex_lock(&g_record_lock);
+
+    if (g_record_fd >= 0 && write(g_record_fd, data, size) != (ssize_t)size) {
+        membrane_err("record: write failed, stopping: %s", strerror(errno));
+        close(g_record_fd);
+        g_record_fd = -1;
+    }
+
+    pthread_mutex_unlock(&g_record_lock);
+}
+
+void record_init(HWC2DisplayConfig* cfg, uint32_t stride) {
+    const char* path = getenv("MEMBRANE_RECORD");
+    if (!path || !*path)
+        return;
+
+    g_record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (g_record_fd < 0) {
+        membrane_err("record: open %s failed: %s", path, strerror(errno));
+        return;
+    }
+
+    struct membrane_trace_header hdr = {
+        .magic = MEMBRANE_TRACE_MAGIC,
+        .version = MEMBRANE_TRACE_VERSION,
+        .width = cfg->width,
+        .height = cfg->height,
+        .vsync_period = cfg->vsyncPeriod,
+        .format = PRESENT_FORMAT,
+        .stride = stride,
+        .usage = PRESENT_USAGE,
+    };
+
+    record_write(&hdr, sizeof(hdr));
+
+    membrane_debug("record: writing trace to %s", path);
+}
+
+void record_signal(const struct membrane_event* ev, int64_t t) {
+    if (g_record_fd < 0)
+        return;
+
+    struct membrane_trace_record rec = {
+        .type = MEMBRANE_TRACE_SIGNAL,
+        .flags = ev->flags,
+        .value = ev->value,
+        .t = t,
+        .display = ev->display,
+    };
+
+    record_write(&rec, sizeof(rec));
+}
+
+void record_present(const struct membrane_get_present_fd* arg, int64_t t) {
+    if (g_record_fd < 0)
+        return;
+
+    struct membrane_trace_record rec = {
+        .type = MEMBRANE_TRACE_PRESENT,
+        .fb_id = arg->buffer_id,
+        .t = t,
+        .num_fds = arg->num_fds,
+        .display = arg->display,
+        .meta = arg->meta,
+    };
+
+    /* dma-bufs report their size through SEEK_END */
+    if (arg->num_fds > 0 && arg->fds[0] >= 0) {
+        off_t size = lseek(arg->fds[0], 0, SEEK_END);
+        rec.size = size > 0 ? (uint64_t)size : 0;
+    }
+
+    record_write(&rec, sizeof(rec));
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+#include <hybris/hwc2/hwc2_compatibility_layer.h>
+#include <xf86drm.h>
+
+#include <membrane.h>
+
+#define MEMBRANE_TRACE_MAGIC 0x4d424e52
+#define MEMBRANE_TRACE_VERSION 1
+
+enum membrane_trace_type {
+    MEMBRANE_TRACE_SIGNAL = 1,
+    MEMBRANE_TRACE_PRESENT = 2,
+};
+
+struct membrane_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int64_t vsync_period;
+    int32_t format;
+    uint32_t stride;
+    uint64_t usage;
+};
+
+/* one per SIGNAL return, plus one per GET_PRESENT_FD; t is CLOCK_MONOTONIC ns */
+struct membrane_trace_record {
+    uint32_t type;
+    uint32_t flags;
+    uint32_t value;
+    uint32_t fb_id;
+    int64_t t;
+    uint32_t num_fds;
+    uint32_t display;
+    uint64_t size;
+    struct membrane_meta meta;
+};
+
+/* starts recording to $MEMBRANE_RECORD if it is set, the header describes display 0 */
+void record_init(HWC2DisplayConfig* cfg, uint32_t stride);
+
+void record_signal(const struct membrane_event* ev, int64_t t);
+
+void record_present(const struct membrane_get_present_fd* arg, int64_t t);
+
+#endif /* RECORD_H */
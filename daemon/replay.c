@@ -0,0 +1,296 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client_target.h"
+#include "present.h"
+#include "present_sched.h"
+#include "record.h"
+#include "telemetry.h"
+
+#include <log.h>
+#include <membrane_time.h>
+
+int hybris_gralloc_allocate(
+    int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride);
+
+#define REPLAY_MAX_BUFFERS 256
+
+static present_sched_t g_sched;
+static present_t* g_present;
+
+/* recorded fb ids mapped to locally allocated stand-in buffers */
+static struct {
+    uint32_t fb_id;
+    buffer_handle_t handle;
+    uint32_t stride;
+} g_buffers[REPLAY_MAX_BUFFERS];
+static int g_num_buffers = 0;
+
+static struct {
+    uint64_t frames;
+    uint64_t hits;
+    uint64_t client;
+    uint64_t failed;
+    uint64_t skipped;
+    uint64_t misses;
+    int64_t slack_min;
+} g_stats;
+
+static void on_hotplug(HWC2EventListener* l, int32_t id, hwc2_display_t d, bool c, bool p) { }
+
+static void on_vsync(HWC2EventListener* l, int32_t id, hwc2_display_t d, int64_t timestamp) {
+    if (d == 0)
+        present_sched_vsync(&g_sched, timestamp);
+}
+
+static buffer_handle_t replay_buffer(HWC2DisplayConfig* cfg, uint32_t fb_id, uint32_t* stride) {
+    for (int i = 0; i < g_num_buffers; i++) {
+        if (g_buffers[i].fb_id == fb_id) {
+            *stride = g_buffers[i].stride;
+            return g_buffers[i].handle;
+        }
+    }
+
+    if (g_num_buffers == REPLAY_MAX_BUFFERS)
+        return NULL;
+
+    buffer_handle_t handle = NULL;
+
+    if (hybris_gralloc_allocate(
+            cfg->width, cfg->height, PRESENT_FORMAT, PRESENT_USAGE, &handle, stride)
+        != 0)
+        return NULL;
+
+    g_buffers[g_num_buffers].fb_id = fb_id;
+    g_buffers[g_num_buffers].handle = handle;
+    g_buffers[g_num_buffers].stride = *stride;
+    g_num_buffers++;
+
+    return handle;
+}
+
+/* builds what GET_PRESENT_FD would have returned for the recorded fb */
+static bool replay_present_fd(HWC2DisplayConfig* cfg, const struct membrane_trace_record* tr,
+    struct membrane_get_present_fd* arg) {
+    uint32_t stride = 0;
+    const native_handle_t* nh = replay_buffer(cfg, tr->fb_id, &stride);
+    if (!nh || nh->numFds > MEMBRANE_MAX_FDS || nh->numInts > MEMBRANE_MAX_INTS)
+        return false;
+
+    arg->buffer_id = tr->fb_id;
+    arg->num_fds = nh->numFds;
+    for (int i = 0; i < nh->numFds; i++)
+        arg->fds[i] = fcntl(nh->data[i], F_DUPFD_CLOEXEC, 0);
+
+    arg->meta.version = MEMBRANE_META_VERSION;
+    arg->meta.num_ints = nh->numInts;
+    arg->meta.num_fds = nh->numFds;
+    arg->meta.stride = stride;
+    memcpy(arg->meta.ints, &nh->data[nh->numFds], nh->numInts * sizeof(int));
+
+    return true;
+}
+
+static void replay_dpms(hwc2_compat_display_t* display, uint32_t value) {
+    clear_buffer_cache(g_present);
+
+    if (value == MEMBRANE_DPMS_NO_COMP)
+        return;
+
+    bool on = value == MEMBRANE_DPMS_ON;
+
+    if (!on) {
+        hwc2_compat_display_set_vsync_enabled(display, HWC2_VSYNC_DISABLE);
+        present_sched_reset(&g_sched);
+    }
+
+    hwc2_compat_display_set_power_mode(display, on ? HWC2_POWER_MODE_ON : HWC2_POWER_MODE_OFF);
+
+    if (on)
+        hwc2_compat_display_set_vsync_enabled(display, HWC2_VSYNC_ENABLE);
+}
+
+static void replay_present(
+    HWC2DisplayConfig* cfg, const struct membrane_trace_record* tr, bool paced) {
+    struct membrane_frame_record rec = { .t_event = membrane_now_ns() };
+    struct membrane_get_present_fd arg = {};
+
+    if (!replay_present_fd(cfg, tr, &arg)) {
+        g_stats.failed++;
+        return;
+    }
+
+    struct ANativeWindowBuffer* anw = membrane_handle_present(g_present, &arg, &rec);
+    if (!anw) {
+        g_stats.failed++;
+        return;
+    }
+
+    rec.t_import = membrane_now_ns();
+    if (paced)
+        present_sched_wait(&g_sched);
+    rec.t_paced = membrane_now_ns();
+
+    int64_t start = membrane_now_ns();
+    int present_fence = do_present_block(g_present, anw, &rec);
+    rec.slack = paced ? present_sched_done(&g_sched, start, membrane_now_ns()) : 0;
+
+    telemetry_commit(&rec, present_fence);
+    if (present_fence >= 0)
+        close(present_fence);
+
+    anw->common.decRef(&anw->common);
+
+    g_stats.frames++;
+    g_stats.hits += !!(rec.flags & MEMBRANE_FRAME_CACHE_HIT);
+    g_stats.client += !!(rec.flags & MEMBRANE_FRAME_CLIENT_COMPOSED);
+
+    if (paced) {
+        g_stats.misses += rec.slack < 0;
+        if (g_stats.frames == 1 || rec.slack < g_stats.slack_min)
+            g_stats.slack_min = rec.slack;
+    }
+}
+
+static void set_default_env(const char* name, int64_t value) {
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%" PRId64, value);
+    setenv(name, buf, 0);
+}
+
+int main(int argc, char** argv) {
+    bool fast = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f")) != -1) {
+        switch (opt) {
+        case 'f':
+            fast = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f] <trace>\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-f] <trace>\n", argv[0]);
+        return 2;
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    struct membrane_trace_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MEMBRANE_TRACE_MAGIC
+        || hdr.version != MEMBRANE_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a membrane trace\n", argv[optind]);
+        return 1;
+    }
+
+    client_target_init();
+
+    /* the mock display takes the recorded mode unless overridden */
+    set_default_env("MEMBRANE_MOCK_WIDTH", hdr.width);
+    set_default_env("MEMBRANE_MOCK_HEIGHT", hdr.height);
+    if (hdr.vsync_period > 0) {
+        set_default_env(
+            "MEMBRANE_MOCK_REFRESH", (1000000000LL + hdr.vsync_period / 2) / hdr.vsync_period);
+    }
+
+    hwc2_compat_device_t* device = hwc2_compat_device_new(false);
+    membrane_assert(device);
+
+    HWC2EventListener listener = {};
+    listener.on_hotplug_received = on_hotplug;
+    listener.on_vsync_received = on_vsync;
+
+    hwc2_compat_device_register_callback(device, &listener, 0);
+    hwc2_compat_device_on_hotplug(device, 0, true);
+
+    hwc2_compat_display_t* display = hwc2_compat_device_get_display_by_id(device, 0);
+    membrane_assert(display);
+
+    hwc2_compat_display_set_power_mode(display, HWC2_POWER_MODE_ON);
+
+    HWC2DisplayConfig* cfg = hwc2_compat_display_get_active_config(display);
+    membrane_assert(cfg);
+
+    present_sched_init(&g_sched, cfg->vsyncPeriod);
+    hwc2_compat_display_set_vsync_enabled(display, HWC2_VSYNC_ENABLE);
+
+    g_present = present_new(display, cfg);
+    membrane_assert(g_present);
+
+    telemetry_init();
+
+    struct membrane_trace_record tr;
+    int64_t t_first = 0;
+    int64_t t_start = membrane_now_ns();
+    uint64_t signals = 0;
+
+    while (fread(&tr, sizeof(tr), 1, f) == 1) {
+        if (!t_first)
+            t_first = tr.t;
+
+        if (!fast)
+            membrane_sleep_until_ns(t_start + (tr.t - t_first));
+
+        /* only the internal display is replayed */
+        if (tr.display != 0) {
+            g_stats.skipped++;
+            continue;
+        }
+
+        switch (tr.type) {
+        case MEMBRANE_TRACE_SIGNAL:
+            signals++;
+            if (tr.flags & MEMBRANE_DPMS_UPDATED)
+                replay_dpms(display, tr.value);
+            break;
+        case MEMBRANE_TRACE_PRESENT:
+            replay_present(cfg, &tr, !fast);
+            break;
+        default:
+            membrane_err("unknown trace record type %u", tr.type);
+            break;
+        }
+    }
+
+    fclose(f);
+
+    double elapsed = (membrane_now_ns() - t_start) / 1e9;
+
+    printf("%" PRIu64 " signals, %" PRIu64 " frames (%" PRIu64 " failed) in %.2f s, %d buffers\n",
+        signals, g_stats.frames, g_stats.failed, elapsed, g_num_buffers);
+
+    if (g_stats.skipped)
+        printf("%" PRIu64 " records for external displays skipped\n", g_stats.skipped);
+
+    if (g_stats.frames) {
+        printf("cache hits %.1f%%, client composed %.1f%%\n", 100.0 * g_stats.hits / g_stats.frames,
+            100.0 * g_stats.client / g_stats.frames);
+    }
+
+    if (!fast && g_stats.frames) {
+        printf("latch misses %" PRIu64 "/%" PRIu64 ", min slack %.1f us\n", g_stats.misses,
+            g_stats.frames, g_stats.slack_min / 1000.0);
+    }
+
+    return 0;
+}
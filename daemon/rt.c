@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+#include <log.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4
+#endif
+
+#define RT_FIFO_PRIORITY 2
+#define RT_DEADLINE_RUNTIME_PCT 25
+#define RT_STACK_PREFAULT (256 * 1024)
+#define RT_MAX_CPUS 64
+
+/* glibc only grew a sched_setattr() wrapper recently */
+struct rt_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+enum rt_policy {
+    RT_POLICY_OTHER,
+    RT_POLICY_FIFO,
+    RT_POLICY_DEADLINE,
+};
+
+static struct {
+    enum rt_policy policy;
+    int priority;
+    int runtime_pct;
+    bool has_cpus;
+    cpu_set_t cpus;
+} g_rt;
+
+static int64_t env_int(const char* name, int64_t def) {
+    const char* v = getenv(name);
+    return v && *v ? strtoll(v, NULL, 0) : def;
+}
+
+/* cpu_capacity on big.LITTLE arm64, the highest cpufreq otherwise */
+static int64_t cpu_capacity(int cpu) {
+    static const char* const paths[] = {
+        "/sys/devices/system/cpu/cpu%d/cpu_capacity",
+        "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+    };
+    char path[96];
+
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        snprintf(path, sizeof(path), paths[i], cpu);
+
+        FILE* f = fopen(path, "re");
+        if (!f)
+            continue;
+
+        int64_t value = 0;
+        int n = fscanf(f, "%" SCNd64, &value);
+        fclose(f);
+
+        if (n == 1)
+            return value;
+    }
+
+    return -1;
+}
+
+/* "big" and "little" pick the fastest or slowest cores, anything else is a cpu list like 4-7 */
+static bool parse_cpus(const char* spec, cpu_set_t* set) {
+    CPU_ZERO(set);
+
+    if (!strcmp(spec, "big") || !strcmp(spec, "little")) {
+        bool big = spec[0] == 'b';
+        int64_t caps[RT_MAX_CPUS];
+        int64_t best = -1;
+        long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+        if (ncpus > RT_MAX_CPUS)
+            ncpus = RT_MAX_CPUS;
+
+        for (int i = 0; i < ncpus; i++) {
+            caps[i] = cpu_capacity(i);
+            if (caps[i] >= 0 && (best < 0 || (big ? caps[i] > best : caps[i] < best)))
+                best = caps[i];
+        }
+
+        if (best < 0)
+            return false;
+
+        for (int i = 0; i < ncpus; i++) {
+            if (caps[i] == best)
+                CPU_SET(i, set);
+        }
+
+        return true;
+    }
+
+    for (const char* p = spec; *p;) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p)
+            return false;
+
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return false;
+        }
+
+        for (long i = first; i <= last && i < CPU_SETSIZE; i++)
+            CPU_SET(i, set);
+
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return false;
+    }
+
+    return CPU_COUNT(set) > 0;
+}
+
+static void lock_memory(void) {
+    /* lock what is mapped now, then only what gets touched so idle thread stacks stay cheap */
+    if (mlockall(MCL_CURRENT) < 0) {
+        membrane_err("rt: mlockall failed: %s", strerror(errno));
+        return;
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) < 0
+        && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        membrane_err("rt: mlockall(MCL_FUTURE) failed: %s", strerror(errno));
+        return;
+    }
+
+    /* freed heap stays mapped and locked instead of faulting back in later */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    membrane_debug("rt: memory locked");
+}
+
+void rt_init(void) {
+    const char* sched = getenv("MEMBRANE_SCHED");
+    const char* cpus = getenv("MEMBRANE_CPUS");
+
+    if (sched && !strcmp(sched, "fifo"))
+        g_rt.policy = RT_POLICY_FIFO;
+    else if (sched && !strcmp(sched, "deadline"))
+        g_rt.policy = RT_POLICY_DEADLINE;
+    else if (sched && *sched && strcmp(sched, "other"))
+        membrane_err("rt: unknown MEMBRANE_SCHED '%s', using the default policy", sched);
+
+    g_rt.priority = env_int("MEMBRANE_SCHED_PRIORITY", RT_FIFO_PRIORITY);
+    g_rt.runtime_pct = env_int("MEMBRANE_SCHED_RUNTIME_PCT", RT_DEADLINE_RUNTIME_PCT);
+    if (g_rt.runtime_pct <= 0 || g_rt.runtime_pct > 100)
+        g_rt.runtime_pct = RT_DEADLINE_RUNTIME_PCT;
+
+    if (cpus && *cpus) {
+        g_rt.has_cpus = parse_cpus(cpus, &g_rt.cpus);
+        if (!g_rt.has_cpus)
+            membrane_err("rt: can't resolve MEMBRANE_CPUS '%s'", cpus);
+    }
+
+    /* the kernel refuses SCHED_DEADLINE for tasks pinned to part of the root domain */
+    if (g_rt.has_cpus && g_rt.policy == RT_POLICY_DEADLINE) {
+        membrane_err("rt: MEMBRANE_CPUS is ignored with SCHED_DEADLINE");
+        g_rt.has_cpus = false;
+    }
+
+    if (env_int("MEMBRANE_MLOCK", 0))
+        lock_memory();
+}
+
+static void __attribute__((noinline)) prefault_stack(void) {
+    volatile char stack[RT_STACK_PREFAULT];
+
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+void rt_thread_setup(const char* name, int64_t period) {
+    if (g_rt.has_cpus && sched_setaffinity(0, sizeof(g_rt.cpus), &g_rt.cpus) < 0)
+        membrane_err("%s: sched_setaffinity failed: %s", name, strerror(errno));
+
+    if (g_rt.policy == RT_POLICY_FIFO) {
+        struct sched_param param = { .sched_priority = g_rt.priority };
+
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) < 0)
+            membrane_err("%s: SCHED_FIFO failed: %s", name, strerror(errno));
+        else
+            membrane_debug("%s: SCHED_FIFO priority %d", name, g_rt.priority);
+    } else if (g_rt.policy == RT_POLICY_DEADLINE) {
+        if (period <= 0)
+            period = 1000000000LL / 60;
+
+        struct rt_sched_attr attr = {
+            .size = sizeof(attr),
+            .sched_policy = SCHED_DEADLINE,
+            .sched_flags = SCHED_FLAG_RESET_ON_FORK,
+            .sched_runtime = period * g_rt.runtime_pct / 100,
+            .sched_deadline = period,
+            .sched_period = period,
+        };
+
+        if (syscall(SYS_sched_setattr, 0, &attr, 0) < 0)
+            membrane_err("%s: SCHED_DEADLINE failed: %s", name, strerror(errno));
+        else
+            membrane_debug("%s: SCHED_DEADLINE runtime %" PRIu64 " / %" PRId64 " ns", name,
+                (uint64_t)attr.sched_runtime, period);
+    }
+
+    prefault_stack();
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+
+/* reads the MEMBRANE_SCHED* / MEMBRANE_CPUS / MEMBRANE_MLOCK profile and locks memory,
+ * call before any other thread is started */
+void rt_init(void);
+
+/* moves the calling present thread onto the profile's policy and cores, period is the
+ * vsync period of the display it presents to */
+void rt_thread_setup(const char* name, int64_t period);
+
+#endif /* RT_H */
@@ -6,30 +6,9 @@
 #include <string.h>
 #include <windowbuffer.h>
 
-static struct {
-    unsigned int width;
-    unsigned int height;
-    unsigned int stride;
-    unsigned int format;
-    uint64_t usage;
-    int initialized;
-} g_config = { 0, 0, 0, 0, 0, 0 };
-
-void rwb_set_properties(unsigned int width, unsigned int height, unsigned int stride,
-    unsigned int format, uint64_t usage) {
-    g_config.width = width;
-    g_config.height = height;
-    g_config.stride = stride;
-    g_config.format = format;
-    g_config.usage = usage;
-    g_config.initialized = 1;
-}
-
-rwb_t* rwb_new(buffer_handle_t handle) {
-    membrane_assert(g_config.initialized);
-
-    RemoteWindowBuffer* wb = new RemoteWindowBuffer(
-        g_config.width, g_config.height, g_config.stride, g_config.format, g_config.usage, handle);
+rwb_t* rwb_new(buffer_handle_t handle, unsigned int width, unsigned int height,
+    unsigned int stride, unsigned int format, uint64_t usage) {
+    RemoteWindowBuffer* wb = new RemoteWindowBuffer(width, height, stride, format, usage, handle);
 
     if (!wb) {
         return NULL;
@@ -48,3 +27,8 @@ struct ANativeWindowBuffer* rwb_get_native(rwb_t* buffer) {
     }
     return NULL;
 }
+
+void rwb_set_allocated(rwb_t* buffer) {
+    if (buffer)
+        reinterpret_cast<RemoteWindowBuffer*>(buffer)->setAllocated(true);
+}
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sync_file.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+#include <log.h>
+
+#define TELEMETRY_PENDING_FENCES 4
+#define TELEMETRY_FENCE_INFOS 8
+
+static struct membrane_telemetry* g_telemetry = NULL;
+static pthread_mutex_t g_telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    uint64_t frame;
+    int fd;
+} g_pending[TELEMETRY_PENDING_FENCES];
+
+void telemetry_init(void) {
+    for (int i = 0; i < TELEMETRY_PENDING_FENCES; i++)
+        g_pending[i].fd = -1;
+
+    int fd = shm_open(membrane_telemetry_name(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        membrane_err("telemetry: shm_open failed: %s", strerror(errno));
+        return;
+    }
+
+    if (ftruncate(fd, MEMBRANE_TELEMETRY_SIZE) < 0) {
+        membrane_err("telemetry: ftruncate failed: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+
+    void* map = mmap(NULL, MEMBRANE_TELEMETRY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        membrane_err("telemetry: mmap failed: %s", strerror(errno));
+        return;
+    }
+
+    g_telemetry = map;
+    memset(g_telemetry, 0, MEMBRANE_TELEMETRY_SIZE);
+    g_telemetry->version = MEMBRANE_TELEMETRY_VERSION;
+    g_telemetry->capacity = MEMBRANE_TELEMETRY_RECORDS;
+    g_telemetry->record_size = sizeof(struct membrane_frame_record);
+    atomic_thread_fence(memory_order_release);
+    g_telemetry->magic = MEMBRANE_TELEMETRY_MAGIC;
+
+    membrane_debug("telemetry: publishing frames to %s", membrane_telemetry_name());
+}
+
+/* 0 while pending, -1 if the signal time can't be read */
+static int64_t fence_signal_time(int fd) {
+    struct sync_fence_info infos[TELEMETRY_FENCE_INFOS];
+    struct sync_file_info info = {
+        .num_fences = TELEMETRY_FENCE_INFOS,
+        .sync_fence_info = (uintptr_t)infos,
+    };
+
+    if (ioctl(fd, SYNC_IOC_FILE_INFO, &info) < 0)
+        return -1;
+
+    if (info.status != 1)
+        return info.status < 0 ? -1 : 0;
+
+    int64_t t = 0;
+    for (uint32_t i = 0; i < info.num_fences && i < TELEMETRY_FENCE_INFOS; i++) {
+        if ((int64_t)infos[i].timestamp_ns > t)
+            t = infos[i].timestamp_ns;
+    }
+
+    return t;
+}
+
+static void write_record(uint64_t frame, const struct membrane_frame_record* rec) {
+    struct membrane_frame_record* dst = &g_telemetry->records[frame % g_telemetry->capacity];
+    uint32_t seq = atomic_load_explicit(&dst->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&dst->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    dst->fb_id = rec->fb_id;
+    dst->flags = rec->flags;
+    dst->display = rec->display;
+    dst->t_signal = rec->t_signal;
+    dst->t_event = rec->t_event;
+    dst->t_import = rec->t_import;
+    dst->t_paced = rec->t_paced;
+    dst->t_validate = rec->t_validate;
+    dst->t_present = rec->t_present;
+    dst->t_fence = rec->t_fence;
+    dst->slack = rec->slack;
+
+    atomic_store_explicit(&dst->seq, seq + 2, memory_order_release);
+}
+
+static void resolve_fences(uint64_t head) {
+    for (int i = 0; i < TELEMETRY_PENDING_FENCES; i++) {
+        if (g_pending[i].fd < 0)
+            continue;
+
+        int64_t t = fence_signal_time(g_pending[i].fd);
+        bool stale = head - g_pending[i].frame >= g_telemetry->capacity;
+
+        if (t == 0 && !stale)
+            continue;
+
+        if (t > 0 && !stale) {
+            struct membrane_frame_record rec
+                = g_telemetry->records[g_pending[i].frame % g_telemetry->capacity];
+            rec.t_fence = t;
+            write_record(g_pending[i].frame, &rec);
+        }
+
+        close(g_pending[i].fd);
+        g_pending[i].fd = -1;
+    }
+}
+
+void telemetry_commit(const struct membrane_frame_record* rec, int present_fence) {
+    if (!g_telemetry)
+        return;
+
+    /* every display thread publishes into the same ring */
+    pthread_mutex_lock(&g_telemetry_lock);
+
+    uint64_t frame = atomic_load_explicit(&g_telemetry->head, memory_order_relaxed);
+
+    write_record(frame, rec);
+    atomic_store_explicit(&g_telemetry->head, frame + 1, memory_order_release);
+
+    resolve_fences(frame + 1);
+
+    if (present_fence >= 0) {
+        int slot = frame % TELEMETRY_PENDING_FENCES;
+        if (g_pending[slot].fd >= 0)
+            close(g_pending[slot].fd);
+
+        g_pending[slot].frame = frame;
+        g_pending[slot].fd = fcntl(present_fence, F_DUPFD_CLOEXEC, 0);
+    }
+
+    pthread_mutex_unlock(&g_telemetry_lock);
+}
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <membrane_telemetry.h>
+
+void telemetry_init(void);
+
+/* publishes a frame; present_fence is borrowed and polled on later frames for its signal time */
+void telemetry_commit(const struct membrane_frame_record* rec, int present_fence);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <membrane_telemetry.h>
+
+enum {
+    SPAN_WAKEUP,
+    SPAN_IMPORT,
+    SPAN_PACING,
+    SPAN_VALIDATE,
+    SPAN_PRESENT,
+    SPAN_TOTAL,
+    SPAN_FENCE,
+    SPAN_SLACK,
+    SPAN_COUNT,
+};
+
+static const char* g_span_names[SPAN_COUNT] = {
+    [SPAN_WAKEUP] = "signal -> wakeup",
+    [SPAN_IMPORT] = "event -> import",
+    [SPAN_PACING] = "import -> paced",
+    [SPAN_VALIDATE] = "paced -> validate",
+    [SPAN_PRESENT] = "validate -> present",
+    [SPAN_TOTAL] = "event -> present",
+    [SPAN_FENCE] = "present -> fence",
+    [SPAN_SLACK] = "deadline slack",
+};
+
+struct span {
+    int64_t* v;
+    size_t n;
+};
+
+static int cmp_i64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void span_add(struct span* s, int64_t from, int64_t to) {
+    if (from > 0 && to > 0)
+        s->v[s->n++] = to - from;
+}
+
+static double percentile(const struct span* s, double p) {
+    size_t i = (size_t)(p * (s->n - 1) + 0.5);
+    return s->v[i] / 1000.0;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [-d display] [frames <= %d]\n", argv0, MEMBRANE_TELEMETRY_RECORDS);
+}
+
+int main(int argc, char** argv) {
+    uint64_t want = MEMBRANE_TELEMETRY_RECORDS;
+    int64_t display = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+        case 'd':
+            display = strtol(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        want = strtoull(argv[optind], NULL, 0);
+        if (!want || want > MEMBRANE_TELEMETRY_RECORDS) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int fd = shm_open(membrane_telemetry_name(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s (is the daemon running?)\n", membrane_telemetry_name(),
+            strerror(errno));
+        return 1;
+    }
+
+    struct membrane_telemetry* t
+        = mmap(NULL, MEMBRANE_TELEMETRY_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (t == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (t->magic != MEMBRANE_TELEMETRY_MAGIC || t->version != MEMBRANE_TELEMETRY_VERSION
+        || t->record_size != sizeof(struct membrane_frame_record)
+        || t->capacity != MEMBRANE_TELEMETRY_RECORDS) {
+        fprintf(stderr, "telemetry layout mismatch\n");
+        return 1;
+    }
+
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+    uint64_t first = head > want ? head - want : 0;
+
+    struct span spans[SPAN_COUNT];
+    for (int i = 0; i < SPAN_COUNT; i++) {
+        spans[i].v = calloc(want, sizeof(int64_t));
+        spans[i].n = 0;
+    }
+
+    size_t frames = 0, hits = 0, client = 0;
+
+    for (uint64_t f = first; f < head; f++) {
+        struct membrane_frame_record rec;
+
+        if (!membrane_telemetry_read(t, f, &rec))
+            continue;
+
+        if (display >= 0 && rec.display != display)
+            continue;
+
+        frames++;
+        hits += !!(rec.flags & MEMBRANE_FRAME_CACHE_HIT);
+        client += !!(rec.flags & MEMBRANE_FRAME_CLIENT_COMPOSED);
+
+        span_add(&spans[SPAN_WAKEUP], rec.t_signal, rec.t_event);
+        span_add(&spans[SPAN_IMPORT], rec.t_event, rec.t_import);
+        span_add(&spans[SPAN_PACING], rec.t_import, rec.t_paced);
+        span_add(&spans[SPAN_VALIDATE], rec.t_paced, rec.t_validate);
+        span_add(&spans[SPAN_PRESENT], rec.t_validate, rec.t_present);
+        span_add(&spans[SPAN_TOTAL], rec.t_event, rec.t_present);
+        span_add(&spans[SPAN_FENCE], rec.t_present, rec.t_fence);
+
+        if (rec.slack)
+            spans[SPAN_SLACK].v[spans[SPAN_SLACK].n++] = rec.slack;
+    }
+
+    if (!frames) {
+        printf("no frames recorded\n");
+        return 0;
+    }
+
+    printf("%zu frames, cache hits %.1f%%, client composed %.1f%%\n\n", frames,
+        100.0 * hits / frames, 100.0 * client / frames);
+    printf("%-20s %10s %10s %10s %10s  (us)\n", "", "p50", "p90", "p99", "max");
+
+    for (int i = 0; i < SPAN_COUNT; i++) {
+        struct span* s = &spans[i];
+
+        if (!s->n) {
+            printf("%-20s %10s\n", g_span_names[i], "-");
+            continue;
+        }
+
+        qsort(s->v, s->n, sizeof(int64_t), cmp_i64);
+        printf("%-20s %10.1f %10.1f %10.1f %10.1f\n", g_span_names[i], percentile(s, 0.50),
+            percentile(s, 0.90), percentile(s, 0.99), s->v[s->n - 1] / 1000.0);
+    }
+
+    return 0;
+}
@@ -20,17 +20,20 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <nativewindowbase.h>
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ws.h>
 
 #include "linux-dmabuf-v1-client-protocol.h"
+#include "linux-explicit-synchronization-unstable-v1-client-protocol.h"
 #include <EGL/eglext.h>
 #include <drm_fourcc.h>
 
+#include <gbm.h>
 #include <wayland-egl-backend.h>
 
 #include <hardware/gralloc.h>
@@ -39,6 +42,9 @@
 #include <EGL/eglext.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <windowbuffer.h>
@@ -53,18 +59,48 @@ int hybris_gralloc_import_buffer(buffer_handle_t raw_handle, buffer_handle_t* ou
 };
 
 #include <log.h>
+#include <membrane_format.h>
+#include <membrane_gbm.h>
+#include <membrane_meta.h>
+#include <membrane_time.h>
+
+/* blocks until the GPU work behind fenceFd has landed, then closes it */
+static void wait_fence(int fenceFd) {
+    if (fenceFd < 0)
+        return;
 
-static PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR_func = NULL;
-static PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR_func = NULL;
-static PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR_func = NULL;
+    struct pollfd pfd = { fenceFd, POLLIN, 0 };
+    while (poll(&pfd, 1, -1) < 0 && (errno == EINTR || errno == EAGAIN)) { }
 
-static void init_egl_sync_funcs() {
-    if (eglCreateSyncKHR_func)
-        return;
-    eglCreateSyncKHR_func = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
-    eglDestroySyncKHR_func = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
-    eglClientWaitSyncKHR_func
-        = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+    close(fenceFd);
+}
+
+static int64_t env_int(const char* name, int64_t def) {
+    const char* v = getenv(name);
+    return v && *v ? strtoll(v, NULL, 0) : def;
+}
+
+/*
+ * clients only register and look up buffer metadata, which the render node allows without
+ * access to the card. the card node is the fallback for kernels without one.
+ */
+static int open_drm_fd() {
+    int fd = open("/dev/dri/by-path/platform-membrane-render", O_RDWR | O_CLOEXEC);
+    if (fd >= 0)
+        return fd;
+
+    fd = open("/dev/dri/by-path/platform-membrane-card", O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        membrane_err("failed to open membrane device: %s", strerror(errno));
+    else
+        drmDropMaster(fd);
+
+    return fd;
+}
+
+static int membrane_drm_fd() {
+    static const int fd = open_drm_fd();
+    return fd;
 }
 
 class MembraneNativeWindowBuffer : public BaseNativeWindowBuffer {
@@ -72,11 +108,13 @@ public:
     MembraneNativeWindowBuffer() {
         busy = 0;
         m_wl_buffer = NULL;
-        m_meta_fd = -1;
+        m_frame = 0;
+        m_lastUsed = 0;
     }
 
     bool allocate(unsigned int w, unsigned int h, unsigned int fmt, uint64_t usg) {
         busy = 0;
+        m_frame = 0;
         ANativeWindowBuffer::width = w;
         ANativeWindowBuffer::height = h;
         ANativeWindowBuffer::format = fmt;
@@ -89,24 +127,12 @@ public:
             return false;
         }
 
-        native_handle_t* nh = (native_handle_t*)handle;
-        int meta_size = nh->numInts * sizeof(int);
-        if (meta_size > 0) {
-            m_meta_fd = memfd_create("membrane_meta", MFD_CLOEXEC);
-            if (m_meta_fd >= 0) {
-                if (ftruncate(m_meta_fd, meta_size) == -1) {
-                    membrane_err("Failed to ftruncate meta buffer: %s", strerror(errno));
-                    close(m_meta_fd);
-                    m_meta_fd = -1;
-                    return false;
-                }
-                if (write(m_meta_fd, &nh->data[nh->numFds], meta_size) != meta_size) {
-                    membrane_err("Failed to write meta buffer: %s", strerror(errno));
-                    close(m_meta_fd);
-                    m_meta_fd = -1;
-                    return false;
-                }
-            }
+        ret = membrane_meta_set(membrane_drm_fd(), handle, stride);
+        if (ret != 0) {
+            membrane_err("Failed to register buffer metadata: %s", strerror(-ret));
+            hybris_gralloc_release(handle, 1);
+            handle = NULL;
+            return false;
         }
 
         return true;
@@ -117,11 +143,8 @@ public:
             wl_buffer_destroy(m_wl_buffer);
             m_wl_buffer = NULL;
         }
-        if (m_meta_fd >= 0) {
-            close(m_meta_fd);
-            m_meta_fd = -1;
-        }
         if (ANativeWindowBuffer::handle) {
+            membrane_meta_clear(membrane_drm_fd(), ANativeWindowBuffer::handle);
             hybris_gralloc_release(ANativeWindowBuffer::handle, 1);
             ANativeWindowBuffer::handle = NULL;
         }
@@ -135,34 +158,109 @@ public:
     struct wl_buffer* getWlBuffer() { return m_wl_buffer; }
     void setBusy(int b) { busy = b; }
     int getBusy() { return busy; }
+    void setFrame(uint64_t frame) { m_frame = frame; }
+    uint64_t getFrame() { return m_frame; }
+    void setLastUsed(uint64_t frame) { m_lastUsed = frame; }
+    uint64_t getLastUsed() { return m_lastUsed; }
 
     int busy;
     struct wl_buffer* m_wl_buffer;
-    int m_meta_fd;
+    uint64_t m_frame;
+    uint64_t m_lastUsed;
 };
 
-class MembraneNativeWindow : public BaseNativeWindow {
+/*
+ * the driver asks the window for the age of the buffer it just dequeued to implement
+ * EGL_EXT_buffer_age and EGL_KHR_partial_update, frames count queued buffers and a buffer that
+ * was never queued, or whose contents were cancelled, has age 0.
+ */
+class MembraneWindow : public BaseNativeWindow {
 public:
-    MembraneNativeWindow(struct wl_egl_window* wl_window, struct wl_display* wl_dpy,
-        struct zwp_linux_dmabuf_v1* dmabuf)
+    MembraneWindow()
         : BaseNativeWindow()
+        , m_frame(0)
+        , m_bufferAge(0) {
+        m_query = ANativeWindow::query;
+        ANativeWindow::query = query_static;
+    }
+
+    virtual int setSwapInterval(int interval) override = 0;
+    virtual void prepareSwap(EGLint* damage_rects, EGLint damage_n_rects) = 0;
+    virtual void finishSwap() = 0;
+
+protected:
+    void setDequeuedFrame(uint64_t frame) { m_bufferAge = frame ? m_frame - frame + 1 : 0; }
+    uint64_t nextFrame() { return ++m_frame; }
+    uint64_t frame() const { return m_frame; }
+
+private:
+    int (*m_query)(const struct ANativeWindow* window, int what, int* value);
+    uint64_t m_frame;
+    int m_bufferAge;
+
+    static int query_static(const struct ANativeWindow* window, int what, int* value) {
+        const MembraneWindow* self = static_cast<const MembraneWindow*>(window);
+
+        if (what == NATIVE_WINDOW_BUFFER_AGE) {
+            *value = self->m_bufferAge;
+            return NO_ERROR;
+        }
+
+        return self->m_query(window, what, value);
+    }
+};
+
+class MembraneNativeWindow : public MembraneWindow {
+public:
+    MembraneNativeWindow(struct wl_egl_window* wl_window, struct wl_display* wl_dpy,
+        struct zwp_linux_dmabuf_v1* dmabuf,
+        struct zwp_linux_explicit_synchronization_v1* explicit_sync)
+        : MembraneWindow()
         , m_wl_window(wl_window)
         , m_wl_display(wl_dpy)
-        , m_dmabuf(dmabuf)
+        , m_sync(NULL)
         , m_bufferCount(3)
+        , m_maxBuffers(std::max<int>(env_int("MEMBRANE_SWAPCHAIN_MAX", 6), 2))
+        , m_idleFrames(env_int("MEMBRANE_SWAPCHAIN_IDLE_FRAMES", 120))
+        , m_bufferWidth(0)
+        , m_bufferHeight(0)
+        , m_bufferFormat(0)
+        , m_bufferUsage(0)
         , m_allocateBuffers(true)
         , m_damage_rects(NULL)
         , m_damage_n_rects(0)
         , m_throttle_callback(NULL)
         , m_queuedBuffer(NULL)
+        , m_acquireFence(-1)
         , m_attached_height(0)
-        , m_swap_interval(1) {
+        , m_swap_interval(1)
+        , m_prealloc(env_int("MEMBRANE_SWAPCHAIN_PREALLOC", 1) != 0)
+        , m_spare(NULL)
+        , m_spareWanted(false)
+        , m_spareStopping(false) {
         m_wl_surface = m_wl_window->surface;
         m_surface_version = wl_proxy_get_version((struct wl_proxy*)m_wl_surface);
 
+        /*
+         * buffer releases and throttle callbacks land on a queue of their own so swaps never
+         * dispatch application events, or wait behind other windows and threads
+         */
+        m_queue = wl_display_create_queue(m_wl_display);
+        m_display_wrapper = (struct wl_display*)wl_proxy_create_wrapper(m_wl_display);
+        wl_proxy_set_queue((struct wl_proxy*)m_display_wrapper, m_queue);
+        m_surface_wrapper = (struct wl_surface*)wl_proxy_create_wrapper(m_wl_surface);
+        wl_proxy_set_queue((struct wl_proxy*)m_surface_wrapper, m_queue);
+        m_dmabuf = (struct zwp_linux_dmabuf_v1*)wl_proxy_create_wrapper(dmabuf);
+        wl_proxy_set_queue((struct wl_proxy*)m_dmabuf, m_queue);
+
         m_wl_window->driver_private = this;
         m_wl_window->resize_callback = resize_callback_static;
 
+        if (explicit_sync) {
+            m_sync = zwp_linux_explicit_synchronization_v1_get_synchronization(
+                explicit_sync, m_wl_surface);
+        }
+
         m_format = HAL_PIXEL_FORMAT_RGBA_8888;
         m_usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE;
 
@@ -170,14 +268,25 @@ public:
     }
 
     virtual ~MembraneNativeWindow() {
+        stopPrealloc();
+
         if (m_throttle_callback)
             wl_callback_destroy(m_throttle_callback);
+        if (m_sync)
+            zwp_linux_surface_synchronization_v1_destroy(m_sync);
+        if (m_acquireFence >= 0)
+            close(m_acquireFence);
 
         destroyBuffers();
         if (m_wl_window) {
             m_wl_window->driver_private = NULL;
             m_wl_window->resize_callback = NULL;
         }
+
+        wl_proxy_wrapper_destroy(m_dmabuf);
+        wl_proxy_wrapper_destroy(m_surface_wrapper);
+        wl_proxy_wrapper_destroy(m_display_wrapper);
+        wl_event_queue_destroy(m_queue);
     }
 
     virtual int setSwapInterval(int interval) override {
@@ -190,25 +299,31 @@ public:
         if (m_allocateBuffers)
             reallocateBuffers();
 
-        MembraneNativeWindowBuffer* mnb = NULL;
-
-        for (;;) {
-            for (int i = 0; i < m_bufferCount; i++) {
-                if (m_buffers[i].getBusy() == 0) {
-                    mnb = &m_buffers[i];
-                    break;
-                }
-            }
-            if (mnb)
-                break;
+        /* releases already on the socket come first so the lowest free buffer gets reused */
+        if (dispatchQueue(0) == -1)
+            return -1;
 
-            wl_display_flush(m_wl_display);
-            if (wl_display_dispatch(m_wl_display) == -1) {
+        /*
+         * after a resize the swapchain refills with one new buffer per dequeue, a compositor
+         * that holds every buffer gets another one until the swapchain reaches its limit
+         */
+        MembraneNativeWindowBuffer* mnb = freeBuffer();
+        if (!mnb && (int)m_buffers.size() < m_bufferCount)
+            mnb = addBuffer();
+        if (!mnb && m_buffers.empty())
+            return -ENOMEM;
+        if (!mnb)
+            mnb = growBuffers();
+
+        while (!mnb) {
+            if (dispatchQueue(-1) == -1)
                 return -1;
-            }
+            mnb = freeBuffer();
         }
 
         mnb->setBusy(1);
+        mnb->setLastUsed(frame());
+        setDequeuedFrame(mnb->getFrame());
 
         *buffer = mnb;
         *fenceFd = -1;
@@ -219,20 +334,10 @@ public:
     virtual int queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd) override {
         MembraneNativeWindowBuffer* mnb = (MembraneNativeWindowBuffer*)buffer;
 
-        if (fenceFd >= 0) {
-            if (eglCreateSyncKHR_func && eglClientWaitSyncKHR_func && eglDestroySyncKHR_func) {
-                EGLDisplay dpy = eglGetCurrentDisplay();
-                if (dpy != EGL_NO_DISPLAY) {
-                    EGLSyncKHR sync = eglCreateSyncKHR_func(dpy, EGL_SYNC_FENCE_KHR, NULL);
-                    if (sync != EGL_NO_SYNC_KHR) {
-                        eglClientWaitSyncKHR_func(
-                            dpy, sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
-                        eglDestroySyncKHR_func(dpy, sync);
-                    }
-                }
-            }
-            close(fenceFd);
-        }
+        /* the fence travels with the commit, rendering may still be in flight here */
+        if (m_acquireFence >= 0)
+            close(m_acquireFence);
+        m_acquireFence = fenceFd;
 
         if (!mnb->getWlBuffer()) {
             createWlBuffer(mnb);
@@ -241,6 +346,7 @@ public:
         if (mnb->getWlBuffer()) {
             membrane_assert(mnb->getBusy() == 1);
             mnb->setBusy(2);
+            mnb->setFrame(nextFrame());
             m_queuedBuffer = mnb;
         } else {
             membrane_err("Failed to create wl_buffer for queue");
@@ -257,6 +363,8 @@ public:
             close(fenceFd);
 
         mnb->setBusy(0);
+        mnb->setFrame(0);
+        reapRetired();
         return 0;
     }
 
@@ -272,8 +380,12 @@ public:
     virtual unsigned int defaultHeight() const override { return m_wl_window->height; }
     virtual unsigned int queueLength() const override {
         int queued = 0;
-        for (int i = 0; i < m_bufferCount; i++) {
-            if (m_buffers[i].busy == 2)
+        for (MembraneNativeWindowBuffer* mnb : m_buffers) {
+            if (mnb->busy == 2)
+                queued++;
+        }
+        for (MembraneNativeWindowBuffer* mnb : m_retired) {
+            if (mnb->busy == 2)
                 queued++;
         }
         return queued;
@@ -303,8 +415,8 @@ public:
     }
 
     virtual int setBufferCount(int cnt) override {
-        if (cnt > 4)
-            cnt = 4;
+        if (cnt > m_maxBuffers)
+            cnt = m_maxBuffers;
         if (m_bufferCount != cnt) {
             m_bufferCount = cnt;
             m_allocateBuffers = true;
@@ -313,28 +425,32 @@ public:
     }
 
     void handleRelease(struct wl_buffer* wl_buf) {
-        for (int i = 0; i < m_bufferCount; i++) {
-            if (m_buffers[i].getWlBuffer() == wl_buf) {
-                m_buffers[i].setBusy(0);
-                if (m_queuedBuffer == &m_buffers[i])
-                    m_queuedBuffer = NULL;
-                break;
+        for (auto* list : { &m_buffers, &m_retired }) {
+            for (MembraneNativeWindowBuffer* mnb : *list) {
+                if (mnb->getWlBuffer() == wl_buf) {
+                    mnb->setBusy(0);
+                    if (m_queuedBuffer == mnb)
+                        m_queuedBuffer = NULL;
+                    break;
+                }
             }
         }
+
+        reapRetired();
     }
 
-    void finishSwap() {
+    void finishSwap() override {
         while (m_throttle_callback) {
-            if (wl_display_dispatch(m_wl_display) == -1) {
+            if (dispatchQueue(-1) == -1) {
                 membrane_err("error dispatching wayland events during throttle");
                 break;
             }
         }
 
         if (m_swap_interval > 0) {
-            m_throttle_callback = wl_surface_frame(m_wl_surface);
+            m_throttle_callback = wl_surface_frame(m_surface_wrapper);
         } else {
-            m_throttle_callback = wl_display_sync(m_wl_display);
+            m_throttle_callback = wl_display_sync(m_display_wrapper);
         }
 
         if (m_throttle_callback) {
@@ -344,9 +460,25 @@ public:
         MembraneNativeWindowBuffer* mnb = m_queuedBuffer;
         m_queuedBuffer = NULL;
 
+        int fence = m_acquireFence;
+        m_acquireFence = -1;
+
+        /*
+         * without explicit sync the compositor may sample the buffer as soon as it is committed,
+         * waiting only now at least overlaps the GPU with the frame callback above
+         */
         if (mnb) {
             wl_surface_attach(m_wl_surface, mnb->getWlBuffer(), 0, 0);
             m_attached_height = m_wl_window->height;
+
+            if (m_sync && fence >= 0) {
+                zwp_linux_surface_synchronization_v1_set_acquire_fence(m_sync, fence);
+                close(fence);
+            } else {
+                wait_fence(fence);
+            }
+        } else if (fence >= 0) {
+            close(fence);
         }
 
         if (m_damage_n_rects > 0 && m_damage_rects && m_attached_height > 0) {
@@ -373,9 +505,11 @@ public:
 
         wl_surface_commit(m_wl_surface);
         wl_display_flush(m_wl_display);
+
+        shrinkBuffers();
     }
 
-    void prepareSwap(EGLint* damage_rects, EGLint damage_n_rects) {
+    void prepareSwap(EGLint* damage_rects, EGLint damage_n_rects) override {
         m_damage_rects = damage_rects;
         m_damage_n_rects = damage_n_rects;
     }
@@ -383,12 +517,23 @@ public:
 private:
     struct wl_egl_window* m_wl_window;
     struct wl_display* m_wl_display;
+    struct wl_event_queue* m_queue;
+    struct wl_display* m_display_wrapper;
+    struct wl_surface* m_surface_wrapper;
     struct zwp_linux_dmabuf_v1* m_dmabuf;
+    struct zwp_linux_surface_synchronization_v1* m_sync;
     struct wl_surface* m_wl_surface;
     int m_surface_version;
 
-    MembraneNativeWindowBuffer m_buffers[4];
+    std::vector<MembraneNativeWindowBuffer*> m_buffers;
+    std::vector<MembraneNativeWindowBuffer*> m_retired;
     int m_bufferCount;
+    int m_maxBuffers;
+    uint64_t m_idleFrames;
+    int m_bufferWidth;
+    int m_bufferHeight;
+    int m_bufferFormat;
+    uint64_t m_bufferUsage;
     bool m_allocateBuffers;
     uint64_t m_usage;
     int m_format;
@@ -397,36 +542,224 @@ private:
 
     struct wl_callback* m_throttle_callback;
     MembraneNativeWindowBuffer* m_queuedBuffer;
+    int m_acquireFence;
     int m_attached_height;
     int m_swap_interval;
 
+    /* one buffer of the size announced by the last resize, allocated off the render thread */
+    bool m_prealloc;
+    std::thread m_spareThread;
+    std::mutex m_spareLock;
+    std::condition_variable m_spareCond;
+    MembraneNativeWindowBuffer* m_spare;
+    bool m_spareWanted;
+    bool m_spareStopping;
+    int m_spareWidth;
+    int m_spareHeight;
+    int m_spareFormat;
+    uint64_t m_spareUsage;
+
+    /*
+     * dispatches only this window's events, waiting up to timeout ms for new ones. a blocking
+     * call returns once something was dispatched, a polling one always reads the socket too.
+     */
+    int dispatchQueue(int timeout) {
+        while (wl_display_prepare_read_queue(m_wl_display, m_queue) != 0) {
+            int ret = wl_display_dispatch_queue_pending(m_wl_display, m_queue);
+            if (ret == -1 || timeout != 0)
+                return ret;
+        }
+
+        wl_display_flush(m_wl_display);
+
+        struct pollfd pfd = { wl_display_get_fd(m_wl_display), POLLIN, 0 };
+        int ret;
+        while ((ret = poll(&pfd, 1, timeout)) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                membrane_err("polling the wayland display failed: %s", strerror(errno));
+                wl_display_cancel_read(m_wl_display);
+                return -1;
+            }
+        }
+
+        if (ret == 0) {
+            wl_display_cancel_read(m_wl_display);
+            return 0;
+        }
+
+        if (wl_display_read_events(m_wl_display) == -1)
+            return -1;
+
+        return wl_display_dispatch_queue_pending(m_wl_display, m_queue);
+    }
+
+    MembraneNativeWindowBuffer* freeBuffer() {
+        for (MembraneNativeWindowBuffer* mnb : m_buffers) {
+            if (mnb->getBusy() == 0)
+                return mnb;
+        }
+        return NULL;
+    }
+
+    static MembraneNativeWindowBuffer* newBuffer(int w, int h, int format, uint64_t usage) {
+        MembraneNativeWindowBuffer* mnb = new MembraneNativeWindowBuffer();
+        mnb->common.incRef(&mnb->common);
+
+        if (!mnb->allocate(w, h, format, usage)) {
+            mnb->common.decRef(&mnb->common);
+            return NULL;
+        }
+
+        return mnb;
+    }
+
+    MembraneNativeWindowBuffer* addBuffer() {
+        MembraneNativeWindowBuffer* mnb = takeSpare();
+        if (!mnb)
+            mnb = newBuffer(m_bufferWidth, m_bufferHeight, m_bufferFormat, m_bufferUsage);
+        if (!mnb)
+            return NULL;
+
+        createWlBuffer(mnb);
+        m_buffers.push_back(mnb);
+        return mnb;
+    }
+
+    static void dropBuffer(MembraneNativeWindowBuffer* mnb) {
+        mnb->release();
+        mnb->common.decRef(&mnb->common);
+    }
+
+    MembraneNativeWindowBuffer* growBuffers() {
+        if ((int)m_buffers.size() >= m_maxBuffers)
+            return NULL;
+
+        MembraneNativeWindowBuffer* mnb = addBuffer();
+        if (mnb)
+            membrane_debug("compositor holds every buffer, %zu now", m_buffers.size());
+        return mnb;
+    }
+
+    /* free buffers are handed out lowest first, so the last one idles once it isn't needed */
+    void shrinkBuffers() {
+        if ((int)m_buffers.size() <= m_bufferCount)
+            return;
+
+        MembraneNativeWindowBuffer* mnb = m_buffers.back();
+        if (mnb->getBusy() != 0 || frame() - mnb->getLastUsed() < m_idleFrames)
+            return;
+
+        m_buffers.pop_back();
+        dropBuffer(mnb);
+        membrane_debug("swapchain back to %zu buffers", m_buffers.size());
+    }
+
     void destroyBuffers() {
         m_queuedBuffer = NULL;
-        for (int i = 0; i < 4; i++) {
-            m_buffers[i].release();
-        }
+        for (MembraneNativeWindowBuffer* mnb : m_buffers)
+            dropBuffer(mnb);
+        for (MembraneNativeWindowBuffer* mnb : m_retired)
+            dropBuffer(mnb);
+        m_buffers.clear();
+        m_retired.clear();
+    }
+
+    /* retired buffers may still be on screen, they go once the compositor releases them */
+    void reapRetired() {
+        auto it = std::partition(m_retired.begin(), m_retired.end(),
+            [](MembraneNativeWindowBuffer* mnb) { return mnb->getBusy() != 0; });
+
+        std::for_each(it, m_retired.end(), dropBuffer);
+        m_retired.erase(it, m_retired.end());
     }
 
+    /* new buffers are only allocated as dequeueBuffer runs out of the current ones */
     void reallocateBuffers() {
         int w = m_wl_window->width;
         int h = m_wl_window->height;
 
-        if (m_bufferCount > 0 && m_buffers[0].getHandle() != NULL) {
-            if (m_buffers[0].width == w && m_buffers[0].height == h
-                && m_buffers[0].format == m_format && m_buffers[0].usage == m_usage) {
-                m_allocateBuffers = false;
-                return;
-            }
+        if (w != m_bufferWidth || h != m_bufferHeight || m_format != m_bufferFormat
+            || m_usage != m_bufferUsage) {
+            m_retired.insert(m_retired.end(), m_buffers.begin(), m_buffers.end());
+            m_buffers.clear();
+            reapRetired();
+
+            m_bufferWidth = w;
+            m_bufferHeight = h;
+            m_bufferFormat = m_format;
+            m_bufferUsage = m_usage;
         }
 
-        destroyBuffers();
+        m_allocateBuffers = false;
+    }
 
-        for (int i = 0; i < m_bufferCount; i++) {
-            m_buffers[i].allocate(w, h, m_format, m_usage);
-            m_buffers[i].common.incRef(&m_buffers[i].common);
-            createWlBuffer(&m_buffers[i]);
+    MembraneNativeWindowBuffer* takeSpare() {
+        std::lock_guard<std::mutex> lock(m_spareLock);
+        MembraneNativeWindowBuffer* mnb = m_spare;
+
+        if (!mnb || mnb->width != m_bufferWidth || mnb->height != m_bufferHeight
+            || mnb->format != m_bufferFormat || mnb->usage != m_bufferUsage)
+            return NULL;
+
+        m_spare = NULL;
+        return mnb;
+    }
+
+    void requestSpare(int w, int h) {
+        std::lock_guard<std::mutex> lock(m_spareLock);
+
+        m_spareWidth = w;
+        m_spareHeight = h;
+        m_spareFormat = m_format;
+        m_spareUsage = m_usage;
+        m_spareWanted = true;
+
+        if (!m_spareThread.joinable())
+            m_spareThread = std::thread(&MembraneNativeWindow::preallocLoop, this);
+        else
+            m_spareCond.notify_one();
+    }
+
+    void preallocLoop() {
+        std::unique_lock<std::mutex> lock(m_spareLock);
+
+        for (;;) {
+            m_spareCond.wait(lock, [this] { return m_spareWanted || m_spareStopping; });
+            if (m_spareStopping)
+                break;
+
+            int w = m_spareWidth;
+            int h = m_spareHeight;
+            int format = m_spareFormat;
+            uint64_t usage = m_spareUsage;
+            MembraneNativeWindowBuffer* stale = m_spare;
+
+            m_spare = NULL;
+            m_spareWanted = false;
+            lock.unlock();
+
+            if (stale)
+                dropBuffer(stale);
+            MembraneNativeWindowBuffer* mnb = newBuffer(w, h, format, usage);
+
+            lock.lock();
+            m_spare = mnb;
         }
-        m_allocateBuffers = false;
+    }
+
+    void stopPrealloc() {
+        if (m_spareThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_spareLock);
+                m_spareStopping = true;
+            }
+            m_spareCond.notify_one();
+            m_spareThread.join();
+        }
+
+        if (m_spare)
+            dropBuffer(m_spare);
+        m_spare = NULL;
     }
 
     void createWlBuffer(MembraneNativeWindowBuffer* mnb) {
@@ -440,11 +773,6 @@ private:
             for (int i = 0; i < nh->numFds; i++) {
                 zwp_linux_buffer_params_v1_add(params, nh->data[i], i, 0, mnb->stride * 4, 0, 0);
             }
-
-            if (mnb->m_meta_fd >= 0) {
-                lseek(mnb->m_meta_fd, 0, SEEK_SET);
-                zwp_linux_buffer_params_v1_add(params, mnb->m_meta_fd, nh->numFds, 0, 1, 0, 0);
-            }
         }
 
         struct wl_buffer* wl_buf = zwp_linux_buffer_params_v1_create_immed(
@@ -460,9 +788,10 @@ private:
     }
 
     static void resize_callback_static(struct wl_egl_window* wl_win, void* data) {
-        (void)wl_win;
         MembraneNativeWindow* win = static_cast<MembraneNativeWindow*>(data);
         win->m_allocateBuffers = true;
+        if (win->m_prealloc)
+            win->requestSpare(wl_win->width, wl_win->height);
     }
 
     static void buffer_release_static(void* data, struct wl_buffer* wl_buffer) {
@@ -489,9 +818,126 @@ const struct wl_buffer_listener MembraneNativeWindow::s_buffer_listener
 const struct wl_callback_listener MembraneNativeWindow::s_throttle_listener
     = { .done = MembraneNativeWindow::throttle_callback_static };
 
+class MembraneGbmWindowBuffer : public BaseNativeWindowBuffer {
+public:
+    void set(const struct membrane_gbm_buffer& buffer, int fmt, int usg) {
+        ANativeWindowBuffer::width = buffer.width;
+        ANativeWindowBuffer::height = buffer.height;
+        ANativeWindowBuffer::stride = buffer.stride;
+        ANativeWindowBuffer::format = fmt;
+        ANativeWindowBuffer::usage = usg;
+        ANativeWindowBuffer::handle = buffer.handle;
+    }
+};
+
+/* renders straight into the buffers of a gbm_surface, the application scans them out itself */
+class MembraneGbmWindow : public MembraneWindow {
+public:
+    MembraneGbmWindow(struct membrane_gbm_surface* surface)
+        : MembraneWindow()
+        , m_surface(surface) {
+        for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS; i++) {
+            m_buffers[i].common.incRef(&m_buffers[i].common);
+            m_frames[i] = 0;
+        }
+    }
+
+    virtual int setSwapInterval(int interval) override {
+        (void)interval;
+        return 0;
+    }
+    virtual unsigned int type() const override { return NATIVE_WINDOW_SURFACE; }
+
+    virtual int dequeueBuffer(BaseNativeWindowBuffer** buffer, int* fenceFd) override {
+        struct membrane_gbm_buffer b;
+
+        int slot = m_surface->dequeue(m_surface, &b);
+        if (slot < 0)
+            return -EBUSY;
+
+        m_buffers[slot].set(b, m_surface->format, m_surface->usage);
+        setDequeuedFrame(m_frames[slot]);
+
+        *buffer = &m_buffers[slot];
+        *fenceFd = -1;
+
+        return 0;
+    }
+
+    virtual int queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd) override {
+        wait_fence(fenceFd);
+        m_frames[slot(buffer)] = nextFrame();
+        m_surface->queue(m_surface, slot(buffer));
+        return 0;
+    }
+
+    virtual int cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd) override {
+        if (fenceFd >= 0)
+            close(fenceFd);
+
+        m_frames[slot(buffer)] = 0;
+        m_surface->cancel(m_surface, slot(buffer));
+        return 0;
+    }
+
+    virtual int lockBuffer(BaseNativeWindowBuffer* buffer) override {
+        (void)buffer;
+        return 0;
+    }
+
+    virtual unsigned int width() const override { return m_surface->base.v0.width; }
+    virtual unsigned int height() const override { return m_surface->base.v0.height; }
+    virtual unsigned int format() const override { return m_surface->format; }
+    virtual unsigned int defaultWidth() const override { return m_surface->base.v0.width; }
+    virtual unsigned int defaultHeight() const override { return m_surface->base.v0.height; }
+    virtual unsigned int queueLength() const override { return 0; }
+    virtual unsigned int transformHint() const override { return 0; }
+    virtual unsigned int getUsage() const override { return m_surface->usage; }
+
+    /* size, format and usage were fixed when the application created the gbm_surface */
+    virtual int setBuffersFormat(int format) override {
+        (void)format;
+        return NO_ERROR;
+    }
+
+    virtual int setBuffersDimensions(int width, int height) override {
+        (void)width;
+        (void)height;
+        return NO_ERROR;
+    }
+
+    virtual int setUsage(uint64_t usage) override {
+        (void)usage;
+        return NO_ERROR;
+    }
+
+    virtual int setBufferCount(int cnt) override {
+        (void)cnt;
+        return NO_ERROR;
+    }
+
+    void prepareSwap(EGLint* damage_rects, EGLint damage_n_rects) override {
+        (void)damage_rects;
+        (void)damage_n_rects;
+    }
+
+    void finishSwap() override { }
+
+private:
+    struct membrane_gbm_surface* m_surface;
+    MembraneGbmWindowBuffer m_buffers[MEMBRANE_GBM_MAX_BUFFERS];
+    uint64_t m_frames[MEMBRANE_GBM_MAX_BUFFERS];
+
+    int slot(BaseNativeWindowBuffer* buffer) const {
+        return static_cast<MembraneGbmWindowBuffer*>(buffer) - m_buffers;
+    }
+};
+
 struct MembraneDisplay : public _EGLDisplay {
     struct wl_display* wl_dpy;
     struct zwp_linux_dmabuf_v1* dmabuf;
+    struct zwp_linux_explicit_synchronization_v1* explicit_sync;
+    struct gbm_device* gbm;
 };
 
 static void registry_handle_global(void* data, struct wl_registry* registry, uint32_t id,
@@ -500,6 +946,9 @@ static void registry_handle_global(void* data, struct wl_registry* registry, uin
     if (strcmp(interface, "zwp_linux_dmabuf_v1") == 0 && version >= 3) {
         dpy->dmabuf = (zwp_linux_dmabuf_v1*)wl_registry_bind(
             registry, id, &zwp_linux_dmabuf_v1_interface, 3);
+    } else if (strcmp(interface, "zwp_linux_explicit_synchronization_v1") == 0) {
+        dpy->explicit_sync = (zwp_linux_explicit_synchronization_v1*)wl_registry_bind(
+            registry, id, &zwp_linux_explicit_synchronization_v1_interface, 1);
     }
 }
 
@@ -515,17 +964,20 @@ static const struct wl_registry_listener registry_listener
 extern "C" void membranews_init_module(struct ws_egl_interface* egl_iface) {
     hybris_gralloc_initialize(1);
     eglplatformcommon_init(egl_iface);
-    init_egl_sync_funcs();
 }
 
 extern "C" _EGLDisplay* membranews_GetDisplay(EGLNativeDisplayType display) {
-    struct wl_display* wl_dpy = (struct wl_display*)display;
-    if (!wl_dpy)
+    if (!display)
         return NULL;
 
     MembraneDisplay* dpy = new MembraneDisplay();
     memset(dpy, 0, sizeof(MembraneDisplay));
-    dpy->wl_dpy = wl_dpy;
+
+    /* libgbm tags its devices with gbm_create_device, like mesa's platform detection */
+    if (*(void**)display == (void*)gbm_create_device)
+        dpy->gbm = (struct gbm_device*)display;
+    else
+        dpy->wl_dpy = (struct wl_display*)display;
 
     return dpy;
 }
@@ -542,9 +994,21 @@ extern "C" EGLNativeWindowType membranews_CreateWindow(
     MembraneDisplay* dpy = (MembraneDisplay*)display;
     struct wl_egl_window* wl_win = (struct wl_egl_window*)win;
 
-    if (!wl_win)
+    if (!win)
         return 0;
 
+    if (dpy->gbm) {
+        struct membrane_gbm_surface* surface = membrane_gbm_surface((struct gbm_surface*)win);
+        if (!surface) {
+            membrane_err("gbm_surface was not created by the membrane backend");
+            return 0;
+        }
+
+        MembraneGbmWindow* w = new MembraneGbmWindow(surface);
+        w->common.incRef(&w->common);
+        return (EGLNativeWindowType) static_cast<ANativeWindow*>(w);
+    }
+
     if (!dpy->dmabuf) {
         struct wl_registry* registry = wl_display_get_registry(dpy->wl_dpy);
         struct wl_event_queue* queue = wl_display_create_queue(dpy->wl_dpy);
@@ -555,6 +1019,9 @@ extern "C" EGLNativeWindowType membranews_CreateWindow(
 
         wl_display_roundtrip_queue(dpy->wl_dpy, queue);
 
+        if (dpy->explicit_sync)
+            wl_proxy_set_queue((struct wl_proxy*)dpy->explicit_sync, NULL);
+
         if (dpy->dmabuf) {
             wl_proxy_set_queue((struct wl_proxy*)dpy->dmabuf, NULL);
         } else {
@@ -568,13 +1035,14 @@ extern "C" EGLNativeWindowType membranews_CreateWindow(
         wl_event_queue_destroy(queue);
     }
 
-    MembraneNativeWindow* w = new MembraneNativeWindow(wl_win, dpy->wl_dpy, dpy->dmabuf);
+    MembraneNativeWindow* w
+        = new MembraneNativeWindow(wl_win, dpy->wl_dpy, dpy->dmabuf, dpy->explicit_sync);
     w->common.incRef(&w->common);
     return (EGLNativeWindowType) static_cast<ANativeWindow*>(w);
 }
 
 extern "C" void membranews_DestroyWindow(EGLNativeWindowType win) {
-    MembraneNativeWindow* w = static_cast<MembraneNativeWindow*>((struct ANativeWindow*)win);
+    MembraneWindow* w = static_cast<MembraneWindow*>((struct ANativeWindow*)win);
     w->common.decRef(&w->common);
 }
 
@@ -585,81 +1053,400 @@ extern "C" __eglMustCastToProperFunctionPointerType membranews_eglGetProcAddress
     return eglplatformcommon_eglGetProcAddress(procname);
 }
 
-extern "C" void membranews_passthroughImageKHR(
-    EGLContext* ctx, EGLenum* target, EGLClientBuffer* buffer, const EGLint** attrib_list) {
-    if (*attrib_list) {
-        int width = 0, height = 0, stride = 0;
-        int usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
-        std::vector<std::pair<int, int>> plane_fds;
-
-        for (const EGLint* attr = *attrib_list; attr && attr[0] != EGL_NONE; attr += 2) {
-            switch (attr[0]) {
-            case EGL_WIDTH:
-                width = attr[1];
-                break;
-            case EGL_HEIGHT:
-                height = attr[1];
-                break;
-            case EGL_DMA_BUF_PLANE0_PITCH_EXT:
-                stride = attr[1];
-                break;
-            case EGL_DMA_BUF_PLANE0_FD_EXT:
-                plane_fds.push_back({ 0, attr[1] });
-                break;
-            case EGL_DMA_BUF_PLANE1_FD_EXT:
-                plane_fds.push_back({ 1, attr[1] });
-                break;
-            case EGL_DMA_BUF_PLANE2_FD_EXT:
-                plane_fds.push_back({ 2, attr[1] });
-                break;
-            case EGL_DMA_BUF_PLANE3_FD_EXT:
-                plane_fds.push_back({ 3, attr[1] });
-                break;
+/*
+ * a dmabuf EGLImage names the planes of one gralloc buffer, which is imported whole and sampled
+ * through its HAL format. the attributes are only checked to describe the buffer, its actual
+ * layout stays gralloc's. plane 0 must start the buffer as an ANativeWindowBuffer has no offset.
+ * a handle with several fds is sent with the ones past the format's planes as extra planes.
+ */
+struct ImportPlane {
+    int fd;
+    int offset;
+    int pitch;
+    bool shared;
+};
+
+/* a buffer is known by the registration id of its plane 0 dmabuf, its other fds belong to it */
+struct ImportKey {
+    uint64_t id;
+    uint32_t fourcc;
+    int width;
+    int height;
+    int num_planes;
+    ImportPlane planes[MEMBRANE_FORMAT_MAX_PLANES];
+
+    bool operator==(const ImportKey& o) const {
+        if (id != o.id || fourcc != o.fourcc || width != o.width || height != o.height
+            || num_planes != o.num_planes)
+            return false;
+
+        for (int i = 0; i < num_planes; i++) {
+            if (planes[i].offset != o.planes[i].offset || planes[i].pitch != o.planes[i].pitch)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+static const struct {
+    EGLint fd;
+    EGLint offset;
+    EGLint pitch;
+    EGLint modifier_lo;
+    EGLint modifier_hi;
+} g_plane_attribs[MEMBRANE_FORMAT_MAX_PLANES] = {
+    { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+        EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+        EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+        EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT,
+        EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT },
+};
+
+static const struct membrane_format* import_parse(const EGLint* attribs, ImportKey* key) {
+    int fds[MEMBRANE_FORMAT_MAX_PLANES] = { -1, -1, -1, -1 };
+    uint64_t modifiers[MEMBRANE_FORMAT_MAX_PLANES] = {};
+    int modifier_parts[MEMBRANE_FORMAT_MAX_PLANES] = {};
+
+    *key = {};
+
+    for (const EGLint* attr = attribs; attr && attr[0] != EGL_NONE; attr += 2) {
+        if (attr[0] == EGL_LINUX_DRM_FOURCC_EXT)
+            key->fourcc = attr[1];
+        else if (attr[0] == EGL_WIDTH)
+            key->width = attr[1];
+        else if (attr[0] == EGL_HEIGHT)
+            key->height = attr[1];
+
+        for (int i = 0; i < MEMBRANE_FORMAT_MAX_PLANES; i++) {
+            if (attr[0] == g_plane_attribs[i].fd) {
+                fds[i] = attr[1];
+            } else if (attr[0] == g_plane_attribs[i].offset) {
+                key->planes[i].offset = attr[1];
+            } else if (attr[0] == g_plane_attribs[i].pitch) {
+                key->planes[i].pitch = attr[1];
+            } else if (attr[0] == g_plane_attribs[i].modifier_lo) {
+                modifiers[i] |= (uint32_t)attr[1];
+                modifier_parts[i] |= 1;
+            } else if (attr[0] == g_plane_attribs[i].modifier_hi) {
+                modifiers[i] |= (uint64_t)(uint32_t)attr[1] << 32;
+                modifier_parts[i] |= 2;
             }
         }
+    }
 
-        std::sort(plane_fds.begin(), plane_fds.end());
-
-        if (!plane_fds.empty()) {
-            int meta_fd = plane_fds.back().second;
-            plane_fds.pop_back();
-
-            struct stat sb;
-            if (fstat(meta_fd, &sb) == 0 && sb.st_size > 0) {
-                int num_ints = sb.st_size / sizeof(int);
-                int num_fds = plane_fds.size();
-                std::vector<int> ints(num_ints);
-
-                lseek(meta_fd, 0, SEEK_SET);
-                if (read(meta_fd, ints.data(), num_ints * sizeof(int))
-                    == (ssize_t)(num_ints * sizeof(int))) {
-                    native_handle_t* nh = native_handle_create(num_fds, num_ints);
-                    for (int i = 0; i < num_fds; i++)
-                        nh->data[i] = plane_fds[i].second;
-                    for (int i = 0; i < num_ints; i++)
-                        nh->data[num_fds + i] = ints[i];
-
-                    buffer_handle_t handle = nullptr;
-                    hybris_gralloc_import_buffer(nh, &handle);
-                    native_handle_delete(nh);
-
-                    if (handle) {
-                        RemoteWindowBuffer* anwb = new RemoteWindowBuffer(
-                            width, height, stride / 4, HAL_PIXEL_FORMAT_RGBA_8888, usage, handle);
-                        anwb->common.incRef(&anwb->common);
-                        anwb->setAllocated(true);
-
-                        *buffer = (EGLClientBuffer) static_cast<ANativeWindowBuffer*>(anwb);
-                        *target = EGL_NATIVE_BUFFER_ANDROID;
-                        *ctx = EGL_NO_CONTEXT;
-                        *attrib_list = nullptr;
-                    }
-                } else {
-                    membrane_err("Failed to read meta buffer: %s", strerror(errno));
-                }
+    const struct membrane_format* fmt = membrane_format_get(key->fourcc);
+    if (!fmt) {
+        membrane_err("dmabuf import: unsupported fourcc %.4s", (char*)&key->fourcc);
+        return NULL;
+    }
+
+    if (key->width <= 0 || key->height <= 0 || key->width % fmt->hsub
+        || key->height % fmt->vsub) {
+        membrane_err("dmabuf import: bad size %dx%d", key->width, key->height);
+        return NULL;
+    }
+
+    while (key->num_planes < MEMBRANE_FORMAT_MAX_PLANES && fds[key->num_planes] >= 0)
+        key->num_planes++;
+
+    if (key->num_planes < fmt->planes) {
+        membrane_err("dmabuf import: %.4s needs %d planes, got %d", (char*)&key->fourcc,
+            fmt->planes, key->num_planes);
+        return NULL;
+    }
+
+    for (int i = 0; i < MEMBRANE_FORMAT_MAX_PLANES; i++) {
+        ImportPlane* plane = &key->planes[i];
+
+        if (i >= key->num_planes) {
+            if (fds[i] >= 0 || plane->offset || plane->pitch || modifier_parts[i]) {
+                membrane_err("dmabuf import: plane %d without an fd", i);
+                return NULL;
             }
+            continue;
+        }
+
+        plane->fd = fds[i];
+
+        /* the extra gralloc fds have no layout of their own */
+        if (i >= fmt->planes)
+            continue;
+
+        if (plane->offset < 0 || plane->pitch <= 0
+            || (uint32_t)plane->pitch < membrane_format_min_pitch(fmt, i, key->width)
+            || (i == 0 && (plane->offset || plane->pitch % fmt->bpp))) {
+            membrane_err("dmabuf import: bad offset %d or pitch %d for plane %d", plane->offset,
+                plane->pitch, i);
+            return NULL;
+        }
+
+        /* the modifier is optional, but then whole and the same for every plane */
+        uint64_t modifier = modifier_parts[i] ? modifiers[i] : DRM_FORMAT_MOD_INVALID;
+        if ((modifier_parts[i] != 0 && modifier_parts[i] != 3)
+            || modifier_parts[i] != modifier_parts[0] || modifiers[i] != modifiers[0]
+            || !membrane_modifier_supported(modifier)) {
+            membrane_err("dmabuf import: unsupported modifier %#" PRIx64 " on plane %d",
+                modifiers[i], i);
+            return NULL;
         }
     }
+
+    return fmt;
+}
+
+/*
+ * the fds of the buffer registered for plane 0 resolve to its registration id, which tells
+ * dmabufs apart where inodes can't. every other fd is one more dmabuf of the gralloc handle, so
+ * the handle gets plane 0's fd and those, and has to end up with as many fds as it was allocated
+ * with. plane 0's pitch has to be the allocated stride, the driver samples with that one.
+ */
+static bool import_resolve(const struct membrane_format* fmt, ImportKey* key,
+    const struct membrane_meta& meta, std::vector<int>* fds) {
+    fds->assign(1, key->planes[0].fd);
+    key->planes[0].shared = true;
+
+    for (int i = 1; i < key->num_planes; i++) {
+        ImportPlane* plane = &key->planes[i];
+        struct membrane_meta other;
+        uint64_t id;
+
+        int ret = membrane_meta_get(membrane_drm_fd(), plane->fd, &other, &id);
+        if (ret != 0 && ret != -ENOENT) {
+            membrane_err("dmabuf import: plane %d: %s", i, strerror(-ret));
+            return false;
+        }
+
+        if (ret == 0 && (id != key->id || i >= fmt->planes)) {
+            membrane_err("dmabuf import: plane %d is not part of plane 0's buffer", i);
+            return false;
+        }
+
+        plane->shared = ret == 0;
+        if (!plane->shared && std::find(fds->begin(), fds->end(), plane->fd) == fds->end())
+            fds->push_back(plane->fd);
+
+        const ImportPlane* prev = &key->planes[i - 1];
+        if (i < fmt->planes && ((prev->shared && plane->shared) || prev->fd == plane->fd)) {
+            int64_t end = prev->offset
+                + (int64_t)prev->pitch * membrane_format_plane_height(fmt, i - 1, key->height);
+
+            if (plane->offset < end) {
+                membrane_err("dmabuf import: plane %d overlaps plane %d", i, i - 1);
+                return false;
+            }
+        }
+    }
+
+    if (fds->size() != meta.num_fds) {
+        membrane_err("dmabuf import: %zu dmabufs for a handle of %u", fds->size(), meta.num_fds);
+        return false;
+    }
+
+    if ((uint32_t)key->planes[0].pitch != meta.stride * fmt->bpp) {
+        membrane_err("dmabuf import: pitch %d but the buffer has a stride of %u pixels",
+            key->planes[0].pitch, meta.stride);
+        return false;
+    }
+
+    return true;
+}
+
+/* the planes have to fit in their dmabufs, only checked before a buffer is first imported */
+static bool import_fits(const struct membrane_format* fmt, const ImportKey& key) {
+    for (int i = 0; i < fmt->planes; i++) {
+        const ImportPlane& plane = key.planes[i];
+        off_t size = lseek(plane.fd, 0, SEEK_END);
+        int64_t end = plane.offset
+            + (int64_t)plane.pitch * membrane_format_plane_height(fmt, i, key.height);
+
+        if (size > 0 && end > size) {
+            membrane_err("dmabuf import: plane %d ends at %" PRId64 " past its %jd byte dmabuf", i,
+                end, (intmax_t)size);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * compositors recreate EGLImages for the same client buffers all the time, so imports are cached
+ * by the registration of their buffer and their layout. dmabuf inodes can't tell buffers apart,
+ * before 5.3 they all share one. entries go once the client has freed the buffer, which clears
+ * its registration, or when the cache is full.
+ */
+#define IMPORT_SWEEP_NS 1000000000LL
+
+struct ImportEntry {
+    ImportKey key;
+    RemoteWindowBuffer* buffer;
+    int64_t last_used;
+};
+
+static std::mutex g_import_lock;
+static std::vector<ImportEntry> g_imports;
+static int64_t g_import_sweep = 0;
+
+static size_t import_cache_size() {
+    static int64_t size = env_int("MEMBRANE_IMPORT_CACHE", 64);
+    return size > 0 ? size : 0;
+}
+
+static void import_drop(ImportEntry& entry) {
+    entry.buffer->common.decRef(&entry.buffer->common);
+}
+
+static void import_sweep(int64_t now) {
+    if (now - g_import_sweep < IMPORT_SWEEP_NS)
+        return;
+
+    g_import_sweep = now;
+
+    auto it = std::partition(g_imports.begin(), g_imports.end(), [](ImportEntry& entry) {
+        struct membrane_meta meta;
+        uint64_t id;
+        int fd = entry.buffer->handle->data[0];
+        return membrane_meta_get(membrane_drm_fd(), fd, &meta, &id) == 0 && id == entry.key.id;
+    });
+
+    std::for_each(it, g_imports.end(), import_drop);
+    g_imports.erase(it, g_imports.end());
+}
+
+/* the returned buffer carries a reference for the caller */
+static RemoteWindowBuffer* import_lookup(const ImportKey& key) {
+    std::lock_guard<std::mutex> lock(g_import_lock);
+    int64_t now = membrane_now_ns();
+
+    import_sweep(now);
+
+    for (ImportEntry& entry : g_imports) {
+        if (entry.key == key) {
+            entry.last_used = now;
+            entry.buffer->common.incRef(&entry.buffer->common);
+            return entry.buffer;
+        }
+    }
+
+    return NULL;
+}
+
+static void import_insert(const ImportKey& key, RemoteWindowBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(g_import_lock);
+
+    if (g_imports.size() >= import_cache_size()) {
+        auto lru = std::min_element(g_imports.begin(), g_imports.end(),
+            [](const ImportEntry& a, const ImportEntry& b) { return a.last_used < b.last_used; });
+
+        import_drop(*lru);
+        g_imports.erase(lru);
+    }
+
+    buffer->common.incRef(&buffer->common);
+    g_imports.push_back({ key, buffer, membrane_now_ns() });
+}
+
+/*
+ * the driver only takes its own reference in eglCreateImageKHR, after this hook has returned. the
+ * buffer handed to it keeps one of ours until the thread's next import, so an eviction on another
+ * thread can't free it in between.
+ */
+struct ImportHandoff {
+    RemoteWindowBuffer* buffer = nullptr;
+
+    ~ImportHandoff() { set(nullptr); }
+
+    void set(RemoteWindowBuffer* next) {
+        if (buffer)
+            buffer->common.decRef(&buffer->common);
+        buffer = next;
+    }
+};
+
+static thread_local ImportHandoff t_import_handoff;
+
+/* a null native buffer fails the driver's import with EGL_BAD_PARAMETER */
+static void import_reject(
+    EGLContext* ctx, EGLenum* target, EGLClientBuffer* buffer, const EGLint** attrib_list) {
+    *buffer = nullptr;
+    *target = EGL_NATIVE_BUFFER_ANDROID;
+    *ctx = EGL_NO_CONTEXT;
+    *attrib_list = nullptr;
+}
+
+extern "C" void membranews_passthroughImageKHR(
+    EGLContext* ctx, EGLenum* target, EGLClientBuffer* buffer, const EGLint** attrib_list) {
+    if (*target != EGL_LINUX_DMA_BUF_EXT)
+        return;
+
+    int usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
+    ImportKey key;
+
+    t_import_handoff.set(nullptr);
+
+    const struct membrane_format* fmt = import_parse(*attrib_list, &key);
+    if (!fmt) {
+        import_reject(ctx, target, buffer, attrib_list);
+        return;
+    }
+
+    struct membrane_meta meta;
+    int ret = membrane_meta_get(membrane_drm_fd(), key.planes[0].fd, &meta, &key.id);
+    if (ret != 0) {
+        membrane_err("Failed to look up buffer metadata: %s", strerror(-ret));
+        import_reject(ctx, target, buffer, attrib_list);
+        return;
+    }
+
+    std::vector<int> fds;
+    if (!import_resolve(fmt, &key, meta, &fds)) {
+        import_reject(ctx, target, buffer, attrib_list);
+        return;
+    }
+
+    bool cacheable = import_cache_size() > 0;
+
+    RemoteWindowBuffer* anwb = cacheable ? import_lookup(key) : NULL;
+    if (!anwb) {
+        if (!import_fits(fmt, key)) {
+            import_reject(ctx, target, buffer, attrib_list);
+            return;
+        }
+
+        native_handle_t* nh = membrane_meta_wrap(&meta, fds.data(), fds.size());
+        if (!nh) {
+            import_reject(ctx, target, buffer, attrib_list);
+            return;
+        }
+
+        buffer_handle_t handle = nullptr;
+        hybris_gralloc_import_buffer(nh, &handle);
+        native_handle_delete(nh);
+
+        if (!handle) {
+            import_reject(ctx, target, buffer, attrib_list);
+            return;
+        }
+
+        anwb = new RemoteWindowBuffer(key.width, key.height, key.planes[0].pitch / fmt->bpp,
+            fmt->hal_format, usage, handle);
+        anwb->setAllocated(true);
+
+        anwb->common.incRef(&anwb->common);
+        if (cacheable)
+            import_insert(key, anwb);
+    }
+
+    t_import_handoff.set(anwb);
+
+    *buffer = (EGLClientBuffer) static_cast<ANativeWindowBuffer*>(anwb);
+    *target = EGL_NATIVE_BUFFER_ANDROID;
+    *ctx = EGL_NO_CONTEXT;
+    *attrib_list = nullptr;
 }
 
 extern "C" const char* membranews_eglQueryString(
@@ -678,20 +1465,20 @@ extern "C" const char* membranews_eglQueryString(
 extern "C" void membranews_prepareSwap(
     EGLDisplay dpy, EGLNativeWindowType win, EGLint* damage_rects, EGLint damage_n_rects) {
     (void)dpy;
-    MembraneNativeWindow* window = static_cast<MembraneNativeWindow*>((struct ANativeWindow*)win);
+    MembraneWindow* window = static_cast<MembraneWindow*>((struct ANativeWindow*)win);
     window->prepareSwap(damage_rects, damage_n_rects);
 }
 
 extern "C" void membranews_finishSwap(EGLDisplay dpy, EGLNativeWindowType win) {
     (void)dpy;
-    MembraneNativeWindow* window = static_cast<MembraneNativeWindow*>((struct ANativeWindow*)win);
+    MembraneWindow* window = static_cast<MembraneWindow*>((struct ANativeWindow*)win);
     window->finishSwap();
 }
 
 extern "C" void membranews_setSwapInterval(
     EGLDisplay dpy, EGLNativeWindowType win, EGLint interval) {
     (void)dpy;
-    MembraneNativeWindow* window = static_cast<MembraneNativeWindow*>((struct ANativeWindow*)win);
+    MembraneWindow* window = static_cast<MembraneWindow*>((struct ANativeWindow*)win);
     window->setSwapInterval(interval);
 }
 
@@ -702,15 +1489,17 @@ extern "C" EGLBoolean membranews_eglQueryDmaBufModifiersEXT(EGLDisplay dpy, EGLi
     EGLint* num_modifiers) {
     (void)dpy;
 
-    if (format != DRM_FORMAT_ARGB8888 && format != DRM_FORMAT_XRGB8888)
+    const struct membrane_format* fmt = membrane_format_get(format);
+    if (!fmt)
         return EGL_FALSE;
 
+    /* YUV is sampled through samplerExternalOES */
     if (num_modifiers)
         *num_modifiers = 1;
     if (max_modifiers > 0 && modifiers)
         modifiers[0] = DRM_FORMAT_MOD_LINEAR;
     if (max_modifiers > 0 && external_only)
-        external_only[0] = EGL_FALSE;
+        external_only[0] = fmt->planes > 1 ? EGL_TRUE : EGL_FALSE;
 
     return EGL_TRUE;
 }
@@ -722,11 +1511,12 @@ extern "C" EGLBoolean membranews_eglQueryDmaBufFormatsEXT(
     if (!num_formats)
         return EGL_FALSE;
 
-    *num_formats = 2;
     if (max_formats > 0 && formats) {
-        formats[0] = DRM_FORMAT_ARGB8888;
-        if (max_formats > 1)
-            formats[1] = DRM_FORMAT_XRGB8888;
+        *num_formats = std::min<EGLint>(max_formats, MEMBRANE_NUM_FORMATS);
+        for (EGLint i = 0; i < *num_formats; i++)
+            formats[i] = membrane_formats[i].fourcc;
+    } else {
+        *num_formats = MEMBRANE_NUM_FORMATS;
     }
 
     return EGL_TRUE;
@@ -3,28 +3,76 @@
 
 #define _GNU_SOURCE
 
+#include <errno.h>
+#include <fcntl.h>
 #include <gbm.h>
 #include <gbm_backend_abi.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
 #include <hardware/gralloc.h>
 #include <xf86drm.h>
 
+#include "pool.h"
+
 #include <log.h>
+#include <membrane_format.h>
+#include <membrane_gbm.h>
+#include <membrane_meta.h>
+
+struct membrane_device {
+    struct gbm_device base;
+    struct membrane_pool* pool;
+    pthread_mutex_t prime_lock;
+};
 
 struct membrane_bo {
     struct gbm_bo base;
     buffer_handle_t handle;
-    int meta_fd;
+    const struct membrane_format* fmt;
+    int usage;
+    uint32_t pixel_stride;
+    void* map;
+    int map_usage;
+    int map_count;
+    bool imported;
+    bool exported;
+    uint32_t prime_handles[MEMBRANE_MAX_FDS];
+};
+
+enum slot_state {
+    SLOT_FREE,
+    SLOT_DEQUEUED,
+    SLOT_QUEUED,
+    SLOT_LOCKED,
+};
+
+struct membrane_surface {
+    struct membrane_gbm_surface base;
+    pthread_mutex_t lock;
+    const struct membrane_format* fmt;
+    uint32_t usage;
+    uint64_t queue_seq;
+    struct {
+        struct membrane_bo* bo;
+        enum slot_state state;
+        uint64_t seq;
+    } slots[MEMBRANE_GBM_MAX_BUFFERS];
 };
 
 int hybris_gralloc_allocate(
     int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride);
 int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
+int hybris_gralloc_import_buffer(buffer_handle_t raw_handle, buffer_handle_t* out_handle);
+int hybris_gralloc_lock(
+    buffer_handle_t handle, int usage, int l, int t, int w, int h, void** vaddr);
+int hybris_gralloc_unlock(buffer_handle_t handle);
 
 struct gbm_device* membrane_device_create(int fd, uint32_t gbm_backend_version);
 
@@ -45,33 +93,78 @@ const struct gbm_backend* gbmint_get_backend(const struct gbm_core* gbm_core) {
 }
 
 static void membrane_device_destroy(struct gbm_device* gbm) {
+    struct membrane_device* dev = (struct membrane_device*)gbm;
+
     membrane_debug("%s", __func__);
-    free(gbm);
+    pool_destroy(dev->pool);
+    pthread_mutex_destroy(&dev->prime_lock);
+    free(dev);
+}
+
+/* only scanout buffers get composer usage, it often means a carve-out or a larger layout */
+static int gralloc_usage(uint32_t usage) {
+    int gralloc_usage = GRALLOC_USAGE_HW_TEXTURE;
+
+    if (usage & GBM_BO_USE_RENDERING)
+        gralloc_usage |= GRALLOC_USAGE_HW_RENDER;
+    if (usage & GBM_BO_USE_SCANOUT)
+        gralloc_usage |= GRALLOC_USAGE_HW_COMPOSER;
+    if (usage & GBM_BO_USE_CURSOR)
+        gralloc_usage |= GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_CURSOR;
+    if (usage & (GBM_BO_USE_WRITE | GBM_BO_USE_CURSOR))
+        gralloc_usage |= GRALLOC_USAGE_SW_WRITE_OFTEN;
+    /* cpu access keeps gralloc away from tiled and compressed layouts */
+    if (usage & GBM_BO_USE_LINEAR)
+        gralloc_usage |= GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY;
+    if (usage & GBM_BO_USE_PROTECTED)
+        gralloc_usage |= GRALLOC_USAGE_PROTECTED;
+
+    return gralloc_usage;
+}
+
+/* bos are single plane, the YUV formats can only be imported as EGLImages */
+static const struct membrane_format* lookup_format(uint32_t format, uint32_t usage) {
+    const struct membrane_format* fmt = membrane_format_get(format);
+
+    if (fmt && fmt->planes > 1)
+        return NULL;
+
+    if (fmt && !fmt->scanout && (usage & (GBM_BO_USE_SCANOUT | GBM_BO_USE_CURSOR)))
+        return NULL;
+
+    return fmt;
+}
+
+static bool has_supported_modifier(const uint64_t* modifiers, unsigned int count) {
+    if (count == 0)
+        return true;
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (membrane_modifier_supported(modifiers[i]))
+            return true;
+    }
+
+    return false;
 }
 
 static int membrane_device_is_format_supported(
     struct gbm_device* gbm, uint32_t format, uint32_t usage) {
     (void)gbm;
-    (void)format;
-    (void)usage;
-    membrane_debug("%s", __func__);
-    return 0;
+    return lookup_format(format, usage) != NULL;
 }
 
 static int membrane_device_get_format_modifier_plane_count(
     struct gbm_device* device, uint32_t format, uint64_t modifier) {
     (void)device;
-    (void)format;
-    (void)modifier;
-    membrane_err("%s shouldnt get called", __func__);
-    return 0;
+
+    if (!lookup_format(format, 0) || !membrane_modifier_supported(modifier))
+        return -1;
+
+    return 1;
 }
 
-static struct gbm_bo* membrane_bo_create(struct gbm_device* gbm, uint32_t width, uint32_t height,
-    uint32_t format, uint32_t usage, const uint64_t* modifiers, const unsigned int count) {
-    (void)modifiers;
-    (void)count;
-    (void)usage;
+static struct membrane_bo* bo_alloc(struct gbm_device* gbm, uint32_t width, uint32_t height,
+    uint32_t format, const struct membrane_format* fmt, uint32_t usage) {
     struct membrane_bo* bo = calloc(1, sizeof(struct membrane_bo));
     if (!bo)
         return NULL;
@@ -80,106 +173,399 @@ static struct gbm_bo* membrane_bo_create(struct gbm_device* gbm, uint32_t width,
     bo->base.v0.width = width;
     bo->base.v0.height = height;
     bo->base.v0.format = format;
-
-    int gralloc_usage
-        = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
-
+    bo->fmt = fmt;
+    bo->usage = gralloc_usage(usage);
+
+    struct membrane_device* dev = (struct membrane_device*)gbm;
+    struct membrane_pool_key key = {
+        .width = width,
+        .height = height,
+        .format = fmt->hal_format,
+        .usage = bo->usage,
+    };
     buffer_handle_t handle = NULL;
     uint32_t stride = 0;
 
-    int ret = hybris_gralloc_allocate(
-        width, height, HAL_PIXEL_FORMAT_RGBA_8888, gralloc_usage, &handle, &stride);
-    if (ret != 0) {
-        membrane_debug("%s: gralloc_allocate failed: %d", __func__, ret);
-        free(bo);
-        return NULL;
+    if (!pool_get(dev->pool, &key, &handle, &stride)) {
+        int ret = hybris_gralloc_allocate(
+            width, height, fmt->hal_format, bo->usage, &handle, &stride);
+        if (ret != 0) {
+            membrane_debug("%s: gralloc_allocate failed: %d", __func__, ret);
+            free(bo);
+            return NULL;
+        }
+
+        ret = membrane_meta_set(gbm->v0.fd, handle, stride);
+        if (ret != 0) {
+            membrane_err("%s: failed to register buffer metadata: %s", __func__, strerror(-ret));
+            hybris_gralloc_release(handle, 1);
+            free(bo);
+            return NULL;
+        }
     }
 
     bo->handle = handle;
-    bo->base.v0.stride = stride * 4;
+    bo->pixel_stride = stride;
+    bo->base.v0.stride = stride * fmt->bpp;
 
-    bo->meta_fd = -1;
+    return bo;
+}
 
-    native_handle_t* nh = (native_handle_t*)handle;
-    int meta_size = nh->numInts * sizeof(int);
+static struct gbm_bo* membrane_bo_create(struct gbm_device* gbm, uint32_t width, uint32_t height,
+    uint32_t format, uint32_t usage, const uint64_t* modifiers, const unsigned int count) {
+    const struct membrane_format* fmt = lookup_format(format, usage);
+    if (!fmt) {
+        membrane_debug("%s: unsupported format %.4s usage %#x", __func__, (char*)&format, usage);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!has_supported_modifier(modifiers, count)) {
+        membrane_debug("%s: none of the %u modifiers is supported", __func__, count);
+        errno = EINVAL;
+        return NULL;
+    }
 
-    if (meta_size > 0) {
-        bo->meta_fd = memfd_create("membrane_meta", MFD_CLOEXEC);
-        if (bo->meta_fd >= 0) {
-            if (ftruncate(bo->meta_fd, meta_size) == -1)
-                fprintf(stderr, "%s: ftruncate failed", __func__);
-            if (write(bo->meta_fd, &nh->data[nh->numFds], meta_size) == -1)
-                membrane_debug("%s: write failed", __func__);
-            lseek(bo->meta_fd, 0, SEEK_SET);
+    struct membrane_bo* bo = bo_alloc(gbm, width, height, format, fmt, usage);
+    return bo ? &bo->base : NULL;
+}
+
+/*
+ * plane fds registered under plane 0's id are the same dmabuf again, every other fd is one more
+ * dmabuf of the gralloc handle. the handle needs exactly as many as it was allocated with.
+ */
+static int resolve_fds(struct gbm_device* gbm, const int* fds, int num_fds, uint64_t id,
+    const struct membrane_meta* meta, int* out) {
+    int count = 1;
+
+    out[0] = fds[0];
+
+    for (int i = 1; i < num_fds; i++) {
+        struct membrane_meta other;
+        uint64_t other_id = 0;
+        bool seen = false;
+
+        for (int j = 0; j < count; j++)
+            seen |= out[j] == fds[i];
+        if (seen)
+            continue;
+
+        int ret = membrane_meta_get(gbm->v0.fd, fds[i], &other, &other_id);
+        if (ret == 0 && other_id == id)
+            continue;
+        if (ret != -ENOENT) {
+            membrane_debug("%s: plane %d is not part of plane 0's buffer", __func__, i);
+            return -EINVAL;
         }
+
+        out[count++] = fds[i];
+    }
+
+    if (count != (int)meta->num_fds) {
+        membrane_debug("%s: %d dmabufs for a handle of %u", __func__, count, meta->num_fds);
+        return -EINVAL;
+    }
+
+    return count;
+}
+
+/* rebuilds the gralloc handle from the dmabufs and the metadata their allocator registered */
+static struct gbm_bo* bo_import_fds(struct gbm_device* gbm, uint32_t width, uint32_t height,
+    uint32_t format, uint32_t stride, const int* fds, int num_fds, uint32_t usage) {
+    const struct membrane_format* fmt = lookup_format(format, usage);
+    if (!fmt || num_fds < 1 || num_fds > MEMBRANE_MAX_FDS) {
+        membrane_debug("%s: unsupported format %.4s usage %#x", __func__, (char*)&format, usage);
+        errno = EINVAL;
+        return NULL;
     }
 
+    if (stride < membrane_format_min_pitch(fmt, 0, width) || stride % fmt->bpp) {
+        membrane_debug("%s: bad stride %u for width %u", __func__, stride, width);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct membrane_meta meta;
+    uint64_t id = 0;
+    int ret = membrane_meta_get(gbm->v0.fd, fds[0], &meta, &id);
+    if (ret != 0) {
+        membrane_debug("%s: no metadata for dmabuf: %s", __func__, strerror(-ret));
+        errno = -ret;
+        return NULL;
+    }
+
+    /* the bo maps and scans out with the gralloc layout, a different pitch would misread it */
+    if (stride != meta.stride * fmt->bpp) {
+        membrane_debug("%s: stride %u but the buffer has a stride of %u pixels", __func__, stride,
+            meta.stride);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int handle_fds[MEMBRANE_MAX_FDS];
+    int count = resolve_fds(gbm, fds, num_fds, id, &meta, handle_fds);
+    if (count < 0) {
+        errno = -count;
+        return NULL;
+    }
+
+    native_handle_t* nh = membrane_meta_wrap(&meta, handle_fds, count);
+    if (!nh) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    buffer_handle_t handle = NULL;
+    ret = hybris_gralloc_import_buffer(nh, &handle);
+    native_handle_delete(nh);
+
+    if (ret != 0 || !handle) {
+        membrane_err("%s: gralloc_import_buffer failed: %d", __func__, ret);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct membrane_bo* bo = calloc(1, sizeof(struct membrane_bo));
+    if (!bo) {
+        hybris_gralloc_release(handle, 0);
+        return NULL;
+    }
+
+    bo->base.gbm = gbm;
+    bo->base.v0.width = width;
+    bo->base.v0.height = height;
+    bo->base.v0.format = format;
+    bo->base.v0.stride = stride;
+    bo->handle = handle;
+    bo->fmt = fmt;
+    bo->usage = gralloc_usage(usage);
+    bo->pixel_stride = stride / fmt->bpp;
+    bo->imported = true;
+
     return &bo->base;
 }
 
 static struct gbm_bo* membrane_bo_import(
     struct gbm_device* gbm, uint32_t type, void* buffer, uint32_t usage) {
-    (void)gbm;
-    (void)type;
-    (void)buffer;
-    (void)usage;
-    membrane_err("%s shouldnt get called", __func__);
-    return NULL;
+    switch (type) {
+    case GBM_BO_IMPORT_FD: {
+        struct gbm_import_fd_data* data = buffer;
+
+        return bo_import_fds(
+            gbm, data->width, data->height, data->format, data->stride, &data->fd, 1, usage);
+    }
+    case GBM_BO_IMPORT_FD_MODIFIER: {
+        struct gbm_import_fd_modifier_data* data = buffer;
+
+        if (!membrane_modifier_supported(data->modifier)) {
+            membrane_debug("%s: unsupported modifier %#" PRIx64, __func__, data->modifier);
+            errno = EINVAL;
+            return NULL;
+        }
+
+        /* gralloc buffers start at the beginning of their first dmabuf */
+        if (data->num_fds < 1 || data->offsets[0] != 0) {
+            membrane_debug("%s: unsupported plane offset", __func__);
+            errno = EINVAL;
+            return NULL;
+        }
+
+        return bo_import_fds(gbm, data->width, data->height, data->format, data->strides[0],
+            data->fds, data->num_fds, usage);
+    }
+    default:
+        /* there is no server side wl_drm, clients hand out linux-dmabuf buffers the
+         * compositor imports by fd */
+        membrane_debug("%s: unsupported import type %#x", __func__, type);
+        errno = ENOSYS;
+        return NULL;
+    }
+}
+
+static int transfer_usage(uint32_t flags) {
+    int usage = 0;
+
+    if (flags & GBM_BO_TRANSFER_READ)
+        usage |= GRALLOC_USAGE_SW_READ_OFTEN;
+    if (flags & GBM_BO_TRANSFER_WRITE)
+        usage |= GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+    return usage;
+}
+
+/*
+ * overlapping maps share one gralloc lock, it is dropped with the last unmap since unlock is
+ * what flushes the CPU side for the GPU and the display. gralloc keeps the handle mapped in
+ * between so a later lock doesn't mmap again.
+ */
+static void* bo_map(struct gbm_bo* bo, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    uint32_t flags, uint32_t* stride, void** map_data) {
+    struct membrane_bo* mbo = (struct membrane_bo*)bo;
+    int usage = transfer_usage(flags);
+
+    if (!usage || x + width > bo->v0.width || y + height > bo->v0.height) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (mbo->map_count > 0 && (mbo->map_usage & usage) != usage) {
+        membrane_debug("%s: bo is already mapped with usage %#x", __func__, mbo->map_usage);
+        errno = EBUSY;
+        return NULL;
+    }
+
+    if (mbo->map_count == 0) {
+        int ret = hybris_gralloc_lock(
+            mbo->handle, usage, 0, 0, bo->v0.width, bo->v0.height, &mbo->map);
+        if (ret != 0) {
+            membrane_err("%s: gralloc_lock failed: %d", __func__, ret);
+            errno = -ret;
+            return NULL;
+        }
+
+        mbo->map_usage = usage;
+    }
+
+    mbo->map_count++;
+
+    *stride = bo->v0.stride;
+    *map_data = mbo;
+
+    return (uint8_t*)mbo->map + (size_t)y * bo->v0.stride + (size_t)x * mbo->fmt->bpp;
 }
 
+/* a mapping would hand out the gralloc byte order, not the one the fourcc promises */
 static void* membrane_bo_map(struct gbm_bo* bo, uint32_t x, uint32_t y, uint32_t width,
     uint32_t height, uint32_t flags, uint32_t* stride, void** map_data) {
-    (void)bo;
-    (void)x;
-    (void)y;
-    (void)width;
-    (void)height;
-    (void)flags;
-    (void)stride;
-    (void)map_data;
-    membrane_err("%s shouldnt get called", __func__);
-    return NULL;
+    struct membrane_bo* mbo = (struct membrane_bo*)bo;
+
+    if (!mbo->fmt->cpu_order) {
+        membrane_debug("%s: %.4s is not laid out in its byte order", __func__,
+            (char*)&mbo->fmt->fourcc);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return bo_map(bo, x, y, width, height, flags, stride, map_data);
 }
 
 static void membrane_bo_unmap(struct gbm_bo* bo, void* map_data) {
-    (void)bo;
-    (void)map_data;
-    membrane_err("%s shouldnt get called", __func__);
+    struct membrane_bo* mbo = (struct membrane_bo*)bo;
+
+    if (map_data != mbo || mbo->map_count == 0) {
+        membrane_err("%s: bo is not mapped", __func__);
+        return;
+    }
+
+    if (--mbo->map_count == 0) {
+        hybris_gralloc_unlock(mbo->handle);
+        mbo->map = NULL;
+        mbo->map_usage = 0;
+    }
 }
 
-static int membrane_bo_write(struct gbm_bo* bo, const void* buf, size_t data) {
-    (void)bo;
-    (void)buf;
-    (void)data;
-    membrane_err("%s shouldnt get called", __func__);
-    return -1;
+/* buf holds tightly packed rows from the top, a short buffer only fills the first rows */
+/* ARGB and XRGB are allocated as RGBA, so cursor images need red and blue swapped */
+static void copy_swap_rb(uint8_t* dst, const uint8_t* src, size_t size) {
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        dst[i] = src[i + 2];
+        dst[i + 1] = src[i + 1];
+        dst[i + 2] = src[i];
+        dst[i + 3] = src[i + 3];
+    }
 }
 
-static int membrane_bo_get_plane_fd(struct gbm_bo* bo, int plane) {
+static int membrane_bo_write(struct gbm_bo* bo, const void* buf, size_t size) {
     struct membrane_bo* mbo = (struct membrane_bo*)bo;
-    native_handle_t* nh = (native_handle_t*)mbo->handle;
-    if (!nh)
+    size_t row = (size_t)bo->v0.width * mbo->fmt->bpp;
+    uint32_t rows = (size + row - 1) / row;
+    bool swap = mbo->fmt->fourcc == DRM_FORMAT_ARGB8888 || mbo->fmt->fourcc == DRM_FORMAT_XRGB8888;
+
+    if (rows > bo->v0.height || (!mbo->fmt->cpu_order && !swap)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t stride;
+    void* map_data;
+    uint8_t* dst
+        = bo_map(bo, 0, 0, bo->v0.width, rows, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+    if (!dst)
         return -1;
 
-    if (plane >= 0 && plane < nh->numFds) {
-        return dup(nh->data[plane]);
-    } else if (plane == nh->numFds && mbo->meta_fd >= 0) {
-        return dup(mbo->meta_fd);
+    if (swap) {
+        const uint8_t* src = buf;
+
+        for (; size >= row; size -= row, src += row, dst += stride)
+            copy_swap_rb(dst, src, row);
+        copy_swap_rb(dst, src, size);
+    } else if (stride == row) {
+        memcpy(dst, buf, size);
+    } else {
+        const uint8_t* src = buf;
+
+        for (; size >= row; size -= row, src += row, dst += stride)
+            memcpy(dst, src, row);
+        memcpy(dst, src, size);
     }
-    return -1;
+
+    membrane_bo_unmap(bo, map_data);
+
+    return 0;
+}
+
+/* the returned fd belongs to the caller, as with every other gbm backend */
+static int membrane_bo_get_plane_fd(struct gbm_bo* bo, int plane) {
+    struct membrane_bo* mbo = (struct membrane_bo*)bo;
+    const native_handle_t* nh = mbo->handle;
+
+    if (!nh || plane < 0 || plane >= nh->numFds) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    mbo->exported = true;
+
+    return fcntl(nh->data[plane], F_DUPFD_CLOEXEC, 0);
 }
 
 static int membrane_bo_get_fd(struct gbm_bo* bo) {
-    (void)bo;
-    membrane_err("%s shouldnt get called", __func__);
-    return -1;
+    return membrane_bo_get_plane_fd(bo, 0);
 }
 
+/*
+ * the dmabuf is imported into the device fd on first use and the handle lives as long as the
+ * bo, so a compositor can add framebuffers straight from it. the caller must not close it.
+ */
 static union gbm_bo_handle membrane_bo_get_handle(struct gbm_bo* bo, int plane) {
-    (void)bo;
-    (void)plane;
-    membrane_err("%s shouldnt get called", __func__);
+    struct membrane_bo* mbo = (struct membrane_bo*)bo;
+    struct membrane_device* dev = (struct membrane_device*)bo->gbm;
+    const native_handle_t* nh = mbo->handle;
     union gbm_bo_handle handle = { 0 };
+
+    if (!nh || plane < 0 || plane >= nh->numFds || plane >= MEMBRANE_MAX_FDS) {
+        errno = EINVAL;
+        return handle;
+    }
+
+    pthread_mutex_lock(&dev->prime_lock);
+
+    if (!mbo->prime_handles[plane]) {
+        struct drm_prime_handle prime = { .fd = nh->data[plane] };
+
+        /* a framebuffer made from the handle reaches the daemon, which keeps the dmabuf */
+        if (ioctl(bo->gbm->v0.fd, DRM_IOCTL_PRIME_FD_TO_HANDLE, &prime) == 0) {
+            mbo->prime_handles[plane] = prime.handle;
+            mbo->exported = true;
+        } else {
+            membrane_err("%s: prime import failed: %s", __func__, strerror(errno));
+        }
+    }
+
+    handle.u32 = mbo->prime_handles[plane];
+
+    pthread_mutex_unlock(&dev->prime_lock);
+
     return handle;
 }
 
@@ -201,10 +587,32 @@ static uint64_t membrane_bo_get_modifier(struct gbm_bo* bo) {
 
 static void membrane_bo_destroy(struct gbm_bo* bo) {
     struct membrane_bo* mbo = (struct membrane_bo*)bo;
-    if (mbo->meta_fd >= 0)
-        close(mbo->meta_fd);
-    if (mbo->handle)
+    struct membrane_device* dev = (struct membrane_device*)bo->gbm;
+    struct membrane_pool_key key = {
+        .width = bo->v0.width,
+        .height = bo->v0.height,
+        .format = mbo->fmt->hal_format,
+        .usage = mbo->usage,
+    };
+
+    if (mbo->map_count > 0)
+        hybris_gralloc_unlock(mbo->handle);
+
+    for (int i = 0; i < MEMBRANE_MAX_FDS; i++) {
+        struct drm_gem_close args = { .handle = mbo->prime_handles[i] };
+
+        if (args.handle)
+            ioctl(bo->gbm->v0.fd, DRM_IOCTL_GEM_CLOSE, &args);
+    }
+    if (mbo->handle && mbo->imported) {
+        hybris_gralloc_release(mbo->handle, 0);
+    } else if (mbo->handle && dev->pool && !mbo->exported) {
+        /* another process may still hold an exported dmabuf, it must not see it reused */
+        pool_put(dev->pool, &key, mbo->handle, mbo->pixel_stride, mbo->fmt->bpp);
+    } else if (mbo->handle) {
+        membrane_meta_clear(bo->gbm->v0.fd, mbo->handle);
         hybris_gralloc_release(mbo->handle, 1);
+    }
     free(mbo);
 }
 
@@ -213,44 +621,189 @@ static int membrane_bo_get_planes(struct gbm_bo* bo) {
     native_handle_t* nh = (native_handle_t*)mbo->handle;
     if (!nh)
         return 0;
-    return nh->numFds + (mbo->meta_fd >= 0 ? 1 : 0);
+    return nh->numFds;
+}
+
+static int surface_find(struct membrane_surface* surf, struct gbm_bo* bo) {
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS; i++) {
+        if (surf->slots[i].bo && &surf->slots[i].bo->base == bo)
+            return i;
+    }
+
+    return -1;
+}
+
+/* reuses a free buffer and only allocates while the ring is still growing */
+static int surface_dequeue(struct membrane_gbm_surface* base, struct membrane_gbm_buffer* buffer) {
+    struct membrane_surface* surf = (struct membrane_surface*)base;
+    struct gbm_surface* s = &surf->base.base;
+    int slot = -1;
+
+    pthread_mutex_lock(&surf->lock);
+
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS && slot < 0; i++) {
+        if (surf->slots[i].bo && surf->slots[i].state == SLOT_FREE)
+            slot = i;
+    }
+
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS && slot < 0; i++) {
+        if (surf->slots[i].bo)
+            continue;
+
+        surf->slots[i].bo
+            = bo_alloc(s->gbm, s->v0.width, s->v0.height, s->v0.format, surf->fmt, surf->usage);
+        if (!surf->slots[i].bo)
+            break;
+
+        membrane_debug("%s: %ux%u buffer %d", __func__, s->v0.width, s->v0.height, i);
+        slot = i;
+    }
+
+    if (slot >= 0) {
+        struct membrane_bo* bo = surf->slots[slot].bo;
+
+        surf->slots[slot].state = SLOT_DEQUEUED;
+        buffer->handle = bo->handle;
+        buffer->width = bo->base.v0.width;
+        buffer->height = bo->base.v0.height;
+        buffer->stride = bo->pixel_stride;
+    }
+
+    pthread_mutex_unlock(&surf->lock);
+
+    if (slot < 0)
+        membrane_err("%s: all buffers are locked by the application", __func__);
+
+    return slot;
+}
+
+static void surface_queue(struct membrane_gbm_surface* base, int slot) {
+    struct membrane_surface* surf = (struct membrane_surface*)base;
+
+    pthread_mutex_lock(&surf->lock);
+    surf->slots[slot].state = SLOT_QUEUED;
+    surf->slots[slot].seq = ++surf->queue_seq;
+    pthread_mutex_unlock(&surf->lock);
+}
+
+static void surface_cancel(struct membrane_gbm_surface* base, int slot) {
+    struct membrane_surface* surf = (struct membrane_surface*)base;
+
+    pthread_mutex_lock(&surf->lock);
+    surf->slots[slot].state = SLOT_FREE;
+    pthread_mutex_unlock(&surf->lock);
 }
 
 static struct gbm_surface* membrane_surface_create(struct gbm_device* gbm, uint32_t width,
     uint32_t height, uint32_t format, uint32_t flags, const uint64_t* modifiers,
     const unsigned count) {
-    (void)gbm;
-    (void)width;
-    (void)height;
-    (void)format;
-    (void)flags;
-    (void)modifiers;
-    (void)count;
-    membrane_err("%s shouldnt get called", __func__);
-    return NULL;
+    const struct membrane_format* fmt = lookup_format(format, flags);
+    if (!fmt || !has_supported_modifier(modifiers, count)) {
+        membrane_debug("%s: unsupported format %.4s flags %#x", __func__, (char*)&format, flags);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct membrane_surface* surf = calloc(1, sizeof(struct membrane_surface));
+    if (!surf)
+        return NULL;
+
+    pthread_mutex_init(&surf->lock, NULL);
+    surf->fmt = fmt;
+    surf->usage = flags | GBM_BO_USE_RENDERING;
+
+    surf->base.base.gbm = gbm;
+    surf->base.base.v0.width = width;
+    surf->base.base.v0.height = height;
+    surf->base.base.v0.format = format;
+    surf->base.base.v0.flags = flags;
+    surf->base.format = fmt->hal_format;
+    surf->base.usage = gralloc_usage(surf->usage);
+    surf->base.dequeue = surface_dequeue;
+    surf->base.queue = surface_queue;
+    surf->base.cancel = surface_cancel;
+
+    return &surf->base.base;
 }
 
+/* hands out the last swapped frame, the ones it superseded are never shown and go back */
 static struct gbm_bo* membrane_surface_lock_front_buffer(struct gbm_surface* surface) {
-    (void)surface;
-    membrane_err("%s shouldnt get called", __func__);
-    return NULL;
+    struct membrane_surface* surf = (struct membrane_surface*)surface;
+    int slot = -1;
+
+    pthread_mutex_lock(&surf->lock);
+
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS; i++) {
+        if (surf->slots[i].state == SLOT_QUEUED
+            && (slot < 0 || surf->slots[i].seq > surf->slots[slot].seq))
+            slot = i;
+    }
+
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS; i++) {
+        if (i != slot && surf->slots[i].state == SLOT_QUEUED)
+            surf->slots[i].state = SLOT_FREE;
+    }
+
+    if (slot >= 0)
+        surf->slots[slot].state = SLOT_LOCKED;
+
+    pthread_mutex_unlock(&surf->lock);
+
+    if (slot < 0) {
+        membrane_err("%s: no frame has been swapped", __func__);
+        return NULL;
+    }
+
+    return &surf->slots[slot].bo->base;
 }
 
 static void membrane_surface_release_buffer(struct gbm_surface* surface, struct gbm_bo* bo) {
-    (void)surface;
-    (void)bo;
-    membrane_err("%s shouldnt get called", __func__);
+    struct membrane_surface* surf = (struct membrane_surface*)surface;
+
+    pthread_mutex_lock(&surf->lock);
+
+    int slot = surface_find(surf, bo);
+    if (slot >= 0 && surf->slots[slot].state == SLOT_LOCKED)
+        surf->slots[slot].state = SLOT_FREE;
+    else
+        membrane_err("%s: buffer %p is not locked on this surface", __func__, (void*)bo);
+
+    pthread_mutex_unlock(&surf->lock);
 }
 
 static int membrane_surface_has_free_buffers(struct gbm_surface* surface) {
-    (void)surface;
-    membrane_err("%s shouldnt get called", __func__);
-    return 0;
+    struct membrane_surface* surf = (struct membrane_surface*)surface;
+    int free_buffers = 0;
+
+    pthread_mutex_lock(&surf->lock);
+
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS; i++) {
+        if (!surf->slots[i].bo || surf->slots[i].state == SLOT_FREE)
+            free_buffers++;
+    }
+
+    pthread_mutex_unlock(&surf->lock);
+
+    return free_buffers > 0;
 }
 
 static void membrane_surface_destroy(struct gbm_surface* surface) {
-    (void)surface;
-    membrane_err("%s shouldnt get called", __func__);
+    struct membrane_surface* surf = (struct membrane_surface*)surface;
+
+    /* the same teardown gbm_bo_destroy does, compositors hang their framebuffers off it */
+    for (int i = 0; i < MEMBRANE_GBM_MAX_BUFFERS; i++) {
+        struct gbm_bo* bo = surf->slots[i].bo ? &surf->slots[i].bo->base : NULL;
+
+        if (!bo)
+            continue;
+
+        if (bo->v0.destroy_user_data)
+            bo->v0.destroy_user_data(bo, bo->v0.user_data);
+        membrane_bo_destroy(bo);
+    }
+
+    pthread_mutex_destroy(&surf->lock);
+    free(surf);
 }
 
 struct gbm_device* membrane_device_create(int fd, uint32_t gbm_backend_version) {
@@ -269,13 +822,18 @@ struct gbm_device* membrane_device_create(int fd, uint32_t gbm_backend_version)
     }
     drmFreeVersion(version);
 
-    struct gbm_device* gbm = calloc(1, sizeof(struct gbm_device));
-    if (!gbm)
+    struct membrane_device* dev = calloc(1, sizeof(struct membrane_device));
+    if (!dev)
         return NULL;
 
+    dev->pool = pool_new(fd);
+    pthread_mutex_init(&dev->prime_lock, NULL);
+
+    struct gbm_device* gbm = &dev->base;
+
     gbm->v0.backend_version = gbm_backend_version;
     gbm->v0.fd = fd;
-    gbm->v0.name = "membrane";
+    gbm->v0.name = MEMBRANE_GBM_NAME;
     gbm->v0.destroy = membrane_device_destroy;
     gbm->v0.is_format_supported = membrane_device_is_format_supported;
     gbm->v0.get_format_modifier_plane_count = membrane_device_get_format_modifier_plane_count;
@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+#include <log.h>
+#include <membrane_meta.h>
+#include <membrane_time.h>
+
+#define POOL_BUCKETS 16
+#define POOL_DEFAULT_MB 64
+#define POOL_DEFAULT_IDLE_MS 2000
+
+/*
+ * a stall of 200ms within 2s means the system is short on memory. unprivileged triggers need a
+ * window that is a multiple of 2s.
+ */
+#define POOL_PSI_TRIGGER "some 200000 2000000"
+
+int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
+
+struct pool_entry {
+    struct membrane_pool_key key;
+    buffer_handle_t handle;
+    uint32_t stride;
+    size_t size;
+    int64_t freed;
+    struct pool_entry* next;
+    struct pool_entry* lru_prev;
+    struct pool_entry* lru_next;
+};
+
+struct membrane_pool {
+    int drm_fd;
+    size_t cap;
+    int64_t idle_ns;
+
+    pthread_mutex_t lock;
+    struct pool_entry* buckets[POOL_BUCKETS];
+    /* oldest first */
+    struct pool_entry* lru_head;
+    struct pool_entry* lru_tail;
+    size_t bytes;
+
+    pthread_t thread;
+    bool thread_tried;
+    bool thread_started;
+    bool stopping;
+    int wake_fd;
+    int psi_fd;
+};
+
+static int64_t env_int(const char* name, int64_t def) {
+    const char* v = getenv(name);
+    return v && *v ? strtoll(v, NULL, 0) : def;
+}
+
+static unsigned int bucket_of(const struct membrane_pool_key* key) {
+    uint32_t h = key->width * 31 + key->height;
+    h = h * 31 + (uint32_t)key->format;
+    h = h * 31 + (uint32_t)key->usage;
+    return h % POOL_BUCKETS;
+}
+
+static bool key_equal(const struct membrane_pool_key* a, const struct membrane_pool_key* b) {
+    return a->width == b->width && a->height == b->height && a->format == b->format
+        && a->usage == b->usage;
+}
+
+static void release_buffer(struct membrane_pool* pool, buffer_handle_t handle) {
+    membrane_meta_clear(pool->drm_fd, handle);
+    hybris_gralloc_release(handle, 1);
+}
+
+/* unlinks entry from its bucket and the lru, called with the lock held */
+static void unlink_entry(struct membrane_pool* pool, struct pool_entry* entry) {
+    struct pool_entry** link = &pool->buckets[bucket_of(&entry->key)];
+
+    while (*link != entry)
+        link = &(*link)->next;
+    *link = entry->next;
+
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        pool->lru_head = entry->lru_next;
+
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        pool->lru_tail = entry->lru_prev;
+
+    pool->bytes -= entry->size;
+}
+
+/* pops entries off the lru while keep() rejects them, the caller releases the returned list */
+static struct pool_entry* evict(
+    struct membrane_pool* pool, bool (*keep)(struct membrane_pool*, struct pool_entry*, int64_t),
+    int64_t now) {
+    struct pool_entry* victims = NULL;
+
+    while (pool->lru_head && !keep(pool, pool->lru_head, now)) {
+        struct pool_entry* entry = pool->lru_head;
+
+        unlink_entry(pool, entry);
+        entry->next = victims;
+        victims = entry;
+    }
+
+    return victims;
+}
+
+static void release_entries(struct membrane_pool* pool, struct pool_entry* entries) {
+    while (entries) {
+        struct pool_entry* next = entries->next;
+
+        release_buffer(pool, entries->handle);
+        free(entries);
+        entries = next;
+    }
+}
+
+static bool keep_fresh(struct membrane_pool* pool, struct pool_entry* entry, int64_t now) {
+    return now - entry->freed < pool->idle_ns;
+}
+
+static bool keep_under_cap(struct membrane_pool* pool, struct pool_entry* entry, int64_t now) {
+    return pool->bytes <= pool->cap;
+}
+
+static bool keep_none(struct membrane_pool* pool, struct pool_entry* entry, int64_t now) {
+    return false;
+}
+
+/* drops buffers that sat unused for idle_ns, and everything under memory pressure */
+static void* pool_thread(void* data) {
+    struct membrane_pool* pool = data;
+
+    pthread_setname_np(pthread_self(), "membrane-pool");
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+
+        struct pool_entry* victims = evict(pool, keep_fresh, membrane_now_ns());
+        bool stopping = pool->stopping;
+        int timeout = -1;
+
+        if (pool->lru_head) {
+            int64_t left = pool->lru_head->freed + pool->idle_ns - membrane_now_ns();
+            timeout = left > 0 ? (left + 999999) / 1000000 : 0;
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if (victims)
+            membrane_debug("pool: trimming idle buffers");
+        release_entries(pool, victims);
+
+        if (stopping)
+            break;
+
+        struct pollfd fds[] = {
+            { .fd = pool->wake_fd, .events = POLLIN },
+            { .fd = pool->psi_fd, .events = POLLPRI },
+        };
+
+        if (poll(fds, pool->psi_fd >= 0 ? 2 : 1, timeout) < 0 && errno != EINTR)
+            break;
+
+        uint64_t v;
+        if ((fds[0].revents & POLLIN) && read(pool->wake_fd, &v, sizeof(v)) != sizeof(v))
+            membrane_err("pool: wake read failed: %s", strerror(errno));
+
+        if (pool->psi_fd >= 0 && (fds[1].revents & POLLPRI)) {
+            pthread_mutex_lock(&pool->lock);
+            victims = evict(pool, keep_none, 0);
+            pthread_mutex_unlock(&pool->lock);
+
+            membrane_debug("pool: memory pressure, trimming");
+            release_entries(pool, victims);
+        }
+    }
+
+    return NULL;
+}
+
+static int open_psi_trigger(void) {
+    int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        membrane_err("pool: no memory pressure trim, open failed: %s", strerror(errno));
+        return -1;
+    }
+
+    if (write(fd, POOL_PSI_TRIGGER, strlen(POOL_PSI_TRIGGER) + 1) < 0) {
+        membrane_err("pool: no memory pressure trim, trigger failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void wake(struct membrane_pool* pool) {
+    uint64_t v = 1;
+    if (write(pool->wake_fd, &v, sizeof(v)) != sizeof(v))
+        membrane_err("pool: wake write failed: %s", strerror(errno));
+}
+
+struct membrane_pool* pool_new(int drm_fd) {
+    int64_t mb = env_int("MEMBRANE_GBM_POOL_MB", POOL_DEFAULT_MB);
+    if (mb <= 0)
+        return NULL;
+
+    struct membrane_pool* pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pool->wake_fd < 0) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->drm_fd = drm_fd;
+    pool->cap = (size_t)mb << 20;
+    pool->idle_ns = env_int("MEMBRANE_GBM_POOL_IDLE_MS", POOL_DEFAULT_IDLE_MS) * 1000000LL;
+    pool->psi_fd = -1;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    return pool;
+}
+
+void pool_destroy(struct membrane_pool* pool) {
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    struct pool_entry* victims = evict(pool, keep_none, 0);
+    pool->stopping = true;
+    pthread_mutex_unlock(&pool->lock);
+
+    release_entries(pool, victims);
+
+    if (pool->thread_started) {
+        wake(pool);
+        pthread_join(pool->thread, NULL);
+    }
+
+    if (pool->psi_fd >= 0)
+        close(pool->psi_fd);
+    close(pool->wake_fd);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+bool pool_get(struct membrane_pool* pool, const struct membrane_pool_key* key,
+    buffer_handle_t* handle, uint32_t* stride) {
+    if (!pool)
+        return false;
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* the bucket is newest first, take the oldest so consumers had the longest to let go */
+    struct pool_entry* found = NULL;
+    for (struct pool_entry* e = pool->buckets[bucket_of(key)]; e; e = e->next) {
+        if (key_equal(&e->key, key))
+            found = e;
+    }
+
+    if (found)
+        unlink_entry(pool, found);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!found)
+        return false;
+
+    *handle = found->handle;
+    *stride = found->stride;
+    free(found);
+
+    return true;
+}
+
+void pool_put(struct membrane_pool* pool, const struct membrane_pool_key* key,
+    buffer_handle_t handle, uint32_t stride, int bpp) {
+    size_t size = (size_t)stride * key->height * bpp;
+    struct pool_entry* entry = NULL;
+
+    if (size <= pool->cap)
+        entry = calloc(1, sizeof(*entry));
+
+    if (!entry) {
+        release_buffer(pool, handle);
+        return;
+    }
+
+    entry->key = *key;
+    entry->handle = handle;
+    entry->stride = stride;
+    entry->size = size;
+    entry->freed = membrane_now_ns();
+
+    pthread_mutex_lock(&pool->lock);
+
+    bool was_empty = !pool->lru_head;
+    unsigned int b = bucket_of(key);
+    entry->next = pool->buckets[b];
+    pool->buckets[b] = entry;
+
+    entry->lru_prev = pool->lru_tail;
+    if (pool->lru_tail)
+        pool->lru_tail->lru_next = entry;
+    else
+        pool->lru_head = entry;
+    pool->lru_tail = entry;
+    pool->bytes += size;
+
+    struct pool_entry* victims = evict(pool, keep_under_cap, 0);
+
+    /* the trim thread starts with the first pooled buffer and sleeps while the pool is empty */
+    bool start = !pool->thread_tried;
+    if (start) {
+        pool->thread_tried = true;
+        pool->psi_fd = open_psi_trigger();
+        pool->thread_started = pthread_create(&pool->thread, NULL, pool_thread, pool) == 0;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    release_entries(pool, victims);
+
+    if (!start && was_empty && pool->thread_started)
+        wake(pool);
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cutils/native_handle.h>
+
+struct membrane_pool;
+
+struct membrane_pool_key {
+    uint32_t width;
+    uint32_t height;
+    int format;
+    int usage;
+};
+
+struct membrane_pool* pool_new(int drm_fd);
+void pool_destroy(struct membrane_pool* pool);
+
+/* hands back a recently freed buffer with the same key, its metadata is still registered */
+bool pool_get(struct membrane_pool* pool, const struct membrane_pool_key* key,
+    buffer_handle_t* handle, uint32_t* stride);
+
+/* takes ownership of the handle, releasing it right away if the pool can't keep it */
+void pool_put(struct membrane_pool* pool, const struct membrane_pool_key* key,
+    buffer_handle_t handle, uint32_t stride, int bpp);
+
+#endif /* POOL_H */
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <drm_fourcc.h>
+#include <system/graphics.h>
+
+#define MEMBRANE_FORMAT_MAX_PLANES 4
+
+/*
+ * the scanout fourccs map onto the RGBA layouts every HWC composes rather than their literal byte
+ * order, which GLES hides but cpu access does not. cpu_order is set where the gralloc layout is
+ * the fourcc's byte order. only ARGB and XRGB can be scanned out.
+ * bpp is per pixel of the first plane, the YUV formats are only imported as video textures and
+ * keep their chroma planes subsampled by hsub and vsub within the one gralloc buffer.
+ */
+struct membrane_format {
+    uint32_t fourcc;
+    int hal_format;
+    int bpp;
+    bool scanout;
+    bool cpu_order;
+    int planes;
+    int hsub;
+    int vsub;
+};
+
+static const struct membrane_format membrane_formats[] = {
+    { DRM_FORMAT_ARGB8888, HAL_PIXEL_FORMAT_RGBA_8888, 4, true, false, 1, 1, 1 },
+    { DRM_FORMAT_XRGB8888, HAL_PIXEL_FORMAT_RGBX_8888, 4, true, false, 1, 1, 1 },
+    { DRM_FORMAT_ABGR8888, HAL_PIXEL_FORMAT_RGBA_8888, 4, false, true, 1, 1, 1 },
+    { DRM_FORMAT_XBGR8888, HAL_PIXEL_FORMAT_RGBX_8888, 4, false, true, 1, 1, 1 },
+    { DRM_FORMAT_BGR888, HAL_PIXEL_FORMAT_RGB_888, 3, false, true, 1, 1, 1 },
+    { DRM_FORMAT_RGB565, HAL_PIXEL_FORMAT_RGB_565, 2, false, true, 1, 1, 1 },
+    { DRM_FORMAT_ABGR2101010, HAL_PIXEL_FORMAT_RGBA_1010102, 4, false, true, 1, 1, 1 },
+    { DRM_FORMAT_XBGR2101010, HAL_PIXEL_FORMAT_RGBA_1010102, 4, false, true, 1, 1, 1 },
+    { DRM_FORMAT_ARGB2101010, HAL_PIXEL_FORMAT_RGBA_1010102, 4, false, false, 1, 1, 1 },
+    { DRM_FORMAT_XRGB2101010, HAL_PIXEL_FORMAT_RGBA_1010102, 4, false, false, 1, 1, 1 },
+    { DRM_FORMAT_ABGR16161616F, HAL_PIXEL_FORMAT_RGBA_FP16, 8, false, true, 1, 1, 1 },
+    { DRM_FORMAT_NV12, HAL_PIXEL_FORMAT_YCBCR_420_888, 1, false, false, 2, 2, 2 },
+    { DRM_FORMAT_NV21, HAL_PIXEL_FORMAT_YCRCB_420_SP, 1, false, true, 2, 2, 2 },
+    { DRM_FORMAT_YVU420, HAL_PIXEL_FORMAT_YV12, 1, false, true, 3, 2, 2 },
+    { DRM_FORMAT_P010, HAL_PIXEL_FORMAT_YCBCR_P010, 2, false, true, 2, 2, 2 },
+};
+
+#define MEMBRANE_NUM_FORMATS (sizeof(membrane_formats) / sizeof(membrane_formats[0]))
+
+static inline const struct membrane_format* membrane_format_get(uint32_t fourcc) {
+    for (size_t i = 0; i < MEMBRANE_NUM_FORMATS; i++) {
+        if (membrane_formats[i].fourcc == fourcc)
+            return &membrane_formats[i];
+    }
+
+    return NULL;
+}
+
+static inline uint32_t membrane_format_plane_height(
+    const struct membrane_format* fmt, int plane, uint32_t height) {
+    return plane ? (height + fmt->vsub - 1) / fmt->vsub : height;
+}
+
+/* the smallest pitch of a plane, semi-planar chroma interleaves two samples */
+static inline uint32_t membrane_format_min_pitch(
+    const struct membrane_format* fmt, int plane, uint32_t width) {
+    if (!plane)
+        return width * fmt->bpp;
+
+    uint32_t samples = (width + fmt->hsub - 1) / fmt->hsub;
+    return samples * fmt->bpp * (fmt->planes == 2 ? 2 : 1);
+}
+
+/* gralloc buffers are exported as plain single plane images */
+static inline bool membrane_modifier_supported(uint64_t modifier) {
+    return modifier == DRM_FORMAT_MOD_LINEAR || modifier == DRM_FORMAT_MOD_INVALID;
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cutils/native_handle.h>
+#include <gbm_backend_abi.h>
+
+#define MEMBRANE_GBM_NAME "membrane"
+#define MEMBRANE_GBM_MAX_BUFFERS 4
+
+/* stride is in pixels, the gralloc handle stays owned by the surface */
+struct membrane_gbm_buffer {
+    buffer_handle_t handle;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+};
+
+/*
+ * the EGL platform renders into gbm_surfaces of this backend through these hooks, format and
+ * usage are the HAL values every buffer is allocated with. dequeue returns the slot of a free
+ * buffer or -1 when the application still holds all of them, the newest queued slot is what the
+ * next lock_front_buffer returns.
+ */
+struct membrane_gbm_surface {
+    struct gbm_surface base;
+    int format;
+    int usage;
+    int (*dequeue)(struct membrane_gbm_surface* surface, struct membrane_gbm_buffer* buffer);
+    void (*queue)(struct membrane_gbm_surface* surface, int slot);
+    void (*cancel)(struct membrane_gbm_surface* surface, int slot);
+};
+
+static inline struct membrane_gbm_surface* membrane_gbm_surface(struct gbm_surface* surface) {
+    if (!surface || !surface->gbm || !surface->gbm->v0.name
+        || strcmp(surface->gbm->v0.name, MEMBRANE_GBM_NAME) != 0)
+        return NULL;
+
+    return (struct membrane_gbm_surface*)surface;
+}
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <cutils/native_handle.h>
+#include <xf86drm.h>
+
+#include <membrane.h>
+
+static inline int membrane_meta_set(int drm_fd, buffer_handle_t handle, uint32_t stride) {
+    const native_handle_t* nh = (const native_handle_t*)handle;
+    struct membrane_meta_op op = {};
+
+    if (!nh || nh->numFds < 1 || nh->numFds > MEMBRANE_MAX_FDS || nh->numInts > MEMBRANE_MAX_INTS)
+        return -EINVAL;
+
+    op.fd = nh->data[0];
+    op.op = MEMBRANE_META_SET;
+    op.meta.version = MEMBRANE_META_VERSION;
+    op.meta.num_ints = nh->numInts;
+    op.meta.num_fds = nh->numFds;
+    op.meta.stride = stride;
+    memcpy(op.meta.ints, &nh->data[nh->numFds], nh->numInts * sizeof(int));
+
+    return ioctl(drm_fd, DRM_IOCTL_MEMBRANE_META, &op) < 0 ? -errno : 0;
+}
+
+static inline void membrane_meta_clear(int drm_fd, buffer_handle_t handle) {
+    const native_handle_t* nh = (const native_handle_t*)handle;
+    struct membrane_meta_op op = {};
+
+    if (!nh || nh->numFds < 1)
+        return;
+
+    op.fd = nh->data[0];
+    op.op = MEMBRANE_META_CLEAR;
+    ioctl(drm_fd, DRM_IOCTL_MEMBRANE_META, &op);
+}
+
+/* id, if not NULL, receives the registration id that tells apart buffers reusing a dmabuf inode */
+static inline int membrane_meta_get(int drm_fd, int fd, struct membrane_meta* meta, uint64_t* id) {
+    struct membrane_meta_op op = {};
+
+    op.fd = fd;
+    op.op = MEMBRANE_META_GET;
+    if (ioctl(drm_fd, DRM_IOCTL_MEMBRANE_META, &op) < 0)
+        return -errno;
+
+    if (op.meta.version != MEMBRANE_META_VERSION || op.meta.num_ints > MEMBRANE_MAX_INTS)
+        return -EPROTO;
+
+    *meta = op.meta;
+    if (id)
+        *id = op.id;
+    return 0;
+}
+
+/* fds are borrowed, not owned by the returned handle */
+static inline native_handle_t* membrane_meta_wrap(
+    const struct membrane_meta* meta, const int* fds, int num_fds) {
+    native_handle_t* nh = native_handle_create(num_fds, meta->num_ints);
+    if (!nh)
+        return NULL;
+
+    for (int i = 0; i < num_fds; i++)
+        nh->data[i] = fds[i];
+
+    memcpy(&nh->data[num_fds], meta->ints, meta->num_ints * sizeof(int));
+
+    return nh;
+}
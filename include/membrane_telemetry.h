@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MEMBRANE_TELEMETRY_SHM "/membrane-telemetry"
+#define MEMBRANE_TELEMETRY_MAGIC 0x4d424e54
+#define MEMBRANE_TELEMETRY_VERSION 3
+#define MEMBRANE_TELEMETRY_RECORDS 1024
+
+#define MEMBRANE_FRAME_CACHE_HIT (1 << 0)
+#define MEMBRANE_FRAME_CLIENT_COMPOSED (1 << 1)
+
+/* all times are CLOCK_MONOTONIC nanoseconds, 0 when unknown, t_signal is when the kernel
+ * raised the event and t_event when the present thread woke up for it, t_paced is when the
+ * vsync pacing sleep after the import ended */
+struct membrane_frame_record {
+    _Atomic uint32_t seq;
+    uint32_t fb_id;
+    uint32_t flags;
+    uint32_t display;
+    int64_t t_signal;
+    int64_t t_event;
+    int64_t t_import;
+    int64_t t_paced;
+    int64_t t_validate;
+    int64_t t_present;
+    int64_t t_fence;
+    int64_t slack;
+};
+
+struct membrane_telemetry {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t record_size;
+    _Atomic uint64_t head;
+    struct membrane_frame_record records[];
+};
+
+/* MEMBRANE_TELEMETRY_SHM in the environment overrides the segment name */
+static inline const char* membrane_telemetry_name(void) {
+    const char* name = getenv("MEMBRANE_TELEMETRY_SHM");
+    return name && *name ? name : MEMBRANE_TELEMETRY_SHM;
+}
+
+#define MEMBRANE_TELEMETRY_SIZE                                                                    \
+    (sizeof(struct membrane_telemetry)                                                             \
+        + MEMBRANE_TELEMETRY_RECORDS * sizeof(struct membrane_frame_record))
+
+/* copies a record out of the ring, returns 0 if the writer raced us */
+static inline int membrane_telemetry_read(
+    struct membrane_telemetry* t, uint64_t frame, struct membrane_frame_record* out) {
+    struct membrane_frame_record* rec = &t->records[frame % t->capacity];
+    uint32_t seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+
+    if (seq & 1)
+        return 0;
+
+    *out = *rec;
+    atomic_thread_fence(memory_order_acquire);
+
+    return atomic_load_explicit(&rec->seq, memory_order_relaxed) == seq;
+}
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+static inline int64_t membrane_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void membrane_sleep_until_ns(int64_t t) {
+    struct timespec ts = {
+        .tv_sec = t / 1000000000LL,
+        .tv_nsec = t % 1000000000LL,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+}
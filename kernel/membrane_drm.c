@@ -4,59 +4,86 @@
 #include "membrane_drv.h"
 
 static void membrane_vblank_event_commit(
-    struct membrane_device* mdev, struct drm_pending_vblank_event* event) {
+    struct membrane_pipe* pipe, struct drm_pending_vblank_event* event) {
     struct drm_pending_vblank_event* old;
     unsigned long flags;
 
-    spin_lock_irqsave(&mdev->vblank_lock, flags);
-    old = mdev->pending_vblank_event;
-    mdev->pending_vblank_event = event;
-    spin_unlock_irqrestore(&mdev->vblank_lock, flags);
+    spin_lock_irqsave(&pipe->vblank_lock, flags);
+    old = pipe->pending_vblank_event;
+    pipe->pending_vblank_event = event;
+    spin_unlock_irqrestore(&pipe->vblank_lock, flags);
 
     if (old) {
-        spin_lock_irqsave(&mdev->crtc.dev->event_lock, flags);
-        drm_crtc_send_vblank_event(&mdev->crtc, old);
-        spin_unlock_irqrestore(&mdev->crtc.dev->event_lock, flags);
+        spin_lock_irqsave(&pipe->crtc.dev->event_lock, flags);
+        drm_crtc_send_vblank_event(&pipe->crtc, old);
+        spin_unlock_irqrestore(&pipe->crtc.dev->event_lock, flags);
     }
 }
 
-void membrane_send_event(struct membrane_device* mdev, u32 flags, u32 value) {
-    if (atomic_read(&mdev->stopping))
+/*
+ * an event the consumer has not read yet is merged rather than replaced, a vblank must not swallow
+ * a power change. value is the DPMS state whenever DPMS_UPDATED is set, and the flags are cleared
+ * once read.
+ */
+void membrane_send_event(struct membrane_pipe* pipe, u32 flags, u32 value) {
+    unsigned long irqflags;
+
+    if (flags & MEMBRANE_DPMS_UPDATED)
+        atomic_set(&pipe->dpms_state, value);
+
+    if (atomic_read(&pipe->stopping))
         return;
 
+    spin_lock_irqsave(&pipe->event_lock, irqflags);
+
+    flags |= pipe->pending_event.flags;
     if (flags & MEMBRANE_DPMS_UPDATED)
-        atomic_set(&mdev->dpms_state, value);
+        value = atomic_read(&pipe->dpms_state);
 
-    mdev->pending_event.flags = flags;
-    mdev->pending_event.value = value;
-    complete(&mdev->event_done);
+    pipe->pending_event.flags = flags;
+    pipe->pending_event.value = value;
+    pipe->pending_event.display = pipe->index;
+    pipe->pending_event.timestamp = ktime_get_ns();
+    complete(&pipe->event_done);
+
+    spin_unlock_irqrestore(&pipe->event_lock, irqflags);
 }
 
 int membrane_signal(struct drm_device* dev, void* data, struct drm_file* file_priv) {
     struct membrane_device* mdev = container_of(dev, struct membrane_device, dev);
     struct membrane_event* arg = data;
+    struct membrane_pipe* pipe = membrane_pipe_get(mdev, arg->display);
+
+    if (!pipe)
+        return -EINVAL;
 
-    if (wait_for_completion_interruptible(&mdev->event_done))
+    if (wait_for_completion_interruptible(&pipe->event_done))
         return -ERESTARTSYS;
 
-    *arg = mdev->pending_event;
-    reinit_completion(&mdev->event_done);
+    spin_lock_irq(&pipe->event_lock);
+    *arg = pipe->pending_event;
+    pipe->pending_event.flags = 0;
+    reinit_completion(&pipe->event_done);
+    spin_unlock_irq(&pipe->event_lock);
+
+    if (pipe->index && !READ_ONCE(pipe->connected))
+        arg->flags |= MEMBRANE_DISPLAY_REMOVED;
 
     return 0;
 }
 
 enum hrtimer_restart membrane_vblank_timer_fn(struct hrtimer* timer) {
-    struct membrane_device* mdev = container_of(timer, struct membrane_device, vblank_timer);
+    struct membrane_pipe* pipe = container_of(timer, struct membrane_pipe, vblank_timer);
     struct drm_framebuffer *fb, *old;
     int r;
 
-    fb = xchg(&mdev->pending_state, NULL);
+    fb = xchg(&pipe->pending_state, NULL);
     if (fb) {
         struct membrane_framebuffer* mfb = to_membrane_fb(fb);
         unsigned int count = 0;
         unsigned int i;
 
-        old = xchg(&mdev->active_state, fb);
+        old = xchg(&pipe->active_state, fb);
         if (old)
             drm_framebuffer_put(old);
 
@@ -64,38 +91,108 @@ enum hrtimer_restart membrane_vblank_timer_fn(struct hrtimer* timer) {
             if (mfb->objs[i])
                 count++;
 
-        membrane_send_event(mdev, MEMBRANE_PRESENT_UPDATED, count);
+        membrane_send_event(pipe, MEMBRANE_PRESENT_UPDATED, count);
     }
 
-    drm_crtc_handle_vblank(&mdev->crtc);
+    drm_crtc_handle_vblank(&pipe->crtc);
 
-    membrane_vblank_event_commit(mdev, NULL);
+    membrane_vblank_event_commit(pipe, NULL);
 
-    r = READ_ONCE(mdev->r);
-    if (r <= 0)
-        r = 60;
+    r = membrane_pipe_refresh(pipe);
 
     hrtimer_forward_now(timer, ns_to_ktime(NSEC_PER_SEC / r));
     return HRTIMER_RESTART;
 }
 
+/* brings a restarted consumer up to date: the DPMS state, or the frame that is on screen */
+static void membrane_handoff(struct membrane_pipe* pipe) {
+    struct drm_framebuffer* fb;
+    struct membrane_framebuffer* mfb;
+    unsigned int count = 0;
+    unsigned int i;
+    u32 dpms = atomic_read(&pipe->dpms_state);
+
+    if (dpms == MEMBRANE_DPMS_OFF || dpms == MEMBRANE_DPMS_NO_COMP) {
+        membrane_send_event(pipe, MEMBRANE_DPMS_UPDATED, dpms);
+        return;
+    }
+
+    fb = xchg(&pipe->last_state, NULL);
+    if (fb) {
+        mfb = to_membrane_fb(fb);
+        for (i = 0; i < MEMBRANE_MAX_FDS; i++)
+            if (mfb->objs[i])
+                count++;
+
+        /* a frame latched while nobody was listening is newer, keep that one */
+        if (cmpxchg(&pipe->active_state, NULL, fb))
+            drm_framebuffer_put(fb);
+    } else if (!READ_ONCE(pipe->active_state)) {
+        if (dpms != MEMBRANE_DPMS_ON)
+            membrane_send_event(pipe, MEMBRANE_DPMS_UPDATED, dpms);
+        return;
+    }
+
+    /* the present path ignores value, so a doze state can ride along */
+    if (dpms != MEMBRANE_DPMS_ON)
+        membrane_send_event(pipe, MEMBRANE_PRESENT_UPDATED | MEMBRANE_DPMS_UPDATED, dpms);
+    else
+        membrane_send_event(pipe, MEMBRANE_PRESENT_UPDATED, count);
+}
+
 int membrane_config(struct drm_device* dev, void* data, struct drm_file* file_priv) {
     struct membrane_device* mdev = container_of(dev, struct membrane_device, dev);
     struct membrane_u2k_cfg* cfg = data;
+    struct membrane_pipe* pipe = membrane_pipe_get(mdev, cfg->display);
+    bool changed = false;
+
+    if (!pipe)
+        return -EINVAL;
+
+    /* a zero sized mode unplugs an external display and wakes its consumer */
+    if (!cfg->w || !cfg->h) {
+        if (!pipe->index)
+            return -EINVAL;
+
+        if (READ_ONCE(pipe->connected)) {
+            WRITE_ONCE(pipe->connected, false);
+            membrane_send_event(pipe, MEMBRANE_DISPLAY_REMOVED, 0);
+            drm_kms_helper_hotplug_event(&mdev->dev);
+        }
 
-    if (!READ_ONCE(mdev->event_consumer)) {
-        WRITE_ONCE(mdev->event_consumer, file_priv);
-        atomic_set(&mdev->stopping, 0);
+        return 0;
     }
 
-    if (READ_ONCE(mdev->w) != cfg->w || READ_ONCE(mdev->h) != cfg->h
-        || READ_ONCE(mdev->r) != cfg->r) {
-        WRITE_ONCE(mdev->w, cfg->w);
-        WRITE_ONCE(mdev->h, cfg->h);
-        WRITE_ONCE(mdev->r, cfg->r);
-        drm_kms_helper_hotplug_event(&mdev->dev);
+    if (!READ_ONCE(pipe->event_consumer)) {
+        spin_lock_irq(&pipe->event_lock);
+        pipe->pending_event.flags = 0;
+        reinit_completion(&pipe->event_done);
+        spin_unlock_irq(&pipe->event_lock);
+        WRITE_ONCE(pipe->event_consumer, file_priv);
+        atomic_set(&pipe->stopping, 0);
+
+        if (xchg(&pipe->handoff, false))
+            membrane_handoff(pipe);
+    }
+
+    WRITE_ONCE(pipe->doze_r, cfg->doze_r);
+
+    if (READ_ONCE(pipe->w) != cfg->w || READ_ONCE(pipe->h) != cfg->h
+        || READ_ONCE(pipe->r) != cfg->r) {
+        WRITE_ONCE(pipe->w, cfg->w);
+        WRITE_ONCE(pipe->h, cfg->h);
+        WRITE_ONCE(pipe->r, cfg->r);
+        changed = true;
     }
 
+    if (!READ_ONCE(pipe->connected)) {
+        WRITE_ONCE(pipe->connected, true);
+        changed = true;
+    }
+
+    if (changed)
+        drm_kms_helper_hotplug_event(&mdev->dev);
+
     return 0;
 }
 
@@ -169,15 +266,12 @@ void membrane_crtc_enable(struct drm_crtc* crtc, struct drm_crtc_state* state) {
 #else
 void membrane_crtc_enable(struct drm_crtc* crtc, struct drm_atomic_state* state) {
 #endif
-    struct membrane_device* mdev = container_of(crtc->dev, struct membrane_device, dev);
-    int r = READ_ONCE(mdev->r);
+    struct membrane_pipe* pipe = crtc_to_pipe(crtc);
+    int r = membrane_pipe_refresh(pipe);
 
-    if (r <= 0)
-        r = 60;
+    hrtimer_start(&pipe->vblank_timer, ns_to_ktime(NSEC_PER_SEC / r), HRTIMER_MODE_REL);
 
-    hrtimer_start(&mdev->vblank_timer, ns_to_ktime(NSEC_PER_SEC / r), HRTIMER_MODE_REL);
-
-    membrane_send_event(mdev, MEMBRANE_DPMS_UPDATED, MEMBRANE_DPMS_ON);
+    membrane_send_event(pipe, MEMBRANE_DPMS_UPDATED, membrane_pipe_dpms(pipe));
 }
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 11, 0)
@@ -185,24 +279,27 @@ void membrane_crtc_disable(struct drm_crtc* crtc, struct drm_crtc_state* old_sta
 #else
 void membrane_crtc_disable(struct drm_crtc* crtc, struct drm_atomic_state* state) {
 #endif
-    struct membrane_device* mdev = container_of(crtc->dev, struct membrane_device, dev);
+    struct membrane_pipe* pipe = crtc_to_pipe(crtc);
     struct drm_framebuffer* old;
 
-    old = xchg(&mdev->active_state, NULL);
+    old = xchg(&pipe->active_state, NULL);
+    if (old)
+        drm_framebuffer_put(old);
+    old = xchg(&pipe->pending_state, NULL);
     if (old)
         drm_framebuffer_put(old);
-    old = xchg(&mdev->pending_state, NULL);
+    old = xchg(&pipe->last_state, NULL);
     if (old)
         drm_framebuffer_put(old);
 
-    hrtimer_cancel(&mdev->vblank_timer);
+    hrtimer_cancel(&pipe->vblank_timer);
 
-    membrane_vblank_event_commit(mdev, NULL);
+    membrane_vblank_event_commit(pipe, NULL);
 
     if (crtc->dev->master) {
-        membrane_send_event(mdev, MEMBRANE_DPMS_UPDATED, MEMBRANE_DPMS_OFF);
+        membrane_send_event(pipe, MEMBRANE_DPMS_UPDATED, MEMBRANE_DPMS_OFF);
     } else {
-        membrane_send_event(mdev, MEMBRANE_DPMS_UPDATED, MEMBRANE_DPMS_NO_COMP);
+        membrane_send_event(pipe, MEMBRANE_DPMS_UPDATED, MEMBRANE_DPMS_NO_COMP);
     }
 }
 
@@ -214,14 +311,14 @@ void membrane_plane_atomic_update(struct drm_plane* plane, struct drm_atomic_sta
     struct drm_plane_state* new_state = drm_atomic_get_new_plane_state(state, plane);
 #endif
     struct drm_framebuffer* fb = new_state->fb;
-    struct membrane_device* mdev = container_of(plane->dev, struct membrane_device, dev);
+    struct membrane_pipe* pipe = plane_to_pipe(plane);
     struct drm_framebuffer* old;
 
     if (!fb)
         return;
 
     drm_framebuffer_get(fb);
-    old = xchg(&mdev->pending_state, fb);
+    old = xchg(&pipe->pending_state, fb);
     if (old)
         drm_framebuffer_put(old);
 }
@@ -238,27 +335,37 @@ void membrane_crtc_atomic_flush(struct drm_crtc* crtc, struct drm_crtc_state* ol
 #else
 void membrane_crtc_atomic_flush(struct drm_crtc* crtc, struct drm_atomic_state* state) {
 #endif
-    struct membrane_device* mdev = container_of(crtc->dev, struct membrane_device, dev);
+    struct membrane_pipe* pipe = crtc_to_pipe(crtc);
     struct drm_pending_vblank_event* event = crtc->state->event;
 
     if (event) {
         crtc->state->event = NULL;
-        membrane_vblank_event_commit(mdev, event);
+        membrane_vblank_event_commit(pipe, event);
     }
 }
 
 int membrane_get_present_fd(struct drm_device* dev, void* data, struct drm_file* file) {
     struct membrane_device* mdev = container_of(dev, struct membrane_device, dev);
     struct membrane_get_present_fd* args = data;
+    struct membrane_pipe* pipe = membrane_pipe_get(mdev, args->display);
     struct drm_framebuffer* fb;
     struct membrane_framebuffer* mfb;
     unsigned int i;
     int count = 0;
 
-    fb = xchg(&mdev->active_state, NULL);
+    if (!pipe)
+        return -EINVAL;
+
+    /* frames and their scanout dmabufs only go to the daemon that configured the pipe */
+    if (READ_ONCE(pipe->event_consumer) != file)
+        return -EACCES;
+
+    fb = xchg(&pipe->active_state, NULL);
     if (!fb) {
         args->buffer_id = 0;
         args->num_fds = 0;
+        args->meta.version = 0;
+        args->meta.num_ints = 0;
         for (i = 0; i < MEMBRANE_MAX_FDS; i++)
             args->fds[i] = -1;
         return 0;
@@ -266,34 +373,58 @@ int membrane_get_present_fd(struct drm_device* dev, void* data, struct drm_file*
 
     mfb = to_membrane_fb(fb);
     args->buffer_id = fb->base.id;
+    args->meta.version = 0;
+    args->meta.num_ints = 0;
+
+    if (mfb->objs[0]) {
+        struct membrane_gem_object* mobj = to_membrane_gem(mfb->objs[0]);
+
+        if (!mobj->meta.version)
+            membrane_meta_lookup(mdev, mobj->dmabuf_file, &mobj->meta);
+
+        if (mobj->meta.version)
+            args->meta = mobj->meta;
+    }
+
+    for (i = 0; i < MEMBRANE_MAX_FDS; i++)
+        args->fds[i] = -1;
 
+    /* one fd per dmabuf, planes that share one are the same fd of the gralloc handle */
     for (i = 0; i < MEMBRANE_MAX_FDS; i++) {
         struct drm_gem_object* obj = mfb->objs[i];
         struct membrane_gem_object* mobj;
+        bool shared = false;
+        unsigned int j;
         int fd;
 
-        if (!obj) {
-            args->fds[i] = -1;
+        if (!obj)
             continue;
-        }
 
         mobj = to_membrane_gem(obj);
+        for (j = 0; j < i; j++) {
+            if (mfb->objs[j] && to_membrane_gem(mfb->objs[j])->dmabuf_file == mobj->dmabuf_file)
+                shared = true;
+        }
+        if (shared)
+            continue;
+
         get_file(mobj->dmabuf_file);
 
         fd = get_unused_fd_flags(O_CLOEXEC);
         if (fd < 0) {
             fput(mobj->dmabuf_file);
-            args->fds[i] = -1;
             continue;
         }
 
         fd_install(fd, mobj->dmabuf_file);
-        args->fds[i] = fd;
-        count++;
+        args->fds[count++] = fd;
     }
 
     args->num_fds = count;
 
-    drm_framebuffer_put(fb);
+    /* keep what the consumer is showing so a restarted daemon can pick it up */
+    fb = xchg(&pipe->last_state, fb);
+    if (fb)
+        drm_framebuffer_put(fb);
     return 0;
 }
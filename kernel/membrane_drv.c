@@ -49,11 +49,36 @@ static const struct drm_encoder_funcs membrane_encoder_funcs = {
     .destroy = drm_encoder_cleanup,
 };
 
+/* tells the daemon about LOW_POWER changes on a crtc that stays lit */
+static void membrane_connector_commit_power(
+    struct drm_connector* connector, struct drm_connector_state* new_state) {
+    struct membrane_pipe* pipe = connector_to_pipe(connector);
+    u32 low_power = to_membrane_connector_state(new_state)->low_power;
+
+    if (atomic_xchg(&pipe->low_power, low_power) == low_power)
+        return;
+
+    if (new_state->crtc && new_state->crtc->state->active)
+        membrane_send_event(pipe, MEMBRANE_DPMS_UPDATED, membrane_pipe_dpms(pipe));
+}
+
 void membrane_atomic_commit_tail(struct drm_atomic_state* state) {
     struct drm_device* dev = state->dev;
+    struct drm_connector* connector;
+    struct drm_connector_state* conn_state;
+    int i;
 
     drm_atomic_helper_commit_modeset_disables(dev, state);
     drm_atomic_helper_commit_planes(dev, state, 0);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 12, 0)
+    for_each_connector_in_state(state, connector, conn_state, i)
+        membrane_connector_commit_power(connector, connector->state);
+#else
+    for_each_new_connector_in_state(state, connector, conn_state, i)
+        membrane_connector_commit_power(connector, conn_state);
+#endif
+
     drm_atomic_helper_commit_modeset_enables(dev, state);
     drm_atomic_helper_commit_hw_done(state);
 
@@ -66,9 +91,9 @@ static struct drm_mode_config_helper_funcs membrane_mode_config_helper_funcs = {
 
 static int membrane_connector_get_modes(struct drm_connector* connector) {
     struct drm_display_mode* mode;
-    struct membrane_device* mdev = container_of(connector->dev, struct membrane_device, dev);
+    struct membrane_pipe* pipe = connector_to_pipe(connector);
 
-    mode = drm_cvt_mode(connector->dev, mdev->w, mdev->h, mdev->r, false, false, false);
+    mode = drm_cvt_mode(connector->dev, pipe->w, pipe->h, pipe->r, false, false, false);
     if (!mode) {
         membrane_err("drm_cvt_mode failed");
         return 0;
@@ -93,16 +118,86 @@ static const struct drm_connector_helper_funcs membrane_connector_helper_funcs =
 
 static enum drm_connector_status membrane_connector_detect(
     struct drm_connector* connector, bool force) {
-    return connector_status_connected;
+    struct membrane_pipe* pipe = connector_to_pipe(connector);
+
+    /* external pipes only show up once the daemon has configured them */
+    if (pipe->index == 0 || READ_ONCE(pipe->connected))
+        return connector_status_connected;
+
+    return connector_status_disconnected;
+}
+
+static void membrane_connector_destroy_state(
+    struct drm_connector* connector, struct drm_connector_state* state) {
+    __drm_atomic_helper_connector_destroy_state(state);
+    kfree(to_membrane_connector_state(state));
+}
+
+static void membrane_connector_reset(struct drm_connector* connector) {
+    struct membrane_connector_state* state = kzalloc(sizeof(*state), GFP_KERNEL);
+
+    if (connector->state)
+        membrane_connector_destroy_state(connector, connector->state);
+
+    connector->state = NULL;
+    if (state) {
+        state->base.connector = connector;
+        connector->state = &state->base;
+    }
+}
+
+static struct drm_connector_state* membrane_connector_duplicate_state(
+    struct drm_connector* connector) {
+    struct membrane_connector_state* state;
+
+    if (WARN_ON(!connector->state))
+        return NULL;
+
+    state = kmemdup(to_membrane_connector_state(connector->state), sizeof(*state), GFP_KERNEL);
+    if (!state)
+        return NULL;
+
+    __drm_atomic_helper_connector_duplicate_state(connector, &state->base);
+    return &state->base;
+}
+
+static int membrane_connector_atomic_set_property(struct drm_connector* connector,
+    struct drm_connector_state* state, struct drm_property* property, uint64_t val) {
+    struct membrane_device* mdev = connector_to_pipe(connector)->mdev;
+
+    if (property != mdev->low_power_prop)
+        return -EINVAL;
+
+    to_membrane_connector_state(state)->low_power = val;
+    return 0;
+}
+
+static int membrane_connector_atomic_get_property(struct drm_connector* connector,
+    const struct drm_connector_state* state, struct drm_property* property, uint64_t* val) {
+    struct membrane_device* mdev = connector_to_pipe(connector)->mdev;
+
+    if (property != mdev->low_power_prop)
+        return -EINVAL;
+
+    *val = container_of(state, struct membrane_connector_state, base)->low_power;
+    return 0;
 }
 
 static const struct drm_connector_funcs membrane_connector_funcs = {
     .detect = membrane_connector_detect,
     .fill_modes = drm_helper_probe_single_connector_modes,
     .destroy = drm_connector_cleanup,
-    .reset = drm_atomic_helper_connector_reset,
-    .atomic_duplicate_state = drm_atomic_helper_connector_duplicate_state,
-    .atomic_destroy_state = drm_atomic_helper_connector_destroy_state,
+    .reset = membrane_connector_reset,
+    .atomic_duplicate_state = membrane_connector_duplicate_state,
+    .atomic_destroy_state = membrane_connector_destroy_state,
+    .atomic_set_property = membrane_connector_atomic_set_property,
+    .atomic_get_property = membrane_connector_atomic_get_property,
+};
+
+static const struct drm_prop_enum_list membrane_low_power_names[] = {
+    { MEMBRANE_LOW_POWER_OFF, "Off" },
+    { MEMBRANE_LOW_POWER_DOZE, "Doze" },
+    { MEMBRANE_LOW_POWER_DOZE_SUSPEND, "Doze-Suspend" },
 };
 
 static const uint32_t membrane_formats[] = {
@@ -110,39 +205,27 @@ static const uint32_t membrane_formats[] = {
     DRM_FORMAT_XRGB8888,
 };
 
-static int membrane_load(struct membrane_device* mdev) {
+static int membrane_pipe_init(struct membrane_device* mdev, unsigned int index) {
     struct drm_device* dev = &mdev->dev;
+    struct membrane_pipe* pipe = &mdev->pipes[index];
+    bool internal = index == 0;
     int ret;
 
-    mdev->w = 1920;
-    mdev->h = 1080;
-    mdev->r = 60;
-
-    init_completion(&mdev->event_done);
-    spin_lock_init(&mdev->vblank_lock);
+    pipe->mdev = mdev;
+    pipe->index = index;
+    pipe->w = 1920;
+    pipe->h = 1080;
+    pipe->r = 60;
 
-    hrtimer_init(&mdev->vblank_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-    mdev->vblank_timer.function = membrane_vblank_timer_fn;
+    init_completion(&pipe->event_done);
+    spin_lock_init(&pipe->event_lock);
+    spin_lock_init(&pipe->vblank_lock);
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
-    drm_mode_config_init(dev);
-#else
-    ret = drm_mode_config_init(dev);
-    if (ret) {
-        membrane_err("drm_mode_config_init failed: %d", ret);
-        return ret;
-    }
-#endif
-
-    dev->mode_config.min_width = 0;
-    dev->mode_config.min_height = 0;
-    dev->mode_config.max_width = 4096;
-    dev->mode_config.max_height = 4096;
-    dev->mode_config.funcs = &membrane_mode_config_funcs;
-    dev->mode_config.helper_private = &membrane_mode_config_helper_funcs;
+    hrtimer_init(&pipe->vblank_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pipe->vblank_timer.function = membrane_vblank_timer_fn;
 
-    ret = drm_universal_plane_init(dev, &mdev->plane, 1, &membrane_plane_funcs, membrane_formats,
-        ARRAY_SIZE(membrane_formats),
+    ret = drm_universal_plane_init(dev, &pipe->plane, 1 << index, &membrane_plane_funcs,
+        membrane_formats, ARRAY_SIZE(membrane_formats),
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
         DRM_PLANE_TYPE_PRIMARY, NULL);
 #else
@@ -153,45 +236,92 @@ static int membrane_load(struct membrane_device* mdev) {
         return ret;
     }
 
-    drm_plane_helper_add(&mdev->plane, &membrane_plane_helper_funcs);
+    drm_plane_helper_add(&pipe->plane, &membrane_plane_helper_funcs);
 
-    drm_crtc_helper_add(&mdev->crtc, &membrane_crtc_helper_funcs);
+    drm_crtc_helper_add(&pipe->crtc, &membrane_crtc_helper_funcs);
     ret = drm_crtc_init_with_planes(
-        dev, &mdev->crtc, &mdev->plane, NULL, &membrane_crtc_funcs, NULL);
+        dev, &pipe->crtc, &pipe->plane, NULL, &membrane_crtc_funcs, NULL);
     if (ret) {
         membrane_err("drm_crtc_init_with_planes failed: %d", ret);
         return ret;
     }
 
-    ret = drm_encoder_init(
-        dev, &mdev->encoder, &membrane_encoder_funcs, DRM_MODE_ENCODER_DSI, NULL);
+    ret = drm_encoder_init(dev, &pipe->encoder, &membrane_encoder_funcs,
+        internal ? DRM_MODE_ENCODER_DSI : DRM_MODE_ENCODER_TMDS, NULL);
     if (ret) {
         membrane_err("drm_encoder_init failed: %d", ret);
         return ret;
     }
 
-    mdev->encoder.possible_crtcs = 1 << drm_crtc_index(&mdev->crtc);
+    pipe->encoder.possible_crtcs = 1 << drm_crtc_index(&pipe->crtc);
 
-    ret = drm_connector_init(
-        dev, &mdev->connector, &membrane_connector_funcs, DRM_MODE_CONNECTOR_DSI);
+    ret = drm_connector_init(dev, &pipe->connector, &membrane_connector_funcs,
+        internal ? DRM_MODE_CONNECTOR_DSI : DRM_MODE_CONNECTOR_HDMIA);
     if (ret) {
         membrane_err("drm_connector_init failed: %d", ret);
         return ret;
     }
 
-    drm_connector_helper_add(&mdev->connector, &membrane_connector_helper_funcs);
+    drm_connector_helper_add(&pipe->connector, &membrane_connector_helper_funcs);
+
+    if (!internal)
+        pipe->connector.polled = DRM_CONNECTOR_POLL_HPD;
+
+    drm_object_attach_property(
+        &pipe->connector.base, mdev->low_power_prop, MEMBRANE_LOW_POWER_OFF);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 19, 0)
-    ret = drm_mode_connector_attach_encoder(&mdev->connector, &mdev->encoder);
+    ret = drm_mode_connector_attach_encoder(&pipe->connector, &pipe->encoder);
 #else
-    ret = drm_connector_attach_encoder(&mdev->connector, &mdev->encoder);
+    ret = drm_connector_attach_encoder(&pipe->connector, &pipe->encoder);
 #endif
     if (ret) {
         membrane_err("drm_mode_connector_attach_encoder failed: %d", ret);
         return ret;
     }
 
-    ret = drm_vblank_init(dev, 1);
+    return 0;
+}
+
+static int membrane_load(struct membrane_device* mdev) {
+    struct drm_device* dev = &mdev->dev;
+    unsigned int i;
+    int ret;
+
+    mutex_init(&mdev->meta_lock);
+    INIT_LIST_HEAD(&mdev->meta_list);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+    drm_mode_config_init(dev);
+#else
+    ret = drm_mode_config_init(dev);
+    if (ret) {
+        membrane_err("drm_mode_config_init failed: %d", ret);
+        return ret;
+    }
+#endif
+
+    dev->mode_config.min_width = 0;
+    dev->mode_config.min_height = 0;
+    dev->mode_config.max_width = 4096;
+    dev->mode_config.max_height = 4096;
+    dev->mode_config.funcs = &membrane_mode_config_funcs;
+    dev->mode_config.helper_private = &membrane_mode_config_helper_funcs;
+
+    mdev->low_power_prop = drm_property_create_enum(dev, 0, MEMBRANE_LOW_POWER_PROP,
+        membrane_low_power_names, ARRAY_SIZE(membrane_low_power_names));
+    if (!mdev->low_power_prop) {
+        membrane_err("drm_property_create_enum failed");
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        ret = membrane_pipe_init(mdev, i);
+        if (ret)
+            return ret;
+    }
+
+    ret = drm_vblank_init(dev, MEMBRANE_MAX_DISPLAYS);
     if (ret) {
         membrane_err("drm_vblank_init failed: %d", ret);
         return ret;
@@ -202,25 +332,58 @@ static int membrane_load(struct membrane_device* mdev) {
     return 0;
 }
 
+static void membrane_pipe_stop(struct membrane_pipe* pipe) {
+    struct drm_framebuffer* old;
+
+    WRITE_ONCE(pipe->event_consumer, NULL);
+    atomic_set(&pipe->stopping, 1);
+    complete_all(&pipe->event_done);
+
+    hrtimer_cancel(&pipe->vblank_timer);
+
+    old = xchg(&pipe->active_state, NULL);
+    if (old)
+        drm_framebuffer_put(old);
+    old = xchg(&pipe->pending_state, NULL);
+    if (old)
+        drm_framebuffer_put(old);
+    old = xchg(&pipe->last_state, NULL);
+    if (old)
+        drm_framebuffer_put(old);
+}
+
 static void membrane_postclose(struct drm_device* dev, struct drm_file* file) {
     struct membrane_device* mdev = container_of(dev, struct membrane_device, dev);
+    bool unplugged = false;
+    unsigned int i;
 
-    if (READ_ONCE(mdev->event_consumer) == file) {
-        struct drm_framebuffer* old;
+    membrane_meta_release(mdev, file);
 
-        WRITE_ONCE(mdev->event_consumer, NULL);
-        atomic_set(&mdev->stopping, 1);
-        complete_all(&mdev->event_done);
+    for (i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        struct membrane_pipe* pipe = &mdev->pipes[i];
 
-        hrtimer_cancel(&mdev->vblank_timer);
+        if (READ_ONCE(pipe->event_consumer) != file)
+            continue;
 
-        old = xchg(&mdev->active_state, NULL);
-        if (old)
-            drm_framebuffer_put(old);
-        old = xchg(&mdev->pending_state, NULL);
-        if (old)
-            drm_framebuffer_put(old);
+        /* the internal panel keeps scanning out until a restarted daemon takes over */
+        if (i == 0) {
+            WRITE_ONCE(pipe->event_consumer, NULL);
+            atomic_set(&pipe->stopping, 1);
+            WRITE_ONCE(pipe->handoff, true);
+            complete_all(&pipe->event_done);
+            continue;
+        }
+
+        membrane_pipe_stop(pipe);
+
+        if (READ_ONCE(pipe->connected)) {
+            WRITE_ONCE(pipe->connected, false);
+            unplugged = true;
+        }
     }
+
+    if (unplugged)
+        drm_kms_helper_hotplug_event(dev);
 }
 
 static const struct file_operations membrane_fops = {
@@ -236,9 +399,9 @@ static const struct file_operations membrane_fops = {
 
 static struct drm_driver membrane_driver = {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 4, 0)
-    .driver_features = DRIVER_MODESET | DRIVER_PRIME | DRIVER_GEM | DRIVER_ATOMIC,
+    .driver_features = DRIVER_MODESET | DRIVER_PRIME | DRIVER_GEM | DRIVER_ATOMIC | DRIVER_RENDER,
 #else
-    .driver_features = DRIVER_MODESET | DRIVER_GEM | DRIVER_ATOMIC,
+    .driver_features = DRIVER_MODESET | DRIVER_GEM | DRIVER_ATOMIC | DRIVER_RENDER,
 #endif
     .fops = &membrane_fops,
     .name = "membrane",
@@ -319,9 +482,14 @@ err_free:
 
 static int membrane_remove(struct platform_device* pdev) {
     struct drm_device* drm = platform_get_drvdata(pdev);
+    struct membrane_device* mdev = container_of(drm, struct membrane_device, dev);
+    unsigned int i;
     membrane_debug("remove");
 
     drm_dev_unregister(drm);
+
+    for (i = 0; i < MEMBRANE_MAX_DISPLAYS; i++)
+        membrane_pipe_stop(&mdev->pipes[i]);
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
     drm_dev_put(drm);
 #endif
@@ -369,6 +537,11 @@ static void __exit membrane_exit(void) {
 module_init(membrane_init);
 module_exit(membrane_exit);
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
 MODULE_LICENSE("GPL v2");
 MODULE_AUTHOR("Deepak Meena <who53@disroot.org>");
 MODULE_DESCRIPTION("Membrane DRM Driver");
@@ -6,7 +6,10 @@
 
 #include <linux/atomic.h>
 #include <linux/completion.h>
+#include <linux/dma-buf.h>
 #include <linux/file.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/version.h>
 
@@ -35,6 +38,7 @@
 struct membrane_gem_object {
     struct drm_gem_object base;
     struct file* dmabuf_file;
+    struct membrane_meta meta;
 };
 
 static inline struct membrane_gem_object* to_membrane_gem(struct drm_gem_object* obj) {
@@ -46,37 +50,120 @@ struct membrane_framebuffer {
     struct drm_gem_object* objs[MEMBRANE_MAX_FDS];
 };
 
+/* every entry pins its dmabuf, bound what one render node client can register */
+#define MEMBRANE_META_MAX_ENTRIES 4096
+
+struct membrane_meta_entry {
+    struct list_head node;
+    struct file* dmabuf_file;
+    struct drm_file* owner;
+    struct membrane_meta meta;
+    u64 id;
+};
+
 static inline struct membrane_framebuffer* to_membrane_fb(struct drm_framebuffer* fb) {
     return container_of(fb, struct membrane_framebuffer, base);
 }
 
-struct membrane_device {
-    struct drm_device dev;
+struct membrane_device;
+
+/* one plane/crtc/encoder/connector chain per display, pipe 0 is the built-in panel */
+struct membrane_pipe {
+    struct membrane_device* mdev;
+    unsigned int index;
+
     struct drm_plane plane;
     struct drm_crtc crtc;
     struct drm_encoder encoder;
     struct drm_connector connector;
 
     struct drm_file* event_consumer;
+    bool connected;
 
     struct drm_framebuffer* active_state;
     struct drm_framebuffer* pending_state;
+    struct drm_framebuffer* last_state;
+    bool handoff;
 
     struct hrtimer vblank_timer;
     struct drm_pending_vblank_event* pending_vblank_event;
     spinlock_t vblank_lock;
 
     int w, h, r;
+    int doze_r;
+    atomic_t low_power;
 
     struct completion event_done;
     struct membrane_event pending_event;
+    spinlock_t event_lock;
     atomic_t dpms_state;
     atomic_t stopping;
 };
 
+struct membrane_device {
+    struct drm_device dev;
+    struct membrane_pipe pipes[MEMBRANE_MAX_DISPLAYS];
+    struct drm_property* low_power_prop;
+
+    struct mutex meta_lock;
+    struct list_head meta_list;
+    u64 meta_seq;
+};
+
+struct membrane_connector_state {
+    struct drm_connector_state base;
+    u32 low_power;
+};
+
+static inline struct membrane_connector_state* to_membrane_connector_state(
+    struct drm_connector_state* state) {
+    return container_of(state, struct membrane_connector_state, base);
+}
+
+static inline struct membrane_pipe* membrane_pipe_get(struct membrane_device* mdev, u32 index) {
+    if (index >= MEMBRANE_MAX_DISPLAYS)
+        return NULL;
+
+    return &mdev->pipes[index];
+}
+
+static inline struct membrane_pipe* crtc_to_pipe(struct drm_crtc* crtc) {
+    return container_of(crtc, struct membrane_pipe, crtc);
+}
+
+static inline struct membrane_pipe* plane_to_pipe(struct drm_plane* plane) {
+    return container_of(plane, struct membrane_pipe, plane);
+}
+
+static inline struct membrane_pipe* connector_to_pipe(struct drm_connector* connector) {
+    return container_of(connector, struct membrane_pipe, connector);
+}
+
+/* the vblank rate and DPMS state the pipe runs at, both follow LOW_POWER */
+static inline int membrane_pipe_refresh(struct membrane_pipe* pipe) {
+    int r = READ_ONCE(pipe->r);
+    int doze_r = READ_ONCE(pipe->doze_r);
+
+    if (atomic_read(&pipe->low_power) && doze_r > 0 && (r <= 0 || doze_r < r))
+        r = doze_r;
+
+    return r > 0 ? r : 60;
+}
+
+static inline u32 membrane_pipe_dpms(struct membrane_pipe* pipe) {
+    switch (atomic_read(&pipe->low_power)) {
+    case MEMBRANE_LOW_POWER_DOZE:
+        return MEMBRANE_DPMS_DOZE;
+    case MEMBRANE_LOW_POWER_DOZE_SUSPEND:
+        return MEMBRANE_DPMS_DOZE_SUSPEND;
+    default:
+        return MEMBRANE_DPMS_ON;
+    }
+}
+
 int membrane_config(struct drm_device* dev, void* data, struct drm_file* file_priv);
 int membrane_signal(struct drm_device* dev, void* data, struct drm_file* file_priv);
-void membrane_send_event(struct membrane_device* mdev, u32 flags, u32 num_fds);
+void membrane_send_event(struct membrane_pipe* pipe, u32 flags, u32 value);
 enum hrtimer_restart membrane_vblank_timer_fn(struct hrtimer* timer);
 
 struct drm_framebuffer* membrane_fb_create(
@@ -111,14 +198,18 @@ int membrane_prime_fd_to_handle(
 int membrane_prime_handle_to_fd(struct drm_device* dev, struct drm_file* file_priv, uint32_t handle,
     uint32_t flags, int* prime_fd);
 int membrane_get_present_fd(struct drm_device* dev, void* data, struct drm_file* file);
+int membrane_meta(struct drm_device* dev, void* data, struct drm_file* file);
+bool membrane_meta_lookup(
+    struct membrane_device* mdev, struct file* dmabuf_file, struct membrane_meta* meta);
+void membrane_meta_release(struct membrane_device* mdev, struct drm_file* file);
 
 void membrane_gem_free_object(struct drm_gem_object* obj);
 
 static const struct drm_ioctl_desc membrane_ioctls[] = {
-    DRM_IOCTL_DEF_DRV(
-        MEMBRANE_GET_PRESENT_FD, membrane_get_present_fd, DRM_UNLOCKED | DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(MEMBRANE_GET_PRESENT_FD, membrane_get_present_fd, DRM_UNLOCKED),
     DRM_IOCTL_DEF_DRV(MEMBRANE_CONFIG, membrane_config, DRM_UNLOCKED),
     DRM_IOCTL_DEF_DRV(MEMBRANE_SIGNAL, membrane_signal, DRM_UNLOCKED),
+    DRM_IOCTL_DEF_DRV(MEMBRANE_META, membrane_meta, DRM_UNLOCKED | DRM_RENDER_ALLOW),
 };
 
 #define membrane_debug(fmt, ...) pr_debug("membrane: %s: " fmt "\n", __func__, ##__VA_ARGS__)
@@ -40,6 +40,8 @@ int membrane_prime_fd_to_handle(
     }
 
     obj->dmabuf_file = dmabuf_file;
+    membrane_meta_lookup(
+        container_of(dev, struct membrane_device, dev), dmabuf_file, &obj->meta);
 
     ret = drm_gem_handle_create(file_priv, &obj->base, handle);
     if (ret) {
@@ -60,3 +62,131 @@ int membrane_prime_handle_to_fd(struct drm_device* dev, struct drm_file* file_pr
     membrane_err("shouldnt get called");
     return -ENOSYS;
 }
+
+static struct membrane_meta_entry* membrane_meta_find(
+    struct membrane_device* mdev, struct file* dmabuf_file) {
+    struct membrane_meta_entry* entry;
+
+    list_for_each_entry(entry, &mdev->meta_list, node) {
+        if (entry->dmabuf_file == dmabuf_file)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static unsigned int membrane_meta_count(struct membrane_device* mdev, struct drm_file* owner) {
+    struct membrane_meta_entry* entry;
+    unsigned int count = 0;
+
+    list_for_each_entry(entry, &mdev->meta_list, node) {
+        if (entry->owner == owner)
+            count++;
+    }
+
+    return count;
+}
+
+static void membrane_meta_free(struct membrane_meta_entry* entry) {
+    list_del(&entry->node);
+    fput(entry->dmabuf_file);
+    kfree(entry);
+}
+
+bool membrane_meta_lookup(
+    struct membrane_device* mdev, struct file* dmabuf_file, struct membrane_meta* meta) {
+    struct membrane_meta_entry* entry;
+
+    mutex_lock(&mdev->meta_lock);
+    entry = membrane_meta_find(mdev, dmabuf_file);
+    if (entry)
+        *meta = entry->meta;
+    mutex_unlock(&mdev->meta_lock);
+
+    return entry != NULL;
+}
+
+void membrane_meta_release(struct membrane_device* mdev, struct drm_file* file) {
+    struct membrane_meta_entry *entry, *tmp;
+
+    mutex_lock(&mdev->meta_lock);
+    list_for_each_entry_safe(entry, tmp, &mdev->meta_list, node) {
+        if (entry->owner == file)
+            membrane_meta_free(entry);
+    }
+    mutex_unlock(&mdev->meta_lock);
+}
+
+int membrane_meta(struct drm_device* dev, void* data, struct drm_file* file_priv) {
+    struct membrane_device* mdev = container_of(dev, struct membrane_device, dev);
+    struct membrane_meta_op* arg = data;
+    struct membrane_meta_entry* entry;
+    struct dma_buf* dmabuf;
+    struct file* dmabuf_file;
+    int ret = 0;
+
+    if (arg->op == MEMBRANE_META_SET
+        && (arg->meta.version != MEMBRANE_META_VERSION
+            || arg->meta.num_ints > MEMBRANE_MAX_INTS))
+        return -EINVAL;
+
+    /* the reference dma_buf_get takes is the one on its file, fput drops it */
+    dmabuf = dma_buf_get(arg->fd);
+    if (IS_ERR(dmabuf))
+        return PTR_ERR(dmabuf);
+    dmabuf_file = dmabuf->file;
+
+    mutex_lock(&mdev->meta_lock);
+    entry = membrane_meta_find(mdev, dmabuf_file);
+
+    switch (arg->op) {
+    case MEMBRANE_META_SET:
+        if (!entry) {
+            if (membrane_meta_count(mdev, file_priv) >= MEMBRANE_META_MAX_ENTRIES) {
+                ret = -ENOSPC;
+                break;
+            }
+            entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+            if (!entry) {
+                ret = -ENOMEM;
+                break;
+            }
+            entry->dmabuf_file = dmabuf_file;
+            dmabuf_file = NULL;
+            list_add(&entry->node, &mdev->meta_list);
+            entry->owner = file_priv;
+        } else if (entry->owner != file_priv) {
+            /* only the allocator that registered a buffer may change it */
+            ret = -EBUSY;
+            break;
+        }
+        entry->meta = arg->meta;
+        entry->id = ++mdev->meta_seq;
+        arg->id = entry->id;
+        break;
+    case MEMBRANE_META_GET:
+        if (entry) {
+            arg->meta = entry->meta;
+            arg->id = entry->id;
+        } else {
+            ret = -ENOENT;
+        }
+        break;
+    case MEMBRANE_META_CLEAR:
+        if (entry && entry->owner != file_priv)
+            ret = -EBUSY;
+        else if (entry)
+            membrane_meta_free(entry);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    mutex_unlock(&mdev->meta_lock);
+
+    if (dmabuf_file)
+        fput(dmabuf_file);
+
+    return ret;
+}
@@ -12,34 +12,81 @@
 
 #define MEMBRANE_PRESENT_UPDATED (1 << 0)
 #define MEMBRANE_DPMS_UPDATED (1 << 1)
+#define MEMBRANE_DISPLAY_REMOVED (1 << 2)
 
 #define MEMBRANE_DPMS_OFF 0
 #define MEMBRANE_DPMS_ON 1
 #define MEMBRANE_DPMS_NO_COMP 2
+#define MEMBRANE_DPMS_DOZE 3
+#define MEMBRANE_DPMS_DOZE_SUSPEND 4
+
+/* enum connector property for always-on displays, off unless the compositor sets it */
+#define MEMBRANE_LOW_POWER_PROP "LOW_POWER"
+#define MEMBRANE_LOW_POWER_OFF 0
+#define MEMBRANE_LOW_POWER_DOZE 1
+#define MEMBRANE_LOW_POWER_DOZE_SUSPEND 2
+
+#define MEMBRANE_MAX_DISPLAYS 2
 
 #define MEMBRANE_MAX_FDS 4
+#define MEMBRANE_MAX_INTS 128
+
+#define MEMBRANE_META_VERSION 2
 
+#define MEMBRANE_META_SET 0
+#define MEMBRANE_META_GET 1
+#define MEMBRANE_META_CLEAR 2
+
+/* display is an input selecting the pipe to wait on, timestamp is the CLOCK_MONOTONIC
+ * time the event was raised */
 struct membrane_event {
     __u32 flags;
     __u32 value;
+    __u32 display;
+    __u32 __reserved;
+    __u64 timestamp;
 };
 
+/* doze_r is the refresh rate while LOW_POWER is set, 0 keeps r */
 struct membrane_u2k_cfg {
     int32_t w;
     int32_t h;
     int32_t r;
+    int32_t display;
+    int32_t doze_r;
     int32_t __reserved;
 };
 
+/* num_fds and stride, in pixels, are those of the gralloc handle the ints come from */
+struct membrane_meta {
+    __u32 version;
+    __u32 num_ints;
+    __u32 num_fds;
+    __u32 stride;
+    __s32 ints[MEMBRANE_MAX_INTS];
+};
+
+/* id names one registration of a buffer, SET and GET return it and it is never reused */
+struct membrane_meta_op {
+    __s32 fd;
+    __u32 op;
+    struct membrane_meta meta;
+    __u64 id;
+};
+
 struct membrane_get_present_fd {
     __u32 buffer_id;
     __u32 num_fds;
     __s32 fds[MEMBRANE_MAX_FDS];
+    struct membrane_meta meta;
+    __u32 display;
+    __u32 __reserved;
 };
 
 #define DRM_MEMBRANE_GET_PRESENT_FD 0x23
 #define DRM_MEMBRANE_CONFIG 0x24
 #define DRM_MEMBRANE_SIGNAL 0x25
+#define DRM_MEMBRANE_META 0x26
 
 #define DRM_IOCTL_MEMBRANE_GET_PRESENT_FD                                                          \
     DRM_IOWR(DRM_COMMAND_BASE + DRM_MEMBRANE_GET_PRESENT_FD, struct membrane_get_present_fd)
@@ -50,4 +97,7 @@ struct membrane_get_present_fd {
 #define DRM_IOCTL_MEMBRANE_SIGNAL                                                                  \
     DRM_IOWR(DRM_COMMAND_BASE + DRM_MEMBRANE_SIGNAL, struct membrane_event)
 
+#define DRM_IOCTL_MEMBRANE_META                                                                    \
+    DRM_IOWR(DRM_COMMAND_BASE + DRM_MEMBRANE_META, struct membrane_meta_op)
+
 #endif
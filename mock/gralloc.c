@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <hardware/gralloc.h>
+
+#include "mock.h"
+
+#include <log.h>
+
+#define MOCK_STRIDE_ALIGN 64
+
+static int64_t g_alloc_us = -1;
+static int64_t g_import_us = -1;
+static int64_t g_lock_us = -1;
+
+/* like a real gralloc a handle is mapped on first lock and stays mapped until release */
+struct mock_mapping {
+    buffer_handle_t handle;
+    void* addr;
+    size_t size;
+    int locks;
+    struct mock_mapping* next;
+};
+
+static struct mock_mapping* g_mappings;
+static pthread_mutex_t g_mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void load_env(void) {
+    if (g_alloc_us >= 0)
+        return;
+
+    g_alloc_us = mock_env("MEMBRANE_MOCK_ALLOC_US", 0);
+    g_import_us = mock_env("MEMBRANE_MOCK_IMPORT_US", 0);
+    g_lock_us = mock_env("MEMBRANE_MOCK_LOCK_US", 0);
+}
+
+static int format_bpp(int format) {
+    switch (format) {
+    case HAL_PIXEL_FORMAT_RGB_888:
+        return 3;
+    case HAL_PIXEL_FORMAT_RGB_565:
+        return 2;
+    case HAL_PIXEL_FORMAT_RGBA_FP16:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+static bool is_mock_handle(buffer_handle_t handle) {
+    return handle && handle->numFds >= 1 && handle->numInts >= MOCK_NUM_INTS
+        && handle->data[handle->numFds + MOCK_INT_MAGIC] == MOCK_GRALLOC_MAGIC;
+}
+
+void hybris_gralloc_initialize(int framebuffer) {
+    mock_delay(mock_env("MEMBRANE_MOCK_INIT_US", 0));
+}
+
+int hybris_gralloc_allocate(
+    int width, int height, int format, int usage, buffer_handle_t* handle, uint32_t* stride) {
+    if (width <= 0 || height <= 0 || !handle || !stride)
+        return -EINVAL;
+
+    load_env();
+    mock_delay(g_alloc_us);
+
+    uint32_t s = (width + MOCK_STRIDE_ALIGN - 1) & ~(MOCK_STRIDE_ALIGN - 1);
+    size_t size = (size_t)s * height * format_bpp(format);
+
+    int fd = memfd_create("membrane-mock-buffer", MFD_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (ftruncate(fd, size) < 0) {
+        int ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    native_handle_t* nh = native_handle_create(1, MOCK_NUM_INTS);
+    if (!nh) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    int* ints = &nh->data[1];
+    nh->data[0] = fd;
+    ints[MOCK_INT_MAGIC] = MOCK_GRALLOC_MAGIC;
+    ints[MOCK_INT_WIDTH] = width;
+    ints[MOCK_INT_HEIGHT] = height;
+    ints[MOCK_INT_FORMAT] = format;
+    ints[MOCK_INT_USAGE] = usage;
+    ints[MOCK_INT_STRIDE] = s;
+    ints[MOCK_INT_SIZE] = size;
+
+    *handle = nh;
+    *stride = s;
+
+    return 0;
+}
+
+static struct mock_mapping** find_mapping(buffer_handle_t handle) {
+    struct mock_mapping** m = &g_mappings;
+
+    while (*m && (*m)->handle != handle)
+        m = &(*m)->next;
+
+    return m;
+}
+
+int hybris_gralloc_release(buffer_handle_t handle, int was_allocated) {
+    if (!handle)
+        return -EINVAL;
+
+    pthread_mutex_lock(&g_mappings_lock);
+    struct mock_mapping** m = find_mapping(handle);
+    struct mock_mapping* mapping = *m;
+    if (mapping)
+        *m = mapping->next;
+    pthread_mutex_unlock(&g_mappings_lock);
+
+    if (mapping) {
+        if (mapping->locks)
+            membrane_err("mock gralloc: releasing a buffer that is still locked");
+        munmap(mapping->addr, mapping->size);
+        free(mapping);
+    }
+
+    native_handle_close(handle);
+    native_handle_delete((native_handle_t*)handle);
+
+    return 0;
+}
+
+/* like a real gralloc the imported handle owns dups of the raw handle's fds */
+int hybris_gralloc_import_buffer(buffer_handle_t raw_handle, buffer_handle_t* out_handle) {
+    if (!is_mock_handle(raw_handle) || !out_handle) {
+        membrane_err("mock gralloc: refusing to import a foreign handle");
+        return -EINVAL;
+    }
+
+    load_env();
+    mock_delay(g_import_us);
+
+    native_handle_t* nh = native_handle_create(raw_handle->numFds, raw_handle->numInts);
+    if (!nh)
+        return -ENOMEM;
+
+    for (int i = 0; i < raw_handle->numFds; i++) {
+        nh->data[i] = fcntl(raw_handle->data[i], F_DUPFD_CLOEXEC, 0);
+        if (nh->data[i] < 0) {
+            int ret = -errno;
+            nh->numFds = i;
+            native_handle_close(nh);
+            native_handle_delete(nh);
+            return ret;
+        }
+    }
+
+    memcpy(&nh->data[nh->numFds], &raw_handle->data[raw_handle->numFds],
+        raw_handle->numInts * sizeof(int));
+
+    *out_handle = nh;
+
+    return 0;
+}
+
+int hybris_gralloc_lock(
+    buffer_handle_t handle, int usage, int l, int t, int w, int h, void** vaddr) {
+    if (!is_mock_handle(handle) || !vaddr)
+        return -EINVAL;
+
+    if (!(usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK)))
+        return -EINVAL;
+
+    load_env();
+    mock_delay(g_lock_us);
+
+    pthread_mutex_lock(&g_mappings_lock);
+
+    struct mock_mapping* mapping = *find_mapping(handle);
+    if (!mapping) {
+        size_t size = handle->data[handle->numFds + MOCK_INT_SIZE];
+        void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle->data[0], 0);
+
+        if (addr == MAP_FAILED) {
+            int ret = -errno;
+            pthread_mutex_unlock(&g_mappings_lock);
+            return ret;
+        }
+
+        mapping = calloc(1, sizeof(*mapping));
+        mapping->handle = handle;
+        mapping->addr = addr;
+        mapping->size = size;
+        mapping->next = g_mappings;
+        g_mappings = mapping;
+    }
+
+    mapping->locks++;
+    *vaddr = mapping->addr;
+
+    pthread_mutex_unlock(&g_mappings_lock);
+
+    return 0;
+}
+
+int hybris_gralloc_unlock(buffer_handle_t handle) {
+    int ret = -EINVAL;
+
+    pthread_mutex_lock(&g_mappings_lock);
+
+    struct mock_mapping* mapping = *find_mapping(handle);
+    if (mapping && mapping->locks > 0) {
+        mapping->locks--;
+        ret = 0;
+    }
+
+    pthread_mutex_unlock(&g_mappings_lock);
+
+    return ret;
+}
@@ -0,0 +1,405 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <hybris/hwc2/hwc2_compatibility_layer.h>
+
+#include "mock.h"
+
+#include <log.h>
+
+struct hwc2_compat_layer {
+    struct ANativeWindowBuffer* buffer;
+    int composition;
+};
+
+#define MOCK_MAX_DISPLAYS 2
+
+struct hwc2_compat_display {
+    hwc2_compat_device_t* device;
+    hwc2_display_t id;
+    HWC2DisplayConfig cfg;
+    hwc2_compat_layer_t* layer;
+
+    struct ANativeWindowBuffer* client_target;
+    struct ANativeWindowBuffer* scanout;
+
+    _Atomic int power_mode;
+    _Atomic bool vsync_enabled;
+    bool validated;
+    bool client_pending;
+    uint64_t frames;
+
+    int64_t epoch;
+    int64_t validate_us;
+    int64_t present_us;
+    bool present_latch;
+    int64_t client_every;
+
+    pthread_t vsync_thread;
+};
+
+struct hwc2_compat_device {
+    pthread_mutex_t lock;
+    HWC2EventListener* listener;
+    int sequence_id;
+    hwc2_compat_display_t* displays[MOCK_MAX_DISPLAYS];
+    bool connected[MOCK_MAX_DISPLAYS];
+    pthread_t hotplug_thread;
+};
+
+static void buffer_assign(struct ANativeWindowBuffer** slot, struct ANativeWindowBuffer* buffer) {
+    if (buffer)
+        buffer->common.incRef(&buffer->common);
+    if (*slot)
+        (*slot)->common.decRef(&(*slot)->common);
+    *slot = buffer;
+}
+
+static int64_t next_vsync(hwc2_compat_display_t* display, int64_t now) {
+    int64_t period = display->cfg.vsyncPeriod;
+    return display->epoch + ((now - display->epoch) / period + 1) * period;
+}
+
+static void* vsync_thread(void* data) {
+    hwc2_compat_display_t* display = data;
+    hwc2_compat_device_t* device = display->device;
+
+    char name[16];
+
+    snprintf(name, sizeof(name), "mock-vsync%d", (int)display->id);
+    pthread_setname_np(pthread_self(), name);
+
+    for (;;) {
+        int64_t t = next_vsync(display, membrane_now_ns());
+        membrane_sleep_until_ns(t);
+
+        if (!atomic_load(&display->vsync_enabled)
+            || atomic_load(&display->power_mode) == HWC2_POWER_MODE_OFF)
+            continue;
+
+        pthread_mutex_lock(&device->lock);
+        HWC2EventListener* listener = device->listener;
+        int seq = device->sequence_id;
+        pthread_mutex_unlock(&device->lock);
+
+        if (listener && listener->on_vsync_received)
+            listener->on_vsync_received(listener, seq, display->id, t);
+    }
+
+    return NULL;
+}
+
+hwc2_compat_device_t* hwc2_compat_device_new(bool useVrComposer) {
+    mock_delay(mock_env("MEMBRANE_MOCK_INIT_US", 0));
+
+    hwc2_compat_device_t* device = calloc(1, sizeof(*device));
+    if (!device)
+        return NULL;
+
+    pthread_mutex_init(&device->lock, NULL);
+
+    return device;
+}
+
+static void notify_hotplug(hwc2_compat_device_t* device, hwc2_display_t id, bool connected) {
+    pthread_mutex_lock(&device->lock);
+    HWC2EventListener* listener = device->listener;
+    int seq = device->sequence_id;
+    pthread_mutex_unlock(&device->lock);
+
+    if (listener && listener->on_hotplug_received)
+        listener->on_hotplug_received(listener, seq, id, connected, id == 0);
+}
+
+/* plugs the external display in and optionally out again, like a dock would */
+static void* hotplug_thread(void* data) {
+    hwc2_compat_device_t* device = data;
+    int64_t connect_ms = mock_env("MEMBRANE_MOCK_EXTERNAL_CONNECT_MS", 0);
+    int64_t disconnect_ms = mock_env("MEMBRANE_MOCK_EXTERNAL_DISCONNECT_MS", 0);
+
+    pthread_setname_np(pthread_self(), "mock-hotplug");
+
+    membrane_sleep_until_ns(membrane_now_ns() + connect_ms * 1000000);
+    notify_hotplug(device, 1, true);
+
+    if (disconnect_ms <= 0)
+        return NULL;
+
+    membrane_sleep_until_ns(membrane_now_ns() + disconnect_ms * 1000000);
+    notify_hotplug(device, 1, false);
+
+    return NULL;
+}
+
+void hwc2_compat_device_register_callback(
+    hwc2_compat_device_t* device, HWC2EventListener* listener, int composerSequenceId) {
+    pthread_mutex_lock(&device->lock);
+    device->listener = listener;
+    device->sequence_id = composerSequenceId;
+    pthread_mutex_unlock(&device->lock);
+
+    notify_hotplug(device, 0, true);
+
+    const char* external = getenv("MEMBRANE_MOCK_EXTERNAL");
+    if (external && *external)
+        pthread_create(&device->hotplug_thread, NULL, hotplug_thread, device);
+}
+
+void hwc2_compat_device_on_hotplug(
+    hwc2_compat_device_t* device, hwc2_display_t displayId, bool connected) {
+    if (displayId >= MOCK_MAX_DISPLAYS)
+        return;
+
+    pthread_mutex_lock(&device->lock);
+    device->connected[displayId] = connected;
+    pthread_mutex_unlock(&device->lock);
+}
+
+/* MEMBRANE_MOCK_EXTERNAL is WxH@R */
+static void display_mode(hwc2_display_t id, int32_t* width, int32_t* height, int64_t* refresh) {
+    if (id == 0) {
+        *width = mock_env("MEMBRANE_MOCK_WIDTH", 1080);
+        *height = mock_env("MEMBRANE_MOCK_HEIGHT", 2340);
+        *refresh = mock_env("MEMBRANE_MOCK_REFRESH", 60);
+        return;
+    }
+
+    *width = 1920;
+    *height = 1080;
+    *refresh = 60;
+
+    int w, h, r;
+    int n = sscanf(getenv("MEMBRANE_MOCK_EXTERNAL"), "%dx%d@%d", &w, &h, &r);
+    if (n >= 2 && w > 0 && h > 0) {
+        *width = w;
+        *height = h;
+    }
+    if (n == 3)
+        *refresh = r;
+}
+
+hwc2_compat_display_t* hwc2_compat_device_get_display_by_id(
+    hwc2_compat_device_t* device, hwc2_display_t id) {
+    if (id >= MOCK_MAX_DISPLAYS)
+        return NULL;
+
+    pthread_mutex_lock(&device->lock);
+    bool connected = device->connected[id];
+    pthread_mutex_unlock(&device->lock);
+
+    if (!connected)
+        return NULL;
+
+    if (device->displays[id])
+        return device->displays[id];
+
+    hwc2_compat_display_t* display = calloc(1, sizeof(*display));
+    if (!display)
+        return NULL;
+
+    int64_t refresh;
+    display_mode(id, &display->cfg.width, &display->cfg.height, &refresh);
+    if (refresh <= 0)
+        refresh = 60;
+
+    display->device = device;
+    display->id = id;
+    display->cfg.id = id;
+    display->cfg.display = id;
+    display->cfg.vsyncPeriod = 1000000000LL / refresh;
+    display->cfg.dpiX = display->cfg.dpiY = 400.0f;
+    display->power_mode = HWC2_POWER_MODE_OFF;
+
+    display->epoch = membrane_now_ns();
+    display->validate_us = mock_env("MEMBRANE_MOCK_VALIDATE_US", 0);
+    display->present_us = mock_env(
+        id == 0 ? "MEMBRANE_MOCK_PRESENT_US" : "MEMBRANE_MOCK_EXTERNAL_PRESENT_US", 0);
+    display->present_latch = mock_env("MEMBRANE_MOCK_PRESENT_LATCH", 0);
+    display->client_every = mock_env("MEMBRANE_MOCK_CLIENT_EVERY", 0);
+
+    if (pthread_create(&display->vsync_thread, NULL, vsync_thread, display) != 0) {
+        free(display);
+        return NULL;
+    }
+
+    membrane_debug("mock hwc2: display %d %dx%d, vsync period %" PRId64 " ns", (int)id,
+        display->cfg.width, display->cfg.height, display->cfg.vsyncPeriod);
+
+    device->displays[id] = display;
+    return display;
+}
+
+void hwc2_compat_device_destroy_display(
+    hwc2_compat_device_t* device, hwc2_compat_display_t* display) { }
+
+HWC2DisplayConfig* hwc2_compat_display_get_active_config(hwc2_compat_display_t* display) {
+    HWC2DisplayConfig* cfg = malloc(sizeof(*cfg));
+    if (cfg)
+        *cfg = display->cfg;
+    return cfg;
+}
+
+hwc2_compat_layer_t* hwc2_compat_display_create_layer(hwc2_compat_display_t* display) {
+    if (display->layer)
+        return NULL;
+
+    display->layer = calloc(1, sizeof(*display->layer));
+    if (display->layer)
+        display->layer->composition = HWC2_COMPOSITION_DEVICE;
+
+    return display->layer;
+}
+
+void hwc2_compat_display_destroy_layer(hwc2_compat_display_t* display, hwc2_compat_layer_t* layer) {
+    if (!layer || layer != display->layer)
+        return;
+
+    buffer_assign(&layer->buffer, NULL);
+    free(layer);
+    display->layer = NULL;
+}
+
+hwc2_error_t hwc2_compat_display_validate(
+    hwc2_compat_display_t* display, uint32_t* outNumTypes, uint32_t* outNumRequests) {
+    mock_delay(display->validate_us);
+
+    *outNumTypes = 0;
+    *outNumRequests = 0;
+    display->validated = true;
+
+    hwc2_compat_layer_t* layer = display->layer;
+    if (!layer)
+        return HWC2_ERROR_NONE;
+
+    display->frames++;
+    if (display->client_every > 0 && layer->composition == HWC2_COMPOSITION_DEVICE
+        && display->frames % display->client_every == 0) {
+        display->client_pending = true;
+        *outNumTypes = 1;
+        return HWC2_ERROR_HAS_CHANGES;
+    }
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_accept_changes(hwc2_compat_display_t* display) {
+    if (!display->validated)
+        return HWC2_ERROR_NOT_VALIDATED;
+
+    if (display->client_pending && display->layer)
+        display->layer->composition = HWC2_COMPOSITION_CLIENT;
+
+    display->client_pending = false;
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_present(
+    hwc2_compat_display_t* display, int32_t* outPresentFence) {
+    *outPresentFence = -1;
+
+    if (!display->validated)
+        return HWC2_ERROR_NOT_VALIDATED;
+
+    display->validated = false;
+
+    mock_delay(display->present_us);
+
+    if (display->present_latch)
+        membrane_sleep_until_ns(next_vsync(display, membrane_now_ns()));
+
+    hwc2_compat_layer_t* layer = display->layer;
+    if (layer && layer->composition == HWC2_COMPOSITION_CLIENT)
+        buffer_assign(&display->scanout, display->client_target);
+    else if (layer)
+        buffer_assign(&display->scanout, layer->buffer);
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_get_release_fences(
+    hwc2_compat_display_t* display, hwc2_compat_out_fences_t** outFences) {
+    *outFences = NULL;
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_set_client_target(hwc2_compat_display_t* display, uint32_t slot,
+    struct ANativeWindowBuffer* buffer, const int32_t acquireFenceFd,
+    android_dataspace_t dataspace) {
+    buffer_assign(&display->client_target, buffer);
+
+    if (acquireFenceFd >= 0)
+        close(acquireFenceFd);
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_set_power_mode(hwc2_compat_display_t* display, int mode) {
+    if (mode < HWC2_POWER_MODE_OFF || mode > HWC2_POWER_MODE_DOZE_SUSPEND)
+        return HWC2_ERROR_BAD_PARAMETER;
+
+    atomic_store(&display->power_mode, mode);
+
+    if (mode == HWC2_POWER_MODE_OFF)
+        buffer_assign(&display->scanout, NULL);
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_set_vsync_enabled(hwc2_compat_display_t* display, int enabled) {
+    if (enabled != HWC2_VSYNC_ENABLE && enabled != HWC2_VSYNC_DISABLE)
+        return HWC2_ERROR_BAD_PARAMETER;
+
+    atomic_store(&display->vsync_enabled, enabled == HWC2_VSYNC_ENABLE);
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_layer_set_buffer(hwc2_compat_layer_t* layer, uint32_t slot,
+    struct ANativeWindowBuffer* buffer, const int32_t acquireFenceFd) {
+    buffer_assign(&layer->buffer, buffer);
+
+    if (acquireFenceFd >= 0)
+        close(acquireFenceFd);
+
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_layer_set_blend_mode(hwc2_compat_layer_t* layer, int mode) {
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_layer_set_composition_type(hwc2_compat_layer_t* layer, int type) {
+    layer->composition = type;
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_layer_set_display_frame(
+    hwc2_compat_layer_t* layer, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_layer_set_source_crop(
+    hwc2_compat_layer_t* layer, float left, float top, float right, float bottom) {
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_layer_set_visible_region(
+    hwc2_compat_layer_t* layer, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+    return HWC2_ERROR_NONE;
+}
+
+int hwc2_compat_out_fences_get_fence(hwc2_compat_out_fences_t* fences, hwc2_compat_layer_t* layer) {
+    return -1;
+}
+
+void hwc2_compat_out_fences_destroy(hwc2_compat_out_fences_t* fences) { }
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct native_handle {
+    int version;
+    int numFds;
+    int numInts;
+    int data[0];
+} native_handle_t;
+
+typedef const native_handle_t* buffer_handle_t;
+
+native_handle_t* native_handle_create(int numFds, int numInts);
+int native_handle_close(const native_handle_t* h);
+int native_handle_delete(native_handle_t* h);
+
+#ifdef __cplusplus
+}
+#endif
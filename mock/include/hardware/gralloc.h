@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <cutils/native_handle.h>
+#include <system/graphics.h>
+
+enum {
+    GRALLOC_USAGE_SW_READ_NEVER = 0x00000000,
+    GRALLOC_USAGE_SW_READ_RARELY = 0x00000002,
+    GRALLOC_USAGE_SW_READ_OFTEN = 0x00000003,
+    GRALLOC_USAGE_SW_READ_MASK = 0x0000000F,
+    GRALLOC_USAGE_SW_WRITE_NEVER = 0x00000000,
+    GRALLOC_USAGE_SW_WRITE_RARELY = 0x00000020,
+    GRALLOC_USAGE_SW_WRITE_OFTEN = 0x00000030,
+    GRALLOC_USAGE_SW_WRITE_MASK = 0x000000F0,
+    GRALLOC_USAGE_HW_TEXTURE = 0x00000100,
+    GRALLOC_USAGE_HW_RENDER = 0x00000200,
+    GRALLOC_USAGE_HW_2D = 0x00000400,
+    GRALLOC_USAGE_HW_COMPOSER = 0x00000800,
+    GRALLOC_USAGE_HW_FB = 0x00001000,
+    GRALLOC_USAGE_PROTECTED = 0x00004000,
+    GRALLOC_USAGE_CURSOR = 0x00008000,
+    GRALLOC_USAGE_HW_VIDEO_ENCODER = 0x00010000,
+};
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <hardware/gralloc.h>
+#include <system/window.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint64_t hwc2_display_t;
+typedef uint32_t hwc2_config_t;
+
+typedef enum {
+    HWC2_ERROR_NONE = 0,
+    HWC2_ERROR_BAD_CONFIG,
+    HWC2_ERROR_BAD_DISPLAY,
+    HWC2_ERROR_BAD_LAYER,
+    HWC2_ERROR_BAD_PARAMETER,
+    HWC2_ERROR_HAS_CHANGES,
+    HWC2_ERROR_NO_RESOURCES,
+    HWC2_ERROR_NOT_VALIDATED,
+    HWC2_ERROR_UNSUPPORTED,
+} hwc2_error_t;
+
+typedef enum {
+    HWC2_COMPOSITION_INVALID = 0,
+    HWC2_COMPOSITION_CLIENT = 1,
+    HWC2_COMPOSITION_DEVICE = 2,
+    HWC2_COMPOSITION_SOLID_COLOR = 3,
+    HWC2_COMPOSITION_CURSOR = 4,
+    HWC2_COMPOSITION_SIDEBAND = 5,
+} hwc2_composition_t;
+
+typedef enum {
+    HWC2_BLEND_MODE_INVALID = 0,
+    HWC2_BLEND_MODE_NONE = 1,
+    HWC2_BLEND_MODE_PREMULTIPLIED = 2,
+    HWC2_BLEND_MODE_COVERAGE = 3,
+} hwc2_blend_mode_t;
+
+typedef enum {
+    HWC2_POWER_MODE_OFF = 0,
+    HWC2_POWER_MODE_DOZE = 1,
+    HWC2_POWER_MODE_ON = 2,
+    HWC2_POWER_MODE_DOZE_SUSPEND = 3,
+} hwc2_power_mode_t;
+
+typedef enum {
+    HWC2_VSYNC_INVALID = 0,
+    HWC2_VSYNC_ENABLE = 1,
+    HWC2_VSYNC_DISABLE = 2,
+} hwc2_vsync_t;
+
+typedef struct HWC2DisplayConfig {
+    hwc2_config_t id;
+    hwc2_display_t display;
+    int32_t width;
+    int32_t height;
+    int64_t vsyncPeriod;
+    float dpiX;
+    float dpiY;
+} HWC2DisplayConfig;
+
+typedef struct HWC2EventListener HWC2EventListener;
+
+typedef void (*on_vsync_received_callback)(
+    HWC2EventListener* listener, int32_t sequenceId, hwc2_display_t display, int64_t timestamp);
+typedef void (*on_hotplug_received_callback)(HWC2EventListener* listener, int32_t sequenceId,
+    hwc2_display_t display, bool connected, bool primaryDisplay);
+typedef void (*on_refresh_received_callback)(
+    HWC2EventListener* listener, int32_t sequenceId, hwc2_display_t display);
+
+struct HWC2EventListener {
+    on_vsync_received_callback on_vsync_received;
+    on_hotplug_received_callback on_hotplug_received;
+    on_refresh_received_callback on_refresh_received;
+};
+
+typedef struct hwc2_compat_device hwc2_compat_device_t;
+typedef struct hwc2_compat_display hwc2_compat_display_t;
+typedef struct hwc2_compat_layer hwc2_compat_layer_t;
+typedef struct hwc2_compat_out_fences hwc2_compat_out_fences_t;
+
+hwc2_compat_device_t* hwc2_compat_device_new(bool useVrComposer);
+void hwc2_compat_device_register_callback(
+    hwc2_compat_device_t* device, HWC2EventListener* listener, int composerSequenceId);
+void hwc2_compat_device_on_hotplug(
+    hwc2_compat_device_t* device, hwc2_display_t displayId, bool connected);
+hwc2_compat_display_t* hwc2_compat_device_get_display_by_id(
+    hwc2_compat_device_t* device, hwc2_display_t id);
+void hwc2_compat_device_destroy_display(
+    hwc2_compat_device_t* device, hwc2_compat_display_t* display);
+
+HWC2DisplayConfig* hwc2_compat_display_get_active_config(hwc2_compat_display_t* display);
+hwc2_error_t hwc2_compat_display_accept_changes(hwc2_compat_display_t* display);
+hwc2_compat_layer_t* hwc2_compat_display_create_layer(hwc2_compat_display_t* display);
+void hwc2_compat_display_destroy_layer(
+    hwc2_compat_display_t* display, hwc2_compat_layer_t* layer);
+hwc2_error_t hwc2_compat_display_get_release_fences(
+    hwc2_compat_display_t* display, hwc2_compat_out_fences_t** outFences);
+hwc2_error_t hwc2_compat_display_present(
+    hwc2_compat_display_t* display, int32_t* outPresentFence);
+hwc2_error_t hwc2_compat_display_set_client_target(hwc2_compat_display_t* display, uint32_t slot,
+    struct ANativeWindowBuffer* buffer, const int32_t acquireFenceFd,
+    android_dataspace_t dataspace);
+hwc2_error_t hwc2_compat_display_set_power_mode(hwc2_compat_display_t* display, int mode);
+hwc2_error_t hwc2_compat_display_set_vsync_enabled(hwc2_compat_display_t* display, int enabled);
+hwc2_error_t hwc2_compat_display_validate(
+    hwc2_compat_display_t* display, uint32_t* outNumTypes, uint32_t* outNumRequests);
+
+hwc2_error_t hwc2_compat_layer_set_buffer(hwc2_compat_layer_t* layer, uint32_t slot,
+    struct ANativeWindowBuffer* buffer, const int32_t acquireFenceFd);
+hwc2_error_t hwc2_compat_layer_set_blend_mode(hwc2_compat_layer_t* layer, int mode);
+hwc2_error_t hwc2_compat_layer_set_composition_type(hwc2_compat_layer_t* layer, int type);
+hwc2_error_t hwc2_compat_layer_set_display_frame(
+    hwc2_compat_layer_t* layer, int32_t left, int32_t top, int32_t right, int32_t bottom);
+hwc2_error_t hwc2_compat_layer_set_source_crop(
+    hwc2_compat_layer_t* layer, float left, float top, float right, float bottom);
+hwc2_error_t hwc2_compat_layer_set_visible_region(
+    hwc2_compat_layer_t* layer, int32_t left, int32_t top, int32_t right, int32_t bottom);
+
+int hwc2_compat_out_fences_get_fence(hwc2_compat_out_fences_t* fences, hwc2_compat_layer_t* layer);
+void hwc2_compat_out_fences_destroy(hwc2_compat_out_fences_t* fences);
+
+#ifdef __cplusplus
+}
+#endif
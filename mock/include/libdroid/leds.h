@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DroidLeds DroidLeds;
+
+DroidLeds* droid_leds_new(GError** error);
+guint droid_leds_get_backlight(DroidLeds* self);
+gboolean droid_leds_set_backlight(DroidLeds* self, guint level, gboolean animate);
+
+G_END_DECLS
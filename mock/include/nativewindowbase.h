@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <string.h>
+
+#include <hardware/gralloc.h>
+#include <system/window.h>
+
+class BaseNativeWindowBuffer : public ANativeWindowBuffer {
+protected:
+    BaseNativeWindowBuffer() {
+        memset(static_cast<ANativeWindowBuffer*>(this), 0, sizeof(ANativeWindowBuffer));
+        common.magic = ANDROID_NATIVE_BUFFER_MAGIC;
+        common.version = sizeof(ANativeWindowBuffer);
+        common.incRef = _incRef;
+        common.decRef = _decRef;
+        refcount = 0;
+    }
+
+    virtual ~BaseNativeWindowBuffer() { }
+
+public:
+    ANativeWindowBuffer* getNativeBuffer() const {
+        return static_cast<ANativeWindowBuffer*>(const_cast<BaseNativeWindowBuffer*>(this));
+    }
+
+private:
+    static BaseNativeWindowBuffer* from(android_native_base_t* base) {
+        return static_cast<BaseNativeWindowBuffer*>(reinterpret_cast<ANativeWindowBuffer*>(base));
+    }
+
+    static void _incRef(android_native_base_t* base) {
+        __atomic_add_fetch(&from(base)->refcount, 1, __ATOMIC_RELAXED);
+    }
+
+    static void _decRef(android_native_base_t* base) {
+        BaseNativeWindowBuffer* self = from(base);
+        if (__atomic_sub_fetch(&self->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+            delete self;
+    }
+
+    unsigned int refcount;
+};
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+enum {
+    HAL_PIXEL_FORMAT_RGBA_8888 = 1,
+    HAL_PIXEL_FORMAT_RGBX_8888 = 2,
+    HAL_PIXEL_FORMAT_RGB_888 = 3,
+    HAL_PIXEL_FORMAT_RGB_565 = 4,
+    HAL_PIXEL_FORMAT_BGRA_8888 = 5,
+    HAL_PIXEL_FORMAT_YCBCR_422_SP = 0x10,
+    HAL_PIXEL_FORMAT_YCRCB_420_SP = 0x11,
+    HAL_PIXEL_FORMAT_YCBCR_422_I = 0x14,
+    HAL_PIXEL_FORMAT_RGBA_FP16 = 0x16,
+    HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED = 0x22,
+    HAL_PIXEL_FORMAT_YCBCR_420_888 = 0x23,
+    HAL_PIXEL_FORMAT_RGBA_1010102 = 0x2B,
+    HAL_PIXEL_FORMAT_YCBCR_P010 = 0x36,
+    HAL_PIXEL_FORMAT_YV12 = 0x32315659,
+};
+
+typedef enum android_dataspace {
+    HAL_DATASPACE_UNKNOWN = 0,
+} android_dataspace_t;
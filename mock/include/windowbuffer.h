@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#pragma once
+
+#include <nativewindowbase.h>
+
+extern "C" int hybris_gralloc_release(buffer_handle_t handle, int was_allocated);
+
+class RemoteWindowBuffer : public BaseNativeWindowBuffer {
+public:
+    RemoteWindowBuffer(unsigned int width, unsigned int height, unsigned int stride,
+        unsigned int format, uint64_t usage, buffer_handle_t handle)
+        : m_allocated(false) {
+        this->width = width;
+        this->height = height;
+        this->stride = stride;
+        this->format = format;
+        this->usage = usage;
+        this->usage_deprecated = (int)usage;
+        this->layerCount = 1;
+        this->handle = handle;
+    }
+
+    ~RemoteWindowBuffer() { hybris_gralloc_release(handle, m_allocated); }
+
+    void setAllocated(bool allocated) { m_allocated = allocated; }
+
+private:
+    bool m_allocated;
+};
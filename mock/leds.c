@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#include <libdroid/leds.h>
+
+#include "mock.h"
+
+#include <log.h>
+
+struct _DroidLeds {
+    guint level;
+};
+
+DroidLeds* droid_leds_new(GError** error) {
+    mock_delay(mock_env("MEMBRANE_MOCK_INIT_US", 0));
+
+    DroidLeds* self = g_new0(DroidLeds, 1);
+    self->level = mock_env("MEMBRANE_MOCK_BACKLIGHT", 128);
+    return self;
+}
+
+guint droid_leds_get_backlight(DroidLeds* self) { return self->level; }
+
+gboolean droid_leds_set_backlight(DroidLeds* self, guint level, gboolean animate) {
+    mock_delay(mock_env("MEMBRANE_MOCK_BACKLIGHT_US", 0));
+
+    membrane_debug("mock leds: backlight %u -> %u", self->level, level);
+    self->level = level;
+
+    return TRUE;
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef MOCK_H
+#define MOCK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <membrane_time.h>
+
+#define MOCK_GRALLOC_MAGIC 0x6d6f636b
+
+/* ints carried after the fd in every mock gralloc handle */
+enum {
+    MOCK_INT_MAGIC,
+    MOCK_INT_WIDTH,
+    MOCK_INT_HEIGHT,
+    MOCK_INT_FORMAT,
+    MOCK_INT_USAGE,
+    MOCK_INT_STRIDE,
+    MOCK_INT_SIZE,
+    MOCK_NUM_INTS,
+};
+
+static inline int64_t mock_env(const char* name, int64_t def) {
+    const char* v = getenv(name);
+    return v && *v ? strtoll(v, NULL, 0) : def;
+}
+
+/* simulated cost of a HAL call */
+static inline void mock_delay(int64_t us) {
+    if (us > 0)
+        membrane_sleep_until_ns(membrane_now_ns() + us * 1000);
+}
+
+#endif /* MOCK_H */
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cutils/native_handle.h>
+
+#define NATIVE_HANDLE_MAX_FDS 1024
+#define NATIVE_HANDLE_MAX_INTS 1024
+
+native_handle_t* native_handle_create(int numFds, int numInts) {
+    if (numFds < 0 || numInts < 0 || numFds > NATIVE_HANDLE_MAX_FDS
+        || numInts > NATIVE_HANDLE_MAX_INTS)
+        return NULL;
+
+    native_handle_t* h = malloc(sizeof(native_handle_t) + sizeof(int) * (numFds + numInts));
+    if (!h)
+        return NULL;
+
+    h->version = sizeof(native_handle_t);
+    h->numFds = numFds;
+    h->numInts = numInts;
+
+    return h;
+}
+
+int native_handle_close(const native_handle_t* h) {
+    if (!h || h->version != sizeof(native_handle_t))
+        return -EINVAL;
+
+    for (int i = 0; i < h->numFds; i++)
+        close(h->data[i]);
+
+    return 0;
+}
+
+int native_handle_delete(native_handle_t* h) {
+    if (!h)
+        return 0;
+
+    if (h->version != sizeof(native_handle_t))
+        return -EINVAL;
+
+    free(h);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#ifndef MEMBRANE_SIM_H
+#define MEMBRANE_SIM_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <drm.h>
+#include <drm_mode.h>
+
+#include <membrane.h>
+
+#define MEMBRANE_SIM_NODE "/dev/dri/by-path/platform-membrane-card"
+#define MEMBRANE_SIM_RENDER_NODE "/dev/dri/by-path/platform-membrane-render"
+#define MEMBRANE_SIM_MAX_PAYLOAD 65536
+
+/* the sim has no resource enumeration, clients use these ids directly */
+enum {
+    MEMBRANE_SIM_PLANE_ID = 31,
+    MEMBRANE_SIM_CRTC_ID = 32,
+    MEMBRANE_SIM_ENCODER_ID = 33,
+    MEMBRANE_SIM_CONNECTOR_ID = 34,
+};
+
+/* pipe n uses the ids above shifted by n * MEMBRANE_SIM_PIPE_STRIDE */
+#define MEMBRANE_SIM_PIPE_STRIDE 10
+
+static inline uint32_t membrane_sim_obj_id(uint32_t id, unsigned int pipe) {
+    return id + pipe * MEMBRANE_SIM_PIPE_STRIDE;
+}
+
+enum {
+    MEMBRANE_SIM_PROP_FB_ID = 1,
+    MEMBRANE_SIM_PROP_CRTC_ID,
+    MEMBRANE_SIM_PROP_SRC_X,
+    MEMBRANE_SIM_PROP_SRC_Y,
+    MEMBRANE_SIM_PROP_SRC_W,
+    MEMBRANE_SIM_PROP_SRC_H,
+    MEMBRANE_SIM_PROP_CRTC_X,
+    MEMBRANE_SIM_PROP_CRTC_Y,
+    MEMBRANE_SIM_PROP_CRTC_W,
+    MEMBRANE_SIM_PROP_CRTC_H,
+    MEMBRANE_SIM_PROP_ACTIVE,
+    MEMBRANE_SIM_PROP_MODE_ID,
+    MEMBRANE_SIM_PROP_DPMS,
+    MEMBRANE_SIM_PROP_LOW_POWER,
+};
+
+/* first request on a connection, the reply carries the event socket */
+#define MEMBRANE_SIM_HELLO 0
+
+struct membrane_sim_msg {
+    uint32_t request;
+    int32_t ret;
+    uint32_t size;
+    uint32_t __reserved;
+};
+
+static inline void membrane_sim_socket_path(char* buf, size_t len) {
+    const char* path = getenv("MEMBRANE_SIM_SOCKET");
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+
+    if (path && *path)
+        snprintf(buf, len, "%s", path);
+    else
+        snprintf(buf, len, "%s/membrane-sim", dir && *dir ? dir : "/tmp");
+}
+
+static inline int membrane_sim_send(int sock, const struct membrane_sim_msg* hdr,
+    const void* payload, const int* fds, int num_fds) {
+    char cbuf[CMSG_SPACE(sizeof(int) * MEMBRANE_MAX_FDS)] = {};
+    struct iovec iov[2] = {
+        { .iov_base = (void*)hdr, .iov_len = sizeof(*hdr) },
+        { .iov_base = (void*)payload, .iov_len = hdr->size },
+    };
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = hdr->size ? 2 : 1,
+    };
+
+    if (num_fds > 0) {
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+    }
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 ? -errno : 0;
+}
+
+static inline int membrane_sim_recv(
+    int sock, struct membrane_sim_msg* hdr, void* payload, uint32_t size, int* fds, int* num_fds) {
+    char cbuf[CMSG_SPACE(sizeof(int) * MEMBRANE_MAX_FDS)];
+    struct iovec iov[2] = {
+        { .iov_base = hdr, .iov_len = sizeof(*hdr) },
+        { .iov_base = payload, .iov_len = size },
+    };
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+        .msg_control = cbuf,
+        .msg_controllen = sizeof(cbuf),
+    };
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < (ssize_t)sizeof(*hdr))
+        return n < 0 ? -errno : -EIO;
+
+    *num_fds = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), n_fds * sizeof(int));
+        *num_fds = n_fds;
+    }
+
+    if ((size_t)n != sizeof(*hdr) + hdr->size) {
+        for (int i = 0; i < *num_fds; i++)
+            close(fds[i]);
+        *num_fds = 0;
+        return -EIO;
+    }
+
+    return 0;
+}
+
+#endif /* MEMBRANE_SIM_H */
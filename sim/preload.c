@@ -0,0 +1,341 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "membrane_sim.h"
+
+#define SIM_MAX_CONNS 4096
+
+/* the fd handed to the application is the event socket, ioctls go over a private control socket */
+struct sim_conn {
+    int ctl;
+    pthread_mutex_t lock;
+};
+
+static struct sim_conn* g_conns[SIM_MAX_CONNS];
+static pthread_mutex_t g_conns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int (*real_open)(const char*, int, ...);
+static int (*real_openat)(int, const char*, int, ...);
+static int (*real_close)(int);
+static int (*real_ioctl)(int, unsigned long, ...);
+
+__attribute__((constructor)) static void sim_init(void) {
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_openat = dlsym(RTLD_NEXT, "openat");
+    real_close = dlsym(RTLD_NEXT, "close");
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+}
+
+static bool is_sim_path(const char* path) {
+    const char* extra = getenv("MEMBRANE_SIM_NODE");
+
+    return path
+        && (strcmp(path, MEMBRANE_SIM_NODE) == 0 || strcmp(path, MEMBRANE_SIM_RENDER_NODE) == 0
+            || (extra && *extra && strcmp(path, extra) == 0));
+}
+
+static struct sim_conn* conn_get(int fd) {
+    if (fd < 0 || fd >= SIM_MAX_CONNS)
+        return NULL;
+
+    return __atomic_load_n(&g_conns[fd], __ATOMIC_ACQUIRE);
+}
+
+/* returns the server's ioctl result, received fds are owned by the caller */
+static int sim_call(struct sim_conn* c, uint32_t request, const void* payload, uint32_t size,
+    const int* fds, int num_fds, void* reply, uint32_t reply_size, int* rfds, int* num_rfds) {
+    struct membrane_sim_msg hdr = { .request = request, .size = size };
+    int dummy_fds[MEMBRANE_MAX_FDS];
+    int dummy_num;
+
+    if (!rfds) {
+        rfds = dummy_fds;
+        num_rfds = &dummy_num;
+    }
+
+    pthread_mutex_lock(&c->lock);
+
+    int ret = membrane_sim_send(c->ctl, &hdr, payload, fds, num_fds);
+    if (!ret)
+        ret = membrane_sim_recv(c->ctl, &hdr, reply, reply_size, rfds, num_rfds);
+
+    pthread_mutex_unlock(&c->lock);
+
+    if (ret)
+        return ret;
+
+    if (rfds == dummy_fds) {
+        for (int i = 0; i < dummy_num; i++)
+            real_close(dummy_fds[i]);
+    }
+
+    return hdr.ret;
+}
+
+static int sim_open(int flags) {
+    char path[108];
+    membrane_sim_socket_path(path, sizeof(path));
+
+    int ctl = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (ctl < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    if (connect(ctl, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        /* no simulator running looks like a missing device node */
+        int err = (errno == ECONNREFUSED || errno == ENOENT) ? ENODEV : errno;
+        real_close(ctl);
+        errno = err;
+        return -1;
+    }
+
+    struct sim_conn* c = calloc(1, sizeof(*c));
+    c->ctl = ctl;
+    pthread_mutex_init(&c->lock, NULL);
+
+    int fds[MEMBRANE_MAX_FDS];
+    int num_fds = 0;
+    int ret = sim_call(c, MEMBRANE_SIM_HELLO, NULL, 0, NULL, 0, NULL, 0, fds, &num_fds);
+
+    if (ret || num_fds != 1 || fds[0] >= SIM_MAX_CONNS) {
+        for (int i = 0; i < num_fds; i++)
+            real_close(fds[i]);
+        real_close(ctl);
+        free(c);
+        errno = ret ? -ret : EMFILE;
+        return -1;
+    }
+
+    int fd = fds[0];
+    if (!(flags & O_CLOEXEC))
+        fcntl(fd, F_SETFD, 0);
+    if (flags & O_NONBLOCK)
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    pthread_mutex_lock(&g_conns_lock);
+    __atomic_store_n(&g_conns[fd], c, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_conns_lock);
+
+    return fd;
+}
+
+static int sim_version(struct sim_conn* c, struct drm_version* v) {
+    struct {
+        struct drm_version v;
+        char strings[256];
+    } reply;
+
+    int ret = sim_call(c, DRM_IOCTL_VERSION, NULL, 0, NULL, 0, &reply, sizeof(reply), NULL, NULL);
+    if (ret)
+        return ret;
+
+    const char* s = reply.strings;
+    struct {
+        size_t* len;
+        char* buf;
+        size_t n;
+    } fields[] = {
+        { &v->name_len, v->name, reply.v.name_len },
+        { &v->date_len, v->date, reply.v.date_len },
+        { &v->desc_len, v->desc, reply.v.desc_len },
+    };
+
+    v->version_major = reply.v.version_major;
+    v->version_minor = reply.v.version_minor;
+    v->version_patchlevel = reply.v.version_patchlevel;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (fields[i].buf && *fields[i].len)
+            memcpy(fields[i].buf, s, *fields[i].len < fields[i].n ? *fields[i].len : fields[i].n);
+        *fields[i].len = fields[i].n;
+        s += fields[i].n;
+    }
+
+    return 0;
+}
+
+/* flattens the four user arrays behind the atomic ioctl into one payload */
+static int sim_atomic(struct sim_conn* c, struct drm_mode_atomic* a) {
+    static __thread uint8_t buf[MEMBRANE_SIM_MAX_PAYLOAD];
+    const uint32_t* count_props = (const uint32_t*)(uintptr_t)a->count_props_ptr;
+    size_t total = 0;
+
+    for (uint32_t i = 0; i < a->count_objs; i++)
+        total += count_props[i];
+
+    size_t size = sizeof(*a) + a->count_objs * 2 * sizeof(uint32_t)
+        + total * (sizeof(uint32_t) + sizeof(uint64_t));
+    if (size > sizeof(buf))
+        return -E2BIG;
+
+    uint8_t* p = buf;
+    memcpy(p, a, sizeof(*a));
+    p += sizeof(*a);
+    memcpy(p, (void*)(uintptr_t)a->objs_ptr, a->count_objs * sizeof(uint32_t));
+    p += a->count_objs * sizeof(uint32_t);
+    memcpy(p, count_props, a->count_objs * sizeof(uint32_t));
+    p += a->count_objs * sizeof(uint32_t);
+    memcpy(p, (void*)(uintptr_t)a->props_ptr, total * sizeof(uint32_t));
+    p += total * sizeof(uint32_t);
+    memcpy(p, (void*)(uintptr_t)a->prop_values_ptr, total * sizeof(uint64_t));
+
+    return sim_call(c, DRM_IOCTL_MODE_ATOMIC, buf, size, NULL, 0, NULL, 0, NULL, NULL);
+}
+
+static int sim_create_blob(struct sim_conn* c, struct drm_mode_create_blob* b) {
+    static __thread uint8_t buf[MEMBRANE_SIM_MAX_PAYLOAD];
+
+    if (sizeof(*b) + b->length > sizeof(buf))
+        return -E2BIG;
+
+    memcpy(buf, b, sizeof(*b));
+    memcpy(buf + sizeof(*b), (void*)(uintptr_t)b->data, b->length);
+
+    return sim_call(
+        c, DRM_IOCTL_MODE_CREATEPROPBLOB, buf, sizeof(*b) + b->length, NULL, 0, b, sizeof(*b),
+        NULL, NULL);
+}
+
+static int sim_present_fd(struct sim_conn* c, struct membrane_get_present_fd* arg) {
+    int fds[MEMBRANE_MAX_FDS];
+    int num_fds = 0;
+
+    int ret = sim_call(c, DRM_IOCTL_MEMBRANE_GET_PRESENT_FD, &arg->display, sizeof(arg->display),
+        NULL, 0, arg, sizeof(*arg), fds, &num_fds);
+    if (ret) {
+        for (int i = 0; i < num_fds; i++)
+            real_close(fds[i]);
+        return ret;
+    }
+
+    /* the server numbers the planes it sent, swap those for our fds */
+    for (int i = 0; i < MEMBRANE_MAX_FDS; i++) {
+        if (arg->fds[i] >= 0 && arg->fds[i] < num_fds)
+            arg->fds[i] = fds[arg->fds[i]];
+        else
+            arg->fds[i] = -1;
+    }
+
+    return 0;
+}
+
+static int sim_ioctl(struct sim_conn* c, unsigned long request, void* arg) {
+    uint32_t size = _IOC_SIZE(request);
+
+    switch (request) {
+    case DRM_IOCTL_VERSION:
+        return sim_version(c, arg);
+    case DRM_IOCTL_MODE_ATOMIC:
+        return sim_atomic(c, arg);
+    case DRM_IOCTL_MODE_CREATEPROPBLOB:
+        return sim_create_blob(c, arg);
+    case DRM_IOCTL_MEMBRANE_GET_PRESENT_FD:
+        return sim_present_fd(c, arg);
+    case DRM_IOCTL_PRIME_FD_TO_HANDLE: {
+        struct drm_prime_handle* p = arg;
+        return sim_call(c, request, p, size, &p->fd, 1, p, size, NULL, NULL);
+    }
+    case DRM_IOCTL_MEMBRANE_META: {
+        struct membrane_meta_op* op = arg;
+        return sim_call(c, request, op, size, &op->fd, 1, op, size, NULL, NULL);
+    }
+    default:
+        break;
+    }
+
+    if (_IOC_TYPE(request) != DRM_IOCTL_BASE)
+        return -ENOTTY;
+
+    return sim_call(c, request, (_IOC_DIR(request) & _IOC_WRITE) ? arg : NULL,
+        (_IOC_DIR(request) & _IOC_WRITE) ? size : 0, NULL, 0, arg,
+        (_IOC_DIR(request) & _IOC_READ) ? size : 0, NULL, NULL);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    va_list ap;
+    va_start(ap, request);
+    void* arg = va_arg(ap, void*);
+    va_end(ap);
+
+    struct sim_conn* c = conn_get(fd);
+    if (!c)
+        return real_ioctl(fd, request, arg);
+
+    int ret = sim_ioctl(c, request, arg);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+
+    return ret;
+}
+
+int close(int fd) {
+    struct sim_conn* c = conn_get(fd);
+
+    if (c) {
+        pthread_mutex_lock(&g_conns_lock);
+        __atomic_store_n(&g_conns[fd], NULL, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&g_conns_lock);
+
+        real_close(c->ctl);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+    }
+
+    return real_close(fd);
+}
+
+int open(const char* path, int flags, ...) {
+    mode_t mode = 0;
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+
+    if (is_sim_path(path))
+        return sim_open(flags);
+
+    return real_open(path, flags, mode);
+}
+
+int openat(int dirfd, const char* path, int flags, ...) {
+    mode_t mode = 0;
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+
+    if (is_sim_path(path))
+        return sim_open(flags);
+
+    return real_openat(dirfd, path, flags, mode);
+}
+
+int open64(const char* path, int flags, ...) __attribute__((alias("open")));
+int openat64(int dirfd, const char* path, int flags, ...) __attribute__((alias("openat")));
+
+int __open_2(const char* path, int flags) { return open(path, flags); }
+int __open64_2(const char* path, int flags) { return open(path, flags); }
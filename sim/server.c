@@ -0,0 +1,1420 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Copyright (c) 2026 Deepak Meena <who53@disroot.org> */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include <drm_fourcc.h>
+
+#include "membrane_sim.h"
+
+#include <log.h>
+#include <membrane_time.h>
+
+#define SIM_FIRST_ID 100
+#define SIM_MAX_SIZE 4096
+/* mirrors MEMBRANE_META_MAX_ENTRIES in the driver */
+#define SIM_META_MAX_ENTRIES 4096
+
+struct sim_obj {
+    int refcount;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    struct membrane_meta meta;
+};
+
+struct sim_handle {
+    uint32_t handle;
+    struct sim_obj* obj;
+};
+
+struct sim_client;
+
+struct sim_fb {
+    struct sim_fb* next;
+    struct sim_client* owner;
+    uint32_t id;
+    int refcount;
+    uint32_t format;
+    struct sim_obj* objs[MEMBRANE_MAX_FDS];
+};
+
+struct sim_blob {
+    struct sim_blob* next;
+    struct sim_client* owner;
+    uint32_t id;
+    uint32_t length;
+};
+
+struct sim_meta_entry {
+    struct sim_meta_entry* next;
+    struct sim_client* owner;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    struct membrane_meta meta;
+    uint64_t id;
+};
+
+struct sim_client {
+    struct sim_client* next;
+    int ctl;
+    int ev;
+    bool atomic;
+    bool dead;
+
+    struct sim_handle* handles;
+    size_t num_handles;
+    uint32_t next_handle;
+
+    /* pipe a SIGNAL is parked on, -1 if none */
+    int signal_pipe;
+
+    /* a blocking atomic commit stalled on the previous flip */
+    void* parked;
+    uint32_t parked_size;
+};
+
+struct sim_kms {
+    bool active;
+    uint32_t mode_id;
+    struct sim_fb* fb;
+    uint32_t plane_crtc;
+    uint32_t conn_crtc;
+    uint32_t low_power;
+};
+
+struct sim_pipe {
+    unsigned int index;
+    int w, h, r;
+    int doze_r;
+    bool connected;
+
+    struct sim_client* event_consumer;
+    bool stopping;
+
+    struct sim_kms kms;
+    struct sim_fb* pending_state;
+    struct sim_fb* active_state;
+    /* the last fb handed to the consumer, replayed to its successor */
+    struct sim_fb* last_state;
+    bool handoff;
+
+    int timer_fd;
+    int64_t next_vblank;
+    uint32_t vblank_seq;
+
+    struct {
+        struct sim_client* client;
+        uint64_t user_data;
+    } flip_event;
+    bool flip_armed;
+
+    struct membrane_event pending_event;
+    bool event_posted;
+    uint32_t dpms_state;
+};
+
+static struct {
+    int refresh_override;
+    int64_t jitter_ns;
+
+    struct sim_client* clients;
+    struct sim_client* master;
+
+    struct sim_pipe pipes[MEMBRANE_MAX_DISPLAYS];
+
+    uint32_t next_id;
+    struct sim_fb* fbs;
+    struct sim_blob* blobs;
+    struct sim_meta_entry* meta;
+    uint64_t meta_seq;
+} g_sim;
+
+static void obj_put(struct sim_obj* obj) {
+    if (--obj->refcount)
+        return;
+
+    close(obj->fd);
+    free(obj);
+}
+
+static void fb_get(struct sim_fb* fb) {
+    if (fb)
+        fb->refcount++;
+}
+
+static void fb_put(struct sim_fb* fb) {
+    if (!fb || --fb->refcount)
+        return;
+
+    for (int i = 0; i < MEMBRANE_MAX_FDS; i++) {
+        if (fb->objs[i])
+            obj_put(fb->objs[i]);
+    }
+
+    free(fb);
+}
+
+static void fb_xchg(struct sim_fb** slot, struct sim_fb* fb) {
+    struct sim_fb* old = *slot;
+    *slot = fb;
+    fb_put(old);
+}
+
+static struct sim_fb* fb_lookup(uint32_t id) {
+    for (struct sim_fb* fb = g_sim.fbs; fb; fb = fb->next) {
+        if (fb->id == id)
+            return fb;
+    }
+
+    return NULL;
+}
+
+static struct sim_blob* blob_lookup(uint32_t id) {
+    for (struct sim_blob* b = g_sim.blobs; b; b = b->next) {
+        if (b->id == id)
+            return b;
+    }
+
+    return NULL;
+}
+
+static int reply(struct sim_client* c, uint32_t request, int32_t ret, const void* payload,
+    uint32_t size, const int* fds, int num_fds) {
+    struct membrane_sim_msg hdr = {
+        .request = request,
+        .ret = ret,
+        .size = size,
+    };
+
+    return membrane_sim_send(c->ctl, &hdr, payload, fds, num_fds);
+}
+
+static int64_t vblank_period(struct sim_pipe* p) {
+    int r = g_sim.refresh_override > 0 ? g_sim.refresh_override : p->r;
+
+    if (p->kms.low_power && p->doze_r > 0 && (r <= 0 || p->doze_r < r))
+        r = p->doze_r;
+
+    if (r <= 0)
+        r = 60;
+
+    return 1000000000LL / r;
+}
+
+/* the vblank grid stays at t, only this tick is moved by the jitter */
+static void timer_arm(struct sim_pipe* p, int64_t t, int64_t jitter) {
+    int64_t fire = t + jitter;
+    struct itimerspec its = {
+        .it_value = {
+            .tv_sec = fire / 1000000000LL,
+            .tv_nsec = fire % 1000000000LL,
+        },
+    };
+
+    p->next_vblank = t;
+    timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void timer_cancel(struct sim_pipe* p) {
+    struct itimerspec its = {};
+
+    p->next_vblank = 0;
+    timerfd_settime(p->timer_fd, 0, &its, NULL);
+}
+
+static void send_flip_event(struct sim_pipe* p, struct sim_client* c, uint64_t user_data) {
+    int64_t now = membrane_now_ns();
+    struct drm_event_vblank ev = {
+        .base = {
+            .type = DRM_EVENT_FLIP_COMPLETE,
+            .length = sizeof(ev),
+        },
+        .user_data = user_data,
+        .tv_sec = now / 1000000000LL,
+        .tv_usec = (now % 1000000000LL) / 1000,
+        .sequence = p->vblank_seq,
+        .crtc_id = membrane_sim_obj_id(MEMBRANE_SIM_CRTC_ID, p->index),
+    };
+
+    if (send(c->ev, &ev, sizeof(ev), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        membrane_err("dropping flip event: %s", strerror(errno));
+}
+
+static void vblank_event_commit(struct sim_pipe* p, struct sim_client* c, uint64_t user_data) {
+    struct sim_client* old = p->flip_armed ? p->flip_event.client : NULL;
+    uint64_t old_data = p->flip_event.user_data;
+
+    p->flip_armed = c != NULL;
+    p->flip_event.client = c;
+    p->flip_event.user_data = user_data;
+
+    if (old)
+        send_flip_event(p, old, old_data);
+}
+
+static void send_event(struct sim_pipe* p, uint32_t flags, uint32_t value) {
+    if (flags & MEMBRANE_DPMS_UPDATED)
+        p->dpms_state = value;
+
+    if (p->stopping)
+        return;
+
+    /* like the driver, an unread event is merged so a vblank can't swallow a power change */
+    if (p->event_posted)
+        flags |= p->pending_event.flags;
+    if (flags & MEMBRANE_DPMS_UPDATED)
+        value = p->dpms_state;
+
+    p->pending_event.flags = flags;
+    p->pending_event.value = value;
+    p->pending_event.display = p->index;
+    p->pending_event.timestamp = membrane_now_ns();
+    if (p->index && !p->connected)
+        p->pending_event.flags |= MEMBRANE_DISPLAY_REMOVED;
+    p->event_posted = true;
+
+    for (struct sim_client* c = g_sim.clients; c; c = c->next) {
+        if (c->signal_pipe != (int)p->index)
+            continue;
+
+        c->signal_pipe = -1;
+        p->event_posted = false;
+        reply(c, DRM_IOCTL_MEMBRANE_SIGNAL, 0, &p->pending_event, sizeof(p->pending_event),
+            NULL, 0);
+        break;
+    }
+}
+
+static uint32_t fb_count_objs(struct sim_fb* fb) {
+    uint32_t count = 0;
+
+    for (int i = 0; i < MEMBRANE_MAX_FDS; i++)
+        count += fb->objs[i] != NULL;
+
+    return count;
+}
+
+static uint32_t pipe_dpms(struct sim_pipe* p) {
+    switch (p->kms.low_power) {
+    case MEMBRANE_LOW_POWER_DOZE:
+        return MEMBRANE_DPMS_DOZE;
+    case MEMBRANE_LOW_POWER_DOZE_SUSPEND:
+        return MEMBRANE_DPMS_DOZE_SUSPEND;
+    default:
+        return MEMBRANE_DPMS_ON;
+    }
+}
+
+static void crtc_enable(struct sim_pipe* p) {
+    timer_arm(p, membrane_now_ns() + vblank_period(p), 0);
+    send_event(p, MEMBRANE_DPMS_UPDATED, pipe_dpms(p));
+}
+
+static void crtc_disable(struct sim_pipe* p) {
+    fb_xchg(&p->active_state, NULL);
+    fb_xchg(&p->pending_state, NULL);
+    fb_xchg(&p->last_state, NULL);
+
+    timer_cancel(p);
+    vblank_event_commit(p, NULL, 0);
+
+    send_event(p, MEMBRANE_DPMS_UPDATED, g_sim.master ? MEMBRANE_DPMS_OFF : MEMBRANE_DPMS_NO_COMP);
+}
+
+static void process_parked(void);
+
+static void vblank(struct sim_pipe* p) {
+    struct sim_fb* fb = p->pending_state;
+
+    p->pending_state = NULL;
+    if (fb) {
+        fb_xchg(&p->active_state, fb);
+        send_event(p, MEMBRANE_PRESENT_UPDATED, fb_count_objs(fb));
+    }
+
+    p->vblank_seq++;
+    vblank_event_commit(p, NULL, 0);
+
+    int64_t next = p->next_vblank + vblank_period(p);
+    int64_t now = membrane_now_ns();
+
+    /* a stalled simulator skips vblanks like hrtimer_forward_now does */
+    if (next <= now)
+        next = now + vblank_period(p);
+
+    int64_t jitter = 0;
+    if (g_sim.jitter_ns > 0)
+        jitter = (int64_t)(random() % (2 * g_sim.jitter_ns + 1)) - g_sim.jitter_ns;
+
+    timer_arm(p, next, jitter);
+
+    process_parked();
+}
+
+static int do_version(struct sim_client* c) {
+    static const char name[] = "membrane";
+    static const char date[] = "20260119";
+    static const char desc[] = "membrane";
+    struct {
+        struct drm_version v;
+        char strings[sizeof(name) + sizeof(date) + sizeof(desc)];
+    } rep = {};
+
+    rep.v.version_major = 1;
+    rep.v.name_len = strlen(name);
+    rep.v.date_len = strlen(date);
+    rep.v.desc_len = strlen(desc);
+    snprintf(rep.strings, sizeof(rep.strings), "%s%s%s", name, date, desc);
+
+    return reply(c, DRM_IOCTL_VERSION, 0, &rep,
+        sizeof(rep.v) + rep.v.name_len + rep.v.date_len + rep.v.desc_len, NULL, 0);
+}
+
+static int do_get_cap(struct drm_get_cap* cap) {
+    switch (cap->capability) {
+    case DRM_CAP_DUMB_BUFFER:
+    case DRM_CAP_ADDFB2_MODIFIERS:
+    case DRM_CAP_ASYNC_PAGE_FLIP:
+        cap->value = 0;
+        return 0;
+    case DRM_CAP_PRIME:
+        cap->value = DRM_PRIME_CAP_IMPORT | DRM_PRIME_CAP_EXPORT;
+        return 0;
+    case DRM_CAP_TIMESTAMP_MONOTONIC:
+    case DRM_CAP_CRTC_IN_VBLANK_EVENT:
+        cap->value = 1;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static int do_set_client_cap(struct sim_client* c, const struct drm_set_client_cap* cap) {
+    switch (cap->capability) {
+    case DRM_CLIENT_CAP_ATOMIC:
+        if (cap->value > 2)
+            return -EINVAL;
+        c->atomic = cap->value;
+        return 0;
+    case DRM_CLIENT_CAP_UNIVERSAL_PLANES:
+    case DRM_CLIENT_CAP_STEREO_3D:
+    case DRM_CLIENT_CAP_ASPECT_RATIO:
+        return cap->value > 1 ? -EINVAL : 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static struct sim_handle* handle_lookup(struct sim_client* c, uint32_t handle) {
+    for (size_t i = 0; i < c->num_handles; i++) {
+        if (c->handles[i].handle == handle)
+            return &c->handles[i];
+    }
+
+    return NULL;
+}
+
+static struct sim_meta_entry* meta_find(dev_t dev, ino_t ino) {
+    for (struct sim_meta_entry* e = g_sim.meta; e; e = e->next) {
+        if (e->dev == dev && e->ino == ino)
+            return e;
+    }
+
+    return NULL;
+}
+
+static unsigned int meta_count(struct sim_client* owner) {
+    unsigned int count = 0;
+
+    for (struct sim_meta_entry* e = g_sim.meta; e; e = e->next)
+        count += e->owner == owner;
+
+    return count;
+}
+
+static void meta_free(struct sim_meta_entry* entry) {
+    for (struct sim_meta_entry** p = &g_sim.meta; *p; p = &(*p)->next) {
+        if (*p == entry) {
+            *p = entry->next;
+            break;
+        }
+    }
+
+    close(entry->fd);
+    free(entry);
+}
+
+/* takes ownership of fd like fget() would take a reference */
+static int do_prime_fd_to_handle(struct sim_client* c, struct drm_prime_handle* args, int fd) {
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return -EBADF;
+    }
+
+    struct sim_obj* obj = calloc(1, sizeof(*obj));
+    struct sim_handle* handles = realloc(c->handles, (c->num_handles + 1) * sizeof(*handles));
+    if (!obj || !handles) {
+        free(obj);
+        if (handles)
+            c->handles = handles;
+        close(fd);
+        return -ENOMEM;
+    }
+
+    obj->refcount = 1;
+    obj->fd = fd;
+    obj->dev = st.st_dev;
+    obj->ino = st.st_ino;
+
+    struct sim_meta_entry* entry = meta_find(st.st_dev, st.st_ino);
+    if (entry)
+        obj->meta = entry->meta;
+
+    c->handles = handles;
+    c->handles[c->num_handles].handle = ++c->next_handle;
+    c->handles[c->num_handles].obj = obj;
+    c->num_handles++;
+
+    args->handle = c->next_handle;
+    args->fd = -1;
+
+    return 0;
+}
+
+static int do_gem_close(struct sim_client* c, const struct drm_gem_close* args) {
+    struct sim_handle* h = handle_lookup(c, args->handle);
+    if (!h)
+        return -EINVAL;
+
+    obj_put(h->obj);
+    *h = c->handles[--c->num_handles];
+
+    return 0;
+}
+
+static int do_addfb2(struct sim_client* c, struct drm_mode_fb_cmd2* cmd) {
+    if (cmd->flags & DRM_MODE_FB_MODIFIERS)
+        return -EINVAL;
+
+    if (!cmd->width || !cmd->height || cmd->width > SIM_MAX_SIZE || cmd->height > SIM_MAX_SIZE)
+        return -EINVAL;
+
+    if (!cmd->handles[0])
+        return -EINVAL;
+
+    struct sim_fb* fb = calloc(1, sizeof(*fb));
+    if (!fb)
+        return -ENOMEM;
+
+    for (int i = 0; i < MEMBRANE_MAX_FDS; i++) {
+        if (!cmd->handles[i])
+            continue;
+
+        struct sim_handle* h = handle_lookup(c, cmd->handles[i]);
+        if (!h) {
+            fb->refcount = 1;
+            fb_put(fb);
+            return -ENOENT;
+        }
+
+        fb->objs[i] = h->obj;
+        h->obj->refcount++;
+    }
+
+    fb->refcount = 1;
+    fb->owner = c;
+    fb->id = g_sim.next_id++;
+    fb->format = cmd->pixel_format;
+    fb->next = g_sim.fbs;
+    g_sim.fbs = fb;
+
+    cmd->fb_id = fb->id;
+
+    return 0;
+}
+
+static void fb_remove(struct sim_fb* fb) {
+    for (struct sim_fb** p = &g_sim.fbs; *p; p = &(*p)->next) {
+        if (*p == fb) {
+            *p = fb->next;
+            break;
+        }
+    }
+
+    /* drm_framebuffer_remove() turns off the primary plane and its crtc */
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        struct sim_pipe* p = &g_sim.pipes[i];
+
+        if (p->kms.fb != fb)
+            continue;
+
+        fb_xchg(&p->kms.fb, NULL);
+        p->kms.plane_crtc = 0;
+
+        if (p->kms.active) {
+            p->kms.active = false;
+            crtc_disable(p);
+        }
+    }
+
+    fb_put(fb);
+}
+
+static int do_rmfb(struct sim_client* c, const uint32_t* id) {
+    struct sim_fb* fb = fb_lookup(*id);
+
+    if (!fb || fb->owner != c)
+        return -ENOENT;
+
+    fb_remove(fb);
+    return 0;
+}
+
+static int do_create_blob(struct sim_client* c, void* payload, uint32_t size) {
+    struct drm_mode_create_blob* args = payload;
+
+    if (size < sizeof(*args) || !args->length || size != sizeof(*args) + args->length)
+        return -EINVAL;
+
+    struct sim_blob* b = calloc(1, sizeof(*b));
+    if (!b)
+        return -ENOMEM;
+
+    b->owner = c;
+    b->id = g_sim.next_id++;
+    b->length = args->length;
+    b->next = g_sim.blobs;
+    g_sim.blobs = b;
+
+    args->blob_id = b->id;
+
+    return 0;
+}
+
+static int do_destroy_blob(struct sim_client* c, const struct drm_mode_destroy_blob* args) {
+    for (struct sim_blob** p = &g_sim.blobs; *p; p = &(*p)->next) {
+        struct sim_blob* b = *p;
+
+        if (b->id != args->blob_id)
+            continue;
+
+        if (b->owner != c)
+            return -EPERM;
+
+        *p = b->next;
+        free(b);
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+/* maps an object id to its pipe and the pipe 0 id of the same object */
+static struct sim_pipe* obj_pipe(uint32_t obj, uint32_t* kind) {
+    if (obj < MEMBRANE_SIM_PLANE_ID)
+        return NULL;
+
+    uint32_t index = (obj - MEMBRANE_SIM_PLANE_ID) / MEMBRANE_SIM_PIPE_STRIDE;
+    uint32_t base = obj - index * MEMBRANE_SIM_PIPE_STRIDE;
+
+    if (index >= MEMBRANE_MAX_DISPLAYS || base > MEMBRANE_SIM_CONNECTOR_ID)
+        return NULL;
+
+    *kind = base;
+    return &g_sim.pipes[index];
+}
+
+static int set_prop(struct sim_kms* states, uint32_t obj, uint32_t prop, uint64_t value) {
+    uint32_t kind;
+    struct sim_pipe* p = obj_pipe(obj, &kind);
+
+    if (!p)
+        return -ENOENT;
+
+    struct sim_kms* s = &states[p->index];
+    uint32_t crtc_id = membrane_sim_obj_id(MEMBRANE_SIM_CRTC_ID, p->index);
+
+    switch (kind) {
+    case MEMBRANE_SIM_PLANE_ID:
+        switch (prop) {
+        case MEMBRANE_SIM_PROP_FB_ID:
+            if (value && !fb_lookup(value))
+                return -ENOENT;
+            s->fb = value ? fb_lookup(value) : NULL;
+            return 0;
+        case MEMBRANE_SIM_PROP_CRTC_ID:
+            if (value && value != crtc_id)
+                return -ENOENT;
+            s->plane_crtc = value;
+            return 0;
+        case MEMBRANE_SIM_PROP_SRC_X ... MEMBRANE_SIM_PROP_CRTC_H:
+            return 0;
+        }
+        break;
+    case MEMBRANE_SIM_CRTC_ID:
+        switch (prop) {
+        case MEMBRANE_SIM_PROP_ACTIVE:
+            s->active = !!value;
+            return 0;
+        case MEMBRANE_SIM_PROP_MODE_ID: {
+            struct sim_blob* b = value ? blob_lookup(value) : NULL;
+            if (value && (!b || b->length != sizeof(struct drm_mode_modeinfo)))
+                return -EINVAL;
+            s->mode_id = value;
+            return 0;
+        }
+        }
+        break;
+    case MEMBRANE_SIM_CONNECTOR_ID:
+        switch (prop) {
+        case MEMBRANE_SIM_PROP_CRTC_ID:
+            if (value && value != crtc_id)
+                return -ENOENT;
+            s->conn_crtc = value;
+            return 0;
+        case MEMBRANE_SIM_PROP_DPMS:
+            return 0;
+        case MEMBRANE_SIM_PROP_LOW_POWER:
+            if (value > MEMBRANE_LOW_POWER_DOZE_SUSPEND)
+                return -EINVAL;
+            s->low_power = value;
+            return 0;
+        }
+        break;
+    default:
+        return -ENOENT;
+    }
+
+    return -EINVAL;
+}
+
+static int check_pipe(const struct sim_kms* s, const struct sim_kms* cur, uint32_t flags) {
+    bool modeset
+        = s->active != cur->active || s->mode_id != cur->mode_id || s->conn_crtc != cur->conn_crtc;
+
+    if (modeset && !(flags & DRM_MODE_ATOMIC_ALLOW_MODESET))
+        return -EINVAL;
+
+    if (s->active && !s->mode_id)
+        return -EINVAL;
+
+    if (!s->fb != !s->plane_crtc)
+        return -EINVAL;
+
+    if (s->fb && s->fb->format != DRM_FORMAT_XRGB8888 && s->fb->format != DRM_FORMAT_ARGB8888)
+        return -EINVAL;
+
+    if ((flags & DRM_MODE_PAGE_FLIP_EVENT) && !s->active && !cur->active)
+        return -EINVAL;
+
+    return 0;
+}
+
+/* same order as membrane_atomic_commit_tail: disables, planes + flush, enables */
+static void commit_pipe(struct sim_pipe* p, const struct sim_kms* s, bool touches_plane,
+    struct sim_client* c, const struct drm_mode_atomic* a) {
+    bool was_active = p->kms.active;
+    bool power_changed = p->kms.low_power != s->low_power;
+
+    fb_get(s->fb);
+    fb_xchg(&p->kms.fb, s->fb);
+    p->kms.active = s->active;
+    p->kms.mode_id = s->mode_id;
+    p->kms.plane_crtc = s->plane_crtc;
+    p->kms.conn_crtc = s->conn_crtc;
+    p->kms.low_power = s->low_power;
+
+    if (was_active && !s->active)
+        crtc_disable(p);
+
+    if (touches_plane && s->fb) {
+        fb_get(s->fb);
+        fb_xchg(&p->pending_state, s->fb);
+    }
+
+    if (a->flags & DRM_MODE_PAGE_FLIP_EVENT)
+        vblank_event_commit(p, c, a->user_data);
+
+    if (power_changed && was_active && s->active)
+        send_event(p, MEMBRANE_DPMS_UPDATED, pipe_dpms(p));
+
+    if (!was_active && s->active)
+        crtc_enable(p);
+
+    /* nothing will vblank, complete the flip right away */
+    if (!s->active)
+        vblank_event_commit(p, NULL, 0);
+}
+
+/* returns 1 when a blocking commit has to wait for the previous flip */
+static int do_atomic(struct sim_client* c, const void* payload, uint32_t size) {
+    const uint32_t valid_flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_TEST_ONLY
+        | DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_ATOMIC_ALLOW_MODESET;
+    struct drm_mode_atomic a;
+
+    if (!c->atomic)
+        return -EINVAL;
+
+    if (c != g_sim.master)
+        return -EACCES;
+
+    if (size < sizeof(a))
+        return -EINVAL;
+
+    memcpy(&a, payload, sizeof(a));
+
+    if (a.flags & ~valid_flags)
+        return -EINVAL;
+
+    if ((a.flags & DRM_MODE_ATOMIC_TEST_ONLY) && (a.flags & DRM_MODE_PAGE_FLIP_EVENT))
+        return -EINVAL;
+
+    const uint32_t* objs = (const uint32_t*)((const uint8_t*)payload + sizeof(a));
+    const uint32_t* counts = objs + a.count_objs;
+    size_t total = 0;
+
+    if (size < sizeof(a) + 2 * a.count_objs * sizeof(uint32_t))
+        return -EINVAL;
+
+    for (uint32_t i = 0; i < a.count_objs; i++)
+        total += counts[i];
+
+    if (size != sizeof(a) + 2 * a.count_objs * sizeof(uint32_t)
+            + total * (sizeof(uint32_t) + sizeof(uint64_t)))
+        return -EINVAL;
+
+    const uint32_t* props = counts + a.count_objs;
+    const uint8_t* values = (const uint8_t*)(props + total);
+
+    struct sim_kms s[MEMBRANE_MAX_DISPLAYS];
+    bool touched[MEMBRANE_MAX_DISPLAYS] = {};
+    bool touches_plane[MEMBRANE_MAX_DISPLAYS] = {};
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++)
+        s[i] = g_sim.pipes[i].kms;
+
+    for (uint32_t i = 0, k = 0; i < a.count_objs; i++) {
+        uint32_t kind;
+        struct sim_pipe* p = obj_pipe(objs[i], &kind);
+
+        if (!p)
+            return -ENOENT;
+
+        for (uint32_t j = 0; j < counts[i]; j++, k++) {
+            uint64_t value;
+            memcpy(&value, values + k * sizeof(uint64_t), sizeof(value));
+
+            int ret = set_prop(s, objs[i], props[k], value);
+            if (ret)
+                return ret;
+        }
+
+        touched[p->index] = true;
+        touches_plane[p->index] |= kind == MEMBRANE_SIM_PLANE_ID;
+    }
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        if (!touched[i])
+            continue;
+
+        int ret = check_pipe(&s[i], &g_sim.pipes[i].kms, a.flags);
+        if (ret)
+            return ret;
+    }
+
+    if (a.flags & DRM_MODE_ATOMIC_TEST_ONLY)
+        return 0;
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        if (!touched[i] || !g_sim.pipes[i].flip_armed)
+            continue;
+
+        if (a.flags & DRM_MODE_ATOMIC_NONBLOCK)
+            return -EBUSY;
+        return 1;
+    }
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        if (touched[i])
+            commit_pipe(&g_sim.pipes[i], &s[i], touches_plane[i], c, &a);
+    }
+
+    return 0;
+}
+
+static void process_parked(void) {
+    for (struct sim_client* c = g_sim.clients; c; c = c->next) {
+        if (!c->parked)
+            continue;
+
+        int ret = do_atomic(c, c->parked, c->parked_size);
+        if (ret == 1)
+            continue;
+
+        free(c->parked);
+        c->parked = NULL;
+        reply(c, DRM_IOCTL_MODE_ATOMIC, ret, NULL, 0, NULL, 0);
+    }
+}
+
+/* brings a restarted consumer up to date: the DPMS state, or the frame that is on screen */
+static void handoff(struct sim_pipe* p) {
+    uint32_t count = 0;
+
+    p->handoff = false;
+
+    if (p->dpms_state == MEMBRANE_DPMS_OFF || p->dpms_state == MEMBRANE_DPMS_NO_COMP) {
+        send_event(p, MEMBRANE_DPMS_UPDATED, p->dpms_state);
+        return;
+    }
+
+    if (p->last_state) {
+        count = fb_count_objs(p->last_state);
+
+        /* a frame latched while nobody was listening is newer, keep that one */
+        if (!p->active_state)
+            p->active_state = p->last_state;
+        else
+            fb_put(p->last_state);
+        p->last_state = NULL;
+    } else if (!p->active_state) {
+        if (p->dpms_state != MEMBRANE_DPMS_ON)
+            send_event(p, MEMBRANE_DPMS_UPDATED, p->dpms_state);
+        return;
+    }
+
+    if (p->dpms_state != MEMBRANE_DPMS_ON)
+        send_event(p, MEMBRANE_PRESENT_UPDATED | MEMBRANE_DPMS_UPDATED, p->dpms_state);
+    else
+        send_event(p, MEMBRANE_PRESENT_UPDATED, count);
+}
+
+static int do_config(struct sim_client* c, const struct membrane_u2k_cfg* cfg) {
+    if (cfg->display < 0 || cfg->display >= MEMBRANE_MAX_DISPLAYS)
+        return -EINVAL;
+
+    struct sim_pipe* p = &g_sim.pipes[cfg->display];
+
+    if (!cfg->w || !cfg->h) {
+        if (!p->index)
+            return -EINVAL;
+
+        if (p->connected) {
+            p->connected = false;
+            send_event(p, MEMBRANE_DISPLAY_REMOVED, 0);
+            membrane_debug("config %d: unplugged", cfg->display);
+        }
+
+        return 0;
+    }
+
+    if (!p->event_consumer) {
+        p->event_posted = false;
+        p->event_consumer = c;
+        p->stopping = false;
+
+        if (p->handoff)
+            handoff(p);
+    }
+
+    p->doze_r = cfg->doze_r;
+
+    if (p->w != cfg->w || p->h != cfg->h || p->r != cfg->r || !p->connected) {
+        p->w = cfg->w;
+        p->h = cfg->h;
+        p->r = cfg->r;
+        p->connected = true;
+        membrane_debug("config %d: %dx%d@%d", cfg->display, cfg->w, cfg->h, cfg->r);
+    }
+
+    return 0;
+}
+
+static int do_present_fd(struct sim_client* c, uint32_t display) {
+    struct membrane_get_present_fd args = { .display = display };
+    int fds[MEMBRANE_MAX_FDS];
+    int count = 0;
+
+    if (display >= MEMBRANE_MAX_DISPLAYS)
+        return reply(c, DRM_IOCTL_MEMBRANE_GET_PRESENT_FD, -EINVAL, NULL, 0, NULL, 0);
+
+    if (g_sim.pipes[display].event_consumer != c)
+        return reply(c, DRM_IOCTL_MEMBRANE_GET_PRESENT_FD, -EACCES, NULL, 0, NULL, 0);
+
+    struct sim_fb* fb = g_sim.pipes[display].active_state;
+    g_sim.pipes[display].active_state = NULL;
+
+    for (int i = 0; i < MEMBRANE_MAX_FDS; i++)
+        args.fds[i] = -1;
+
+    if (fb) {
+        args.buffer_id = fb->id;
+
+        if (fb->objs[0]) {
+            struct sim_obj* obj = fb->objs[0];
+
+            if (!obj->meta.version) {
+                struct sim_meta_entry* entry = meta_find(obj->dev, obj->ino);
+                if (entry)
+                    obj->meta = entry->meta;
+            }
+
+            args.meta = obj->meta;
+        }
+
+        for (int i = 0; i < MEMBRANE_MAX_FDS; i++) {
+            struct sim_obj* obj = fb->objs[i];
+            bool shared = false;
+
+            if (!obj)
+                continue;
+
+            for (int j = 0; j < i; j++) {
+                if (fb->objs[j] && fb->objs[j]->dev == obj->dev && fb->objs[j]->ino == obj->ino)
+                    shared = true;
+            }
+            if (shared)
+                continue;
+
+            fds[count] = obj->fd;
+            args.fds[count] = count;
+            count++;
+        }
+
+        args.num_fds = count;
+    }
+
+    int ret = reply(c, DRM_IOCTL_MEMBRANE_GET_PRESENT_FD, 0, &args, sizeof(args), fds, count);
+    if (fb)
+        fb_xchg(&g_sim.pipes[display].last_state, fb);
+
+    return ret;
+}
+
+static int do_meta(struct sim_client* c, struct membrane_meta_op* arg, int fd) {
+    struct stat st;
+    int ret = 0;
+
+    if (arg->op == MEMBRANE_META_SET
+        && (arg->meta.version != MEMBRANE_META_VERSION || arg->meta.num_ints > MEMBRANE_MAX_INTS)) {
+        if (fd >= 0)
+            close(fd);
+        return -EINVAL;
+    }
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return -EBADF;
+    }
+
+    struct sim_meta_entry* entry = meta_find(st.st_dev, st.st_ino);
+
+    switch (arg->op) {
+    case MEMBRANE_META_SET:
+        if (!entry) {
+            if (meta_count(c) >= SIM_META_MAX_ENTRIES) {
+                ret = -ENOSPC;
+                break;
+            }
+            entry = calloc(1, sizeof(*entry));
+            if (!entry) {
+                ret = -ENOMEM;
+                break;
+            }
+            entry->fd = fd;
+            entry->dev = st.st_dev;
+            entry->ino = st.st_ino;
+            entry->next = g_sim.meta;
+            g_sim.meta = entry;
+            entry->owner = c;
+            fd = -1;
+        } else if (entry->owner != c) {
+            ret = -EBUSY;
+            break;
+        }
+        entry->meta = arg->meta;
+        entry->id = ++g_sim.meta_seq;
+        arg->id = entry->id;
+        break;
+    case MEMBRANE_META_GET:
+        if (entry) {
+            arg->meta = entry->meta;
+            arg->id = entry->id;
+        } else {
+            ret = -ENOENT;
+        }
+        break;
+    case MEMBRANE_META_CLEAR:
+        if (entry && entry->owner != c)
+            ret = -EBUSY;
+        else if (entry)
+            meta_free(entry);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return ret;
+}
+
+/* everything but the flattened and output-only ioctls carries exactly the ioctl struct */
+static bool payload_ok(const struct membrane_sim_msg* hdr) {
+    switch (hdr->request) {
+    case MEMBRANE_SIM_HELLO:
+    case DRM_IOCTL_VERSION:
+        return hdr->size == 0;
+    case DRM_IOCTL_MEMBRANE_GET_PRESENT_FD:
+        return hdr->size == sizeof(uint32_t);
+    case DRM_IOCTL_MODE_ATOMIC:
+    case DRM_IOCTL_MODE_CREATEPROPBLOB:
+        return true;
+    default:
+        return !(_IOC_DIR(hdr->request) & _IOC_WRITE) || hdr->size == _IOC_SIZE(hdr->request);
+    }
+}
+
+static void client_handle(struct sim_client* c) {
+    static uint8_t buf[MEMBRANE_SIM_MAX_PAYLOAD];
+    struct membrane_sim_msg hdr;
+    int fds[MEMBRANE_MAX_FDS];
+    int num_fds = 0;
+
+    if (membrane_sim_recv(c->ctl, &hdr, buf, sizeof(buf), fds, &num_fds) < 0) {
+        c->dead = true;
+        return;
+    }
+
+    int fd = num_fds > 0 ? fds[0] : -1;
+    for (int i = 1; i < num_fds; i++)
+        close(fds[i]);
+
+    uint32_t rsize = 0;
+    int ret;
+
+    if (!payload_ok(&hdr)) {
+        if (fd >= 0)
+            close(fd);
+        reply(c, hdr.request, -EINVAL, NULL, 0, NULL, 0);
+        return;
+    }
+
+    switch (hdr.request) {
+    case MEMBRANE_SIM_HELLO: {
+        int sv[2];
+
+        if (c->ev >= 0) {
+            reply(c, hdr.request, -EINVAL, NULL, 0, NULL, 0);
+            return;
+        }
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+            reply(c, hdr.request, -errno, NULL, 0, NULL, 0);
+            return;
+        }
+
+        c->ev = sv[0];
+        if (!g_sim.master)
+            g_sim.master = c;
+
+        reply(c, hdr.request, 0, NULL, 0, &sv[1], 1);
+        close(sv[1]);
+        return;
+    }
+    case DRM_IOCTL_VERSION:
+        do_version(c);
+        return;
+    case DRM_IOCTL_MEMBRANE_SIGNAL: {
+        const struct membrane_event* ev = (const void*)buf;
+        struct sim_pipe* p;
+
+        if (ev->display >= MEMBRANE_MAX_DISPLAYS) {
+            reply(c, hdr.request, -EINVAL, NULL, 0, NULL, 0);
+            return;
+        }
+
+        p = &g_sim.pipes[ev->display];
+        if (p->event_posted) {
+            p->event_posted = false;
+            reply(c, hdr.request, 0, &p->pending_event, sizeof(p->pending_event), NULL, 0);
+        } else {
+            c->signal_pipe = ev->display;
+        }
+        return;
+    }
+    case DRM_IOCTL_MEMBRANE_GET_PRESENT_FD: {
+        uint32_t display;
+        memcpy(&display, buf, sizeof(display));
+        do_present_fd(c, display);
+        return;
+    }
+    case DRM_IOCTL_MODE_ATOMIC:
+        ret = do_atomic(c, buf, hdr.size);
+        if (ret == 1) {
+            c->parked = malloc(hdr.size);
+            c->parked_size = hdr.size;
+            memcpy(c->parked, buf, hdr.size);
+            return;
+        }
+        break;
+    case DRM_IOCTL_MODE_CREATEPROPBLOB:
+        ret = do_create_blob(c, buf, hdr.size);
+        rsize = sizeof(struct drm_mode_create_blob);
+        break;
+    case DRM_IOCTL_MODE_DESTROYPROPBLOB:
+        ret = do_destroy_blob(c, (void*)buf);
+        break;
+    case DRM_IOCTL_GET_CAP:
+        ret = do_get_cap((void*)buf);
+        rsize = hdr.size;
+        break;
+    case DRM_IOCTL_SET_CLIENT_CAP:
+        ret = do_set_client_cap(c, (void*)buf);
+        break;
+    case DRM_IOCTL_SET_MASTER:
+        ret = g_sim.master && g_sim.master != c ? -EBUSY : 0;
+        if (!ret)
+            g_sim.master = c;
+        break;
+    case DRM_IOCTL_DROP_MASTER:
+        ret = g_sim.master == c ? 0 : -EINVAL;
+        if (!ret)
+            g_sim.master = NULL;
+        break;
+    case DRM_IOCTL_PRIME_FD_TO_HANDLE:
+        ret = do_prime_fd_to_handle(c, (void*)buf, fd);
+        fd = -1;
+        rsize = hdr.size;
+        break;
+    case DRM_IOCTL_GEM_CLOSE:
+        ret = do_gem_close(c, (void*)buf);
+        break;
+    case DRM_IOCTL_MODE_ADDFB2:
+        ret = do_addfb2(c, (void*)buf);
+        rsize = hdr.size;
+        break;
+    case DRM_IOCTL_MODE_RMFB:
+        ret = do_rmfb(c, (void*)buf);
+        break;
+    case DRM_IOCTL_MEMBRANE_CONFIG:
+        ret = do_config(c, (void*)buf);
+        break;
+    case DRM_IOCTL_MEMBRANE_META:
+        ret = do_meta(c, (void*)buf, fd);
+        fd = -1;
+        rsize = hdr.size;
+        break;
+    default:
+        membrane_debug("unsupported ioctl 0x%08x", hdr.request);
+        ret = -EOPNOTSUPP;
+        break;
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    reply(c, hdr.request, ret, buf, ret ? 0 : rsize, NULL, 0);
+}
+
+/* same teardown order as drm_file_free() followed by membrane_postclose() */
+static void client_destroy(struct sim_client* c) {
+    for (struct sim_fb *fb = g_sim.fbs, *next; fb; fb = next) {
+        next = fb->next;
+        if (fb->owner == c)
+            fb_remove(fb);
+    }
+
+    for (struct sim_blob **p = &g_sim.blobs, *b; (b = *p);) {
+        if (b->owner == c) {
+            *p = b->next;
+            free(b);
+        } else {
+            p = &b->next;
+        }
+    }
+
+    for (size_t i = 0; i < c->num_handles; i++)
+        obj_put(c->handles[i].obj);
+    free(c->handles);
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        struct sim_pipe* p = &g_sim.pipes[i];
+
+        if (p->flip_armed && p->flip_event.client == c) {
+            p->flip_armed = false;
+            p->flip_event.client = NULL;
+        }
+    }
+
+    if (g_sim.master == c)
+        g_sim.master = NULL;
+
+    for (struct sim_meta_entry *e = g_sim.meta, *next; e; e = next) {
+        next = e->next;
+        if (e->owner == c)
+            meta_free(e);
+    }
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        struct sim_pipe* p = &g_sim.pipes[i];
+
+        if (p->event_consumer != c)
+            continue;
+
+        p->event_consumer = NULL;
+        p->stopping = true;
+        p->event_posted = false;
+
+        /* the internal panel keeps scanning out for whoever configures it next */
+        if (i == 0) {
+            p->handoff = true;
+            continue;
+        }
+
+        timer_cancel(p);
+        fb_xchg(&p->active_state, NULL);
+        fb_xchg(&p->pending_state, NULL);
+        fb_xchg(&p->last_state, NULL);
+        p->connected = false;
+    }
+
+    for (struct sim_client** p = &g_sim.clients; *p; p = &(*p)->next) {
+        if (*p == c) {
+            *p = c->next;
+            break;
+        }
+    }
+
+    free(c->parked);
+    if (c->ev >= 0)
+        close(c->ev);
+    close(c->ctl);
+    free(c);
+}
+
+static int listen_socket(void) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    membrane_sim_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    membrane_assert(fd >= 0);
+
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        membrane_err("%s: %s", addr.sun_path, strerror(errno));
+        exit(1);
+    }
+
+    membrane_debug("listening on %s", addr.sun_path);
+
+    return fd;
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+
+    g_sim.next_id = SIM_FIRST_ID;
+
+    const char* refresh = getenv("MEMBRANE_SIM_REFRESH");
+    const char* jitter = getenv("MEMBRANE_SIM_JITTER_US");
+
+    if (refresh)
+        g_sim.refresh_override = atoi(refresh);
+    if (jitter)
+        g_sim.jitter_ns = atoll(jitter) * 1000;
+
+    for (int i = 0; i < MEMBRANE_MAX_DISPLAYS; i++) {
+        struct sim_pipe* p = &g_sim.pipes[i];
+
+        p->index = i;
+        p->w = 1920;
+        p->h = 1080;
+        p->r = 60;
+        p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        membrane_assert(p->timer_fd >= 0);
+    }
+
+    int lfd = listen_socket();
+
+    for (;;) {
+        const size_t first = 1 + MEMBRANE_MAX_DISPLAYS;
+        size_t n = first;
+        for (struct sim_client* c = g_sim.clients; c; c = c->next)
+            n++;
+
+        struct pollfd pfds[n];
+        struct sim_client* owners[n];
+
+        pfds[0] = (struct pollfd) { .fd = lfd, .events = POLLIN };
+        for (int p = 0; p < MEMBRANE_MAX_DISPLAYS; p++)
+            pfds[1 + p] = (struct pollfd) { .fd = g_sim.pipes[p].timer_fd, .events = POLLIN };
+
+        size_t i = first;
+        for (struct sim_client* c = g_sim.clients; c; c = c->next, i++) {
+            pfds[i] = (struct pollfd) { .fd = c->ctl, .events = POLLIN };
+            owners[i] = c;
+        }
+
+        if (poll(pfds, n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            membrane_err("poll: %s", strerror(errno));
+            return 1;
+        }
+
+        for (int p = 0; p < MEMBRANE_MAX_DISPLAYS; p++) {
+            uint64_t expirations;
+
+            if ((pfds[1 + p].revents & POLLIN)
+                && read(g_sim.pipes[p].timer_fd, &expirations, sizeof(expirations)) > 0)
+                vblank(&g_sim.pipes[p]);
+        }
+
+        for (i = first; i < n; i++) {
+            if (pfds[i].revents & POLLIN)
+                client_handle(owners[i]);
+            else if (pfds[i].revents & (POLLHUP | POLLERR))
+                owners[i]->dead = true;
+        }
+
+        for (struct sim_client *c = g_sim.clients, *next; c; c = next) {
+            next = c->next;
+            if (c->dead)
+                client_destroy(c);
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd < 0)
+                continue;
+
+            struct sim_client* c = calloc(1, sizeof(*c));
+            c->ctl = fd;
+            c->ev = -1;
+            c->signal_pipe = -1;
+            c->next = g_sim.clients;
+            g_sim.clients = c;
+        }
+    }
+
+    return 0;
+}